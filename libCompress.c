@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tinyFS.h"
+#include "tinyFS_errno.h"
+
+#define HASH_BITS 12
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+
+int hashSequence(const unsigned char *src);
+unsigned char *writeLength(unsigned char *dst, int length);
+
+/* The compressed stream is a list of sequences. Each starts with a token byte: the high
+ * four bits are the number of literal bytes that follow it and the low four bits are the
+ * length of the match after them minus MIN_MATCH. A nibble of 15 means the rest of the
+ * length follows the token in bytes of 255 and a final byte below 255. After the literals
+ * comes a two byte little endian offset back into the output to copy the match from. The
+ * last sequence ends after its literals and has no match.
+ */
+
+/* lzCompress() compresses srcSize bytes from src into dst, which must have room for at
+ * least LZ_BOUND(srcSize) bytes. Matches are found greedily through a hash table of the
+ * last position each four byte sequence was seen at. Returns the compressed length.
+ */
+int lzCompress(const char *src, int srcSize, char *dst) {
+	const unsigned char *in = (const unsigned char *)src;
+	unsigned char *out = (unsigned char *)dst;
+	int table[1 << HASH_BITS];
+	int pos = 0, literalStart = 0, candidate, hash, matchLength, literalLength;
+
+	memset(table, -1, sizeof(table));
+
+	while(pos + MIN_MATCH <= srcSize) {
+		hash = hashSequence(&in[pos]);
+		candidate = table[hash];
+		table[hash] = pos;
+
+		if(candidate < 0 || pos - candidate > MAX_OFFSET ||
+				memcmp(&in[candidate], &in[pos], MIN_MATCH) != 0) {
+			pos++;
+			continue;
+		}
+
+		matchLength = MIN_MATCH;
+
+		while(pos + matchLength < srcSize && in[candidate + matchLength] == in[pos + matchLength]) {
+			matchLength++;
+		}
+
+		literalLength = pos - literalStart;
+
+		*out++ = (literalLength < 15 ? literalLength : 15) << 4 |
+			(matchLength - MIN_MATCH < 15 ? matchLength - MIN_MATCH : 15);
+
+		if(literalLength >= 15) out = writeLength(out, literalLength - 15);
+
+		memcpy(out, &in[literalStart], literalLength);
+		out += literalLength;
+
+		*out++ = (pos - candidate) & 0xFF;
+		*out++ = (pos - candidate) >> 8;
+
+		if(matchLength - MIN_MATCH >= 15) out = writeLength(out, matchLength - MIN_MATCH - 15);
+
+		pos += matchLength;
+		literalStart = pos;
+	}
+
+	//	whatever is left goes out as literals
+	literalLength = srcSize - literalStart;
+
+	*out++ = (literalLength < 15 ? literalLength : 15) << 4;
+
+	if(literalLength >= 15) out = writeLength(out, literalLength - 15);
+
+	memcpy(out, &in[literalStart], literalLength);
+	out += literalLength;
+
+	return out - (unsigned char *)dst;
+}
+
+/* lzDecompress() decompresses srcSize bytes of lzCompress() output from src into dst,
+ * writing at most dstCapacity bytes. Returns the decompressed length, or -1 if the input
+ * is malformed or decompresses to more than dstCapacity bytes.
+ */
+int lzDecompress(const char *src, int srcSize, char *dst, int dstCapacity) {
+	const unsigned char *in = (const unsigned char *)src, *end = in + srcSize;
+	unsigned char *out = (unsigned char *)dst;
+	int token, length, offset, produced = 0;
+
+	while(in < end) {
+		token = *in++;
+		length = token >> 4;
+
+		if(length == 15) {
+			do {
+				if(in >= end) return -1;
+
+				length += *in;
+			} while(*in++ == 255);
+		}
+
+		if(length > end - in || length > dstCapacity - produced) {
+			return -1;
+		}
+
+		memcpy(&out[produced], in, length);
+		in += length;
+		produced += length;
+
+		//	the last sequence has no match
+		if(in == end) break;
+
+		if(end - in < 2) {
+			return -1;
+		}
+
+		offset = in[0] | in[1] << 8;
+		in += 2;
+		length = (token & 0x0F) + MIN_MATCH;
+
+		if((token & 0x0F) == 15) {
+			do {
+				if(in >= end) return -1;
+
+				length += *in;
+			} while(*in++ == 255);
+		}
+
+		if(offset == 0 || offset > produced || length > dstCapacity - produced) {
+			return -1;
+		}
+
+		//	byte by byte, since the match may overlap the bytes it produces
+		for(; length > 0; length--, produced++) {
+			out[produced] = out[produced - offset];
+		}
+	}
+
+	return produced;
+}
+
+int hashSequence(const unsigned char *src) {
+	uint32_t sequence;
+
+	memcpy(&sequence, src, sizeof(sequence));
+
+	return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+unsigned char *writeLength(unsigned char *dst, int length) {
+	for(; length >= 255; length -= 255) *dst++ = 255;
+
+	*dst++ = length;
+
+	return dst;
+}
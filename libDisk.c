@@ -1,8 +1,10 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 #include "tinyFS.h"
 #include "tinyFS_errno.h"
@@ -12,6 +14,10 @@ Disk *findDisk(int diskNum);
 
 DiskNode *head;
 
+//	disks and their list nodes live as long as the process
+Pool diskPool = POOL_INIT(Disk, 16);
+Pool diskNodePool = POOL_INIT(DiskNode, 16);
+
 int diskCount = 0;
 
 /* This functions opens a regular UNIX file and designates the first nBytes of it as 
@@ -19,15 +25,17 @@ int diskCount = 0;
  * If nBytes > 0 and there is already a file by the given filename, that file’s contents
  * may be overwritten. If nBytes is 0, an existing disk is opened, and should not be
  * overwritten. There is no requirement to maintain integrity of any file content beyond
- * nBytes. The return value is -1 on failure or a disk number on success.
+ * nBytes. nBytes is an off_t, so a disk may be bigger than 2 GiB, up to INT32_MAX blocks.
+ * The return value is -1 on failure or a disk number on success.
  */
-int openDisk(char *filename, int nBytes) {
+int openDisk(char *filename, off_t nBytes) {
 	int diskNum = 0;
 	FILE *file;
 	Disk disk;
 	char *permissions = "w+";
 	
-	if(nBytes % BLOCKSIZE != 0) {
+	//	block numbers are ints, which is what bounds a disk's size
+	if(nBytes % BLOCKSIZE != 0 || nBytes < 0 || nBytes / BLOCKSIZE > INT32_MAX) {
 		return OPENDISK_FAILURE;
 	}
 
@@ -72,12 +80,15 @@ int openDisk(char *filename, int nBytes) {
 void addDisk(Disk disk) {
 	DiskNode *curr;
 
-	Disk *diskPtr = malloc(sizeof(Disk));
+	Disk *diskPtr = poolAlloc(&diskPool);
 	memcpy(diskPtr, &disk, sizeof(Disk));
+
+	pthread_mutex_init(&diskPtr->syncLock, NULL);
+	pthread_cond_init(&diskPtr->syncDone, NULL);
 	
 	//	create head if it is null
 	if(head == NULL) {
-		head = malloc(sizeof(DiskNode));
+		head = poolAlloc(&diskNodePool);
 		*head = (DiskNode) {
 			diskPtr,
 			NULL
@@ -88,7 +99,7 @@ void addDisk(Disk disk) {
 		
 		while(curr->next != NULL) curr = curr->next;
 				
-		curr->next = malloc(sizeof(DiskNode));
+		curr->next = poolAlloc(&diskNodePool);
 		*(curr->next) = (DiskNode) {
 			diskPtr,
 			NULL
@@ -127,7 +138,7 @@ Disk *findDisk(int diskNum) {
  */
 int readBlock(int disk, int bNum, void *block) {
 	Disk *diskPtr;
-	int byteOffset;
+	off_t byteOffset;
 	
 	diskPtr = findDisk(disk);
 	
@@ -135,20 +146,44 @@ int readBlock(int disk, int bNum, void *block) {
 		return READBLOCK_FAILURE;
 	}
 	
-	byteOffset = bNum * BLOCKSIZE;
+	byteOffset = (off_t) bNum * BLOCKSIZE;
 	
 	if(byteOffset + BLOCKSIZE > diskPtr->space) {
 		return DISK_PAST_LIMITS;
 	}
 	
-	//	seek to correct location in file
-	if(fseek(diskPtr->file, byteOffset, SEEK_SET) != 0) {
+	//	read at the block's offset without moving the file position, so threads can
+	//	read the disk at once
+	if(pread(fileno(diskPtr->file), block, BLOCKSIZE, byteOffset) < 0) {
 		return READBLOCK_FAILURE;
 	}
 	
-	//	read from file into block buffer
-	fread(block, BLOCKSIZE, 1, diskPtr->file);
-	
+	return 0;
+}
+
+/* readBlocks() is readBlock() for nBlocks consecutive blocks, read with one pread() so a
+ * run of blocks costs the same number of calls as a single one.
+ */
+int readBlocks(int disk, int bNum, int nBlocks, void *blocks) {
+	Disk *diskPtr;
+	off_t byteOffset;
+
+	diskPtr = findDisk(disk);
+
+	if(diskPtr == NULL || !diskPtr->open) {
+		return READBLOCK_FAILURE;
+	}
+
+	byteOffset = (off_t) bNum * BLOCKSIZE;
+
+	if(bNum < 0 || nBlocks < 0 || byteOffset + (off_t) nBlocks * BLOCKSIZE > diskPtr->space) {
+		return DISK_PAST_LIMITS;
+	}
+
+	if(pread(fileno(diskPtr->file), blocks, (size_t) nBlocks * BLOCKSIZE, byteOffset) < 0) {
+		return READBLOCK_FAILURE;
+	}
+
 	return 0;
 }
 
@@ -161,7 +196,7 @@ int readBlock(int disk, int bNum, void *block) {
 */
 int writeBlock(int disk, int bNum, void *block) {
 	Disk *diskPtr;
-	int byteOffset;
+	off_t byteOffset;
 	
 	diskPtr = findDisk(disk);
 	
@@ -169,19 +204,50 @@ int writeBlock(int disk, int bNum, void *block) {
 		return WRITEBLOCK_FAILURE;
 	}
 	
-	byteOffset = bNum * BLOCKSIZE;
+	byteOffset = (off_t) bNum * BLOCKSIZE;
 	
 	if(byteOffset + BLOCKSIZE > diskPtr->space) {
 		return DISK_PAST_LIMITS;
 	}
 
-	//	seek to correct location in file
-	if(fseek(diskPtr->file, byteOffset, SEEK_SET) != 0) {
+	//	written straight to the file rather than through its stdio buffer, so reads with
+	//	pread() see it
+	if(pwrite(fileno(diskPtr->file), block, BLOCKSIZE, byteOffset) != BLOCKSIZE) {
 		return WRITEBLOCK_FAILURE;
 	}
 
-	//	write from block buffer into file
-	fwrite(block, BLOCKSIZE, 1, diskPtr->file);
+	pthread_mutex_lock(&diskPtr->syncLock);
+	diskPtr->writes++;
+	pthread_mutex_unlock(&diskPtr->syncLock);
+
+	return 0;
+}
+
+/* writeBlocks() is writeBlock() for nBlocks consecutive blocks, written with one pwrite().
+ */
+int writeBlocks(int disk, int bNum, int nBlocks, void *blocks) {
+	Disk *diskPtr;
+	off_t byteOffset;
+
+	diskPtr = findDisk(disk);
+
+	if(diskPtr == NULL || !diskPtr->open) {
+		return WRITEBLOCK_FAILURE;
+	}
+
+	byteOffset = (off_t) bNum * BLOCKSIZE;
+
+	if(bNum < 0 || nBlocks < 0 || byteOffset + (off_t) nBlocks * BLOCKSIZE > diskPtr->space) {
+		return DISK_PAST_LIMITS;
+	}
+
+	if(pwrite(fileno(diskPtr->file), blocks, (size_t) nBlocks * BLOCKSIZE, byteOffset) != (ssize_t) nBlocks * BLOCKSIZE) {
+		return WRITEBLOCK_FAILURE;
+	}
+
+	pthread_mutex_lock(&diskPtr->syncLock);
+	diskPtr->writes += nBlocks;
+	pthread_mutex_unlock(&diskPtr->syncLock);
 
 	return 0;
 }
@@ -203,3 +269,93 @@ void closeDisk(int disk) {
 
 	diskPtr->open = 0;
 }
+
+/* discardBlocks() punches nBlocks blocks starting at bNum out of the disk's backing file,
+ * keeping the file's size. The range reads back as zeros and no longer takes up space on
+ * the host. Returns 0 on success, or an error if the disk isn't open or the host file
+ * system can't punch holes.
+ */
+int discardBlocks(int disk, int bNum, int nBlocks) {
+	Disk *diskPtr;
+	off_t byteOffset;
+
+	diskPtr = findDisk(disk);
+
+	if(diskPtr == NULL || !diskPtr->open) {
+		return DISCARD_BLOCKS_FAILURE;
+	}
+
+	byteOffset = (off_t) bNum * BLOCKSIZE;
+
+	if(byteOffset + (off_t) nBlocks * BLOCKSIZE > diskPtr->space) {
+		return DISK_PAST_LIMITS;
+	}
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+	//	buffered writes to the range would otherwise land after the hole is punched
+	if(fflush(diskPtr->file) != 0) {
+		return DISCARD_BLOCKS_FAILURE;
+	}
+
+	if(fallocate(fileno(diskPtr->file), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			byteOffset, (off_t) nBlocks * BLOCKSIZE) != 0) {
+		return DISCARD_BLOCKS_FAILURE;
+	}
+
+	return 0;
+#else
+	return DISCARD_BLOCKS_FAILURE;
+#endif
+}
+
+/* syncDisk() flushes and fdatasync()s the disk's backing file, sharing one fdatasync()
+ * between every caller that arrives while another is in progress. A sync covers all the
+ * writes counted before it started, so a caller waits until one that started after its
+ * own writes has finished, starting it itself if nobody else is syncing.
+ */
+int syncDisk(int disk) {
+	Disk *diskPtr;
+	unsigned long target, covered;
+	int result = 0;
+
+	diskPtr = findDisk(disk);
+
+	if(diskPtr == NULL || !diskPtr->open) {
+		return SYNC_DISK_FAILURE;
+	}
+
+	pthread_mutex_lock(&diskPtr->syncLock);
+
+	target = diskPtr->writes;
+
+	while(diskPtr->syncedWrites < target && result == 0) {
+		if(diskPtr->syncing) {
+			pthread_cond_wait(&diskPtr->syncDone, &diskPtr->syncLock);
+			continue;
+		}
+
+		diskPtr->syncing = 1;
+		covered = diskPtr->writes;
+
+		pthread_mutex_unlock(&diskPtr->syncLock);
+
+		if(fflush(diskPtr->file) != 0 || fdatasync(fileno(diskPtr->file)) != 0) {
+			result = SYNC_DISK_FAILURE;
+		}
+
+		pthread_mutex_lock(&diskPtr->syncLock);
+
+		if(result == 0 && covered > diskPtr->syncedWrites) {
+			diskPtr->syncedWrites = covered;
+		}
+
+		diskPtr->syncing = 0;
+		diskPtr->syncs++;
+
+		pthread_cond_broadcast(&diskPtr->syncDone);
+	}
+
+	pthread_mutex_unlock(&diskPtr->syncLock);
+
+	return result;
+}
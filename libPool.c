@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tinyFS.h"
+
+/* A pool hands out objects of one size. They are carved in order out of slabs of
+ * slabObjects objects, each slab one malloc(), and an object given back goes on a free
+ * list threaded through its first word, so taking or giving back an object is a couple of
+ * pointer moves. Slabs are never freed: the file systems and disks the pools hold
+ * live as long as the process, since a file system's block lists exist only in memory and
+ * tfs_unmount() has to keep them for the next tfs_mount().
+ */
+
+/* poolAlloc() returns an object from 'pool': the last one given back if there is one,
+ * otherwise the next one of the newest slab, starting a new slab when that one is used up.
+ * The object's content is whatever was there before.
+ */
+void *poolAlloc(Pool *pool) {
+	void *object;
+
+	if(pool->freeObjects != NULL) {
+		object = pool->freeObjects;
+		pool->freeObjects = *(void **)object;
+
+		return object;
+	}
+
+	if(pool->slabLeft == 0) {
+		poolReserve(pool, pool->slabObjects);
+	}
+
+	object = pool->slabNext;
+	pool->slabNext += pool->objectSize;
+	pool->slabLeft--;
+
+	return object;
+}
+
+/* poolFree() gives an object from poolAlloc() back to 'pool'. NULL is ignored. */
+void poolFree(Pool *pool, void *object) {
+	if(object == NULL) {
+		return;
+	}
+
+	*(void **)object = pool->freeObjects;
+	pool->freeObjects = object;
+}
+
+/* poolReserve() makes sure the newest slab of 'pool' has count objects left, starting a
+ * slab of at least count objects if it doesn't, so a caller about to take that many
+ * objects gets them from a single allocation. What was left of the old slab goes on the
+ * free list.
+ */
+void poolReserve(Pool *pool, int count) {
+	PoolSlab *slab;
+
+	if(pool->slabLeft >= count) {
+		return;
+	}
+
+	for(; pool->slabLeft > 0; pool->slabLeft--, pool->slabNext += pool->objectSize) {
+		poolFree(pool, pool->slabNext);
+	}
+
+	if(count < pool->slabObjects) count = pool->slabObjects;
+
+	slab = malloc(sizeof(PoolSlab) + (size_t) count * pool->objectSize);
+	slab->next = pool->slabs;
+
+	pool->slabs = slab;
+	pool->slabNext = (char *)(slab + 1);
+	pool->slabLeft = count;
+}
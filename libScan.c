@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tinyFS.h"
+
+void *runScanWorker(void *arg);
+int takeChunk(ScanWorker *worker);
+int scanResult(Scan *scan);
+
+/* A scan splits its items into chunks and gives every worker an equal, contiguous range
+ * of them up front. A worker takes chunks off the front of its own range, so it works
+ * through neighbouring items in order, and once its range runs out it takes the back
+ * half of the first other range that isn't empty. Ranges only ever shrink or get split,
+ * so the scan is over when a worker finds every range empty.
+ */
+int scanItems(int items, int chunkItems, size_t scratchSize, ScanFunction function, void *arg) {
+	Scan scan;
+	int chunks, worker, started, result = 0;
+
+	if(items <= 0) {
+		return 0;
+	}
+
+	chunks = (items + chunkItems - 1) / chunkItems;
+
+	scan = (Scan) {
+		function,
+		arg,
+		items,
+		chunkItems,
+		scanThreads(chunks),
+		NULL
+	};
+
+	pthread_mutex_init(&scan.resultLock, NULL);
+	scan.workers = calloc(scan.workerCount, sizeof(ScanWorker));
+
+	for(worker = 0; worker < scan.workerCount; worker++) {
+		pthread_mutex_init(&scan.workers[worker].lock, NULL);
+		scan.workers[worker].next = (int)((int64_t) chunks * worker / scan.workerCount);
+		scan.workers[worker].end = (int)((int64_t) chunks * (worker + 1) / scan.workerCount);
+		scan.workers[worker].id = worker;
+		scan.workers[worker].scan = &scan;
+
+		if(scratchSize > 0 && posix_memalign((void **)&scan.workers[worker].scratch, SCAN_BUFFER_ALIGN, scratchSize) != 0) {
+			scan.workers[worker].scratch = NULL;
+			result = -1;
+		}
+	}
+
+	if(result == 0) {
+		//	workers that can't be started leave their ranges to be stolen by the others
+		for(started = 1; started < scan.workerCount; started++) {
+			if(pthread_create(&scan.workers[started].thread, NULL, runScanWorker, &scan.workers[started]) != 0) {
+				break;
+			}
+		}
+
+		runScanWorker(&scan.workers[0]);
+
+		for(worker = 1; worker < started; worker++) {
+			pthread_join(scan.workers[worker].thread, NULL);
+		}
+
+		result = scan.result;
+	}
+
+	for(worker = 0; worker < scan.workerCount; worker++) {
+		free(scan.workers[worker].scratch);
+		pthread_mutex_destroy(&scan.workers[worker].lock);
+	}
+
+	free(scan.workers);
+	pthread_mutex_destroy(&scan.resultLock);
+
+	return result;
+}
+
+int scanThreads(int chunks) {
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int threads = (cpus > 0 ? cpus : 1) * SCAN_THREADS_PER_CPU;
+
+	if(threads > SCAN_THREADS_MAX) threads = SCAN_THREADS_MAX;
+
+	return chunks < threads ? chunks : threads;
+}
+
+/* Runs chunks of a scan until there are none left or a call has failed */
+void *runScanWorker(void *arg) {
+	ScanWorker *worker = arg;
+	Scan *scan = worker->scan;
+	int chunk, first, count, result;
+
+	while(scanResult(scan) == 0 && (chunk = takeChunk(worker)) >= 0) {
+		first = chunk * scan->chunkItems;
+		count = scan->items - first < scan->chunkItems ? scan->items - first : scan->chunkItems;
+
+		if((result = scan->function(scan->arg, first, count, worker->scratch)) < 0) {
+			pthread_mutex_lock(&scan->resultLock);
+
+			if(scan->result == 0) scan->result = result;
+
+			pthread_mutex_unlock(&scan->resultLock);
+		}
+	}
+
+	return NULL;
+}
+
+/* Returns the next chunk for a worker, stolen from another worker's range if its own is
+ * empty, or -1 once every range is. Only one lock is held at a time.
+ */
+int takeChunk(ScanWorker *worker) {
+	Scan *scan = worker->scan;
+	ScanWorker *victim;
+	int chunk = -1, i, left, stolenFirst = 0, stolenEnd = 0;
+
+	pthread_mutex_lock(&worker->lock);
+
+	if(worker->next < worker->end) chunk = worker->next++;
+
+	pthread_mutex_unlock(&worker->lock);
+
+	for(i = 1; chunk < 0 && i < scan->workerCount; i++) {
+		victim = &scan->workers[(worker->id + i) % scan->workerCount];
+
+		pthread_mutex_lock(&victim->lock);
+
+		//	the back half, rounded up so the last chunk of a range can be stolen too
+		if((left = victim->end - victim->next) > 0) {
+			stolenEnd = victim->end;
+			stolenFirst = victim->end -= (left + 1) / 2;
+		}
+
+		pthread_mutex_unlock(&victim->lock);
+
+		if(left > 0) {
+			pthread_mutex_lock(&worker->lock);
+			worker->next = stolenFirst + 1;
+			worker->end = stolenEnd;
+			pthread_mutex_unlock(&worker->lock);
+
+			chunk = stolenFirst;
+		}
+	}
+
+	return chunk;
+}
+
+int scanResult(Scan *scan) {
+	int result;
+
+	pthread_mutex_lock(&scan->resultLock);
+	result = scan->result;
+	pthread_mutex_unlock(&scan->resultLock);
+
+	return result;
+}
@@ -1,4 +1,8 @@
 #include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "tinyFS.h"
 #include "tinyFS_errno.h"
@@ -6,26 +10,145 @@
 int setMagicNumbers(fileDescriptor diskNum, int blocks);
 int writeSuperBlock(fileDescriptor diskNum, SuperBlock superblock);
 int writeRootInode(fileDescriptor diskNum, Inode rootInode);
-BlockNode *setupFreeBlockList();
+BlockNode *setupFreeBlockList(Pool *blockNodePool, int freeBlockCount);
 void addFileSystem(FileSystem fileSystem);
 FileSystem *findFileSystem(char *filename);
 int verifyFileSystem(FileSystem fileSystem);
+int formatChunk(void *arg, int first, int count, char *scratch);
+int verifyChunk(void *arg, int first, int count, char *scratch);
 int findFile(FileSystem fileSystem, char *filename);
 int getFreeBlock(FileSystem *fileSystemPtr);
-int addInode(fileDescriptor diskNum, Inode inode, int blockNum);
+int addInode(FileSystem *fileSystemPtr, Inode inode, int blockNum);
+int createInode(FileSystem *fileSystemPtr, int parentBlockNum, char *name, int directory);
+fileDescriptor openInode(FileSystem *fileSystemPtr, char *path, int inodeBlockNum, int flags);
 int addDynamicResource(FileSystem *fileSystemPtr, DynamicResource dynamicResource);
 int removeDynamicResource(FileSystem *fileSystem, fileDescriptor FD);
+void releaseResourceNode(FileSystem *fileSystemPtr, DynamicResourceNode *node);
 int tfs_rename(char *oldName, char *newName);
-void freeDataBlocks(BlockNode *blockHead);
 int tfs_readdir();
-int renameInode(FileSystem *fileSystemPtr, int blockNum, char *newName);
+int renameInode(FileSystem *fileSystemPtr, int blockNum, char *newName, int parentBlockNum);
 int renameDynamicResource(FileSystem *fileSystemPtr, int inodeBlockNum, char *newName);
 DynamicResource *findResource(DynamicResourceNode *rsrcTable, int fd);
 void getCurrentTime(char *timestamp);
 int tfs_readFileInfo(fileDescriptor FD);
+int findFreeBlockRun(FileSystem *fileSystemPtr, int count);
+int getFreeBlockRun(FileSystem *fileSystemPtr, int count);
+int allocateBlocks(FileSystem *fileSystemPtr, BlockNode **blockListPtr, int count);
+void releaseBlock(FileSystem *fileSystemPtr, int blockNum);
+int countBlocks(BlockNode *blockHead);
+BlockNode *findDataBlock(BlockNode *blockHead, int index);
+int countDataBlocks(BlockNode *blockHead);
+BlockNode *nextDataBlock(BlockNode *blockHead);
+int fillHoles(FileSystem *fileSystemPtr, BlockNode **link, int linkIndex, int firstIndex, int lastIndex, off_t zeroBelow);
+int zeroRange(FileSystem *fileSystemPtr, Inode *inodePtr, off_t from, off_t to);
+int writeDataBlocks(FileSystem *fileSystemPtr, Inode *inodePtr, off_t offset, char *buffer, int size);
+int flushPendingData(FileSystem *fileSystemPtr, DynamicResource *dynamicResourcePtr);
+int flushAllPendingData(FileSystem *fileSystemPtr);
+int flushFilePendingData(FileSystem *fileSystemPtr, int inodeBlockNum);
+void dropFilePendingData(FileSystem *fileSystemPtr, int inodeBlockNum);
+void releaseDataBlocks(FileSystem *fileSystemPtr, BlockNode *blockHead);
+int bufferPendingByte(FileSystem *fileSystemPtr, DynamicResource *dynamicResourcePtr, char byte);
+int countExtents(BlockNode *blockHead);
+void startDefragMove(FileSystem *fileSystemPtr, int inodeBlockNum, Inode *inodePtr);
+int continueDefragMove(FileSystem *fileSystemPtr, int budget);
+void blockListChanged(FileSystem *fileSystemPtr, BlockNode *blockHead);
+void trimDataBlocks(FileSystem *fileSystemPtr, Inode *inodePtr, int blocks);
+int getFreeBlockAfter(FileSystem *fileSystemPtr, int blockNum);
+int unshareBlock(FileSystem *fileSystemPtr, BlockNode *blockNode);
+BlockNode *shareBlockList(FileSystem *fileSystemPtr, BlockNode *blockHead);
+int countSharedBlocks(FileSystem *fileSystemPtr, BlockNode *blockHead);
+int findSnapshot(FileSystem *fileSystemPtr, char *name);
+int collectFiles(FileSystem *fileSystemPtr, int nodeBlockNum, char *path, SnapshotFiles *files);
+void freeSnapshotFiles(SnapshotFiles *files, int first);
+int freezeInode(FileSystem *fileSystemPtr, Snapshot *snapshotPtr, int inodeBlockNum, char *path);
+int releaseSnapshotInodes(FileSystem *fileSystemPtr, Snapshot *snapshotPtr);
+int writeCompressedFile(FileSystem *fileSystemPtr, Inode *inodePtr, char *buffer, int size);
+int compressGroups(char *buffer, int size, char *packed, CompressedExtent ***tailPtrPtr);
+int loadCompressedGroup(FileSystem *fileSystemPtr, DynamicResource *dynamicResourcePtr, Inode *inodePtr, off_t offset);
+int decompressFile(FileSystem *fileSystemPtr, DynamicResource *dynamicResourcePtr, char *inodeData);
+int recompressFile(FileSystem *fileSystemPtr, int inodeBlockNum);
+void releaseExtents(FileSystem *fileSystemPtr, int inodeBlockNum, Inode *inodePtr);
+CompressedExtent *copyExtents(CompressedExtent *extent);
+void freeExtents(CompressedExtent *extent);
+uint64_t fingerprintBlock(char *payload);
+int dedupBlock(FileSystem *fileSystemPtr, BlockNode *blockNode, char *data);
+void indexBlock(FileSystem *fileSystemPtr, int blockNum, char *data);
+void unindexBlock(FileSystem *fileSystemPtr, int blockNum);
+int readFsBlock(FileSystem *fileSystemPtr, int blockNum, void *block);
+int writeFsBlock(FileSystem *fileSystemPtr, int blockNum, void *block);
+int getLogBlock(FileSystem *fileSystemPtr);
+void killLogBlock(FileSystem *fileSystemPtr, int diskBlock);
+void unmapLogBlock(FileSystem *fileSystemPtr, int blockNum);
+int findCleanSegment(FileSystem *fileSystemPtr);
+int findCleanVictim(FileSystem *fileSystemPtr);
+int cleanSegment(FileSystem *fileSystemPtr, int segment, int budget);
+int resolvePath(FileSystem *fileSystemPtr, char *path, int *parentBlockNumPtr, char *name);
+int lookupEntry(FileSystem *fileSystemPtr, int directoryBlockNum, char *name);
+int insertEntry(FileSystem *fileSystemPtr, int directoryBlockNum, char *name, int inodeBlockNum, int directory);
+int removeEntry(FileSystem *fileSystemPtr, int directoryBlockNum, char *name);
+int readDirectoryNode(FileSystem *fileSystemPtr, int blockNum, DirectoryNode *node);
+int writeDirectoryNode(FileSystem *fileSystemPtr, int blockNum, DirectoryNode *node);
+int findEntryIndex(DirectoryNode *node, char *name);
+int splitDirectoryNode(FileSystem *fileSystemPtr, int parentBlockNum, DirectoryNode *parent, int index, DirectoryNode *child);
+int mergeDirectoryNodes(FileSystem *fileSystemPtr, int parentBlockNum, DirectoryNode *parent, int index, DirectoryNode *left, DirectoryNode *right);
+int insertIntoNode(FileSystem *fileSystemPtr, int blockNum, DirectoryNode *node, DirectoryEntry *entry);
+int deleteFromNode(FileSystem *fileSystemPtr, int blockNum, DirectoryNode *node, char *name);
+int findEdgeEntry(FileSystem *fileSystemPtr, int blockNum, int last, DirectoryEntry *entry);
+int collectEntries(FileSystem *fileSystemPtr, int blockNum, DirectoryStream *stream, DirEntry *entries, int count, int *filledPtr);
+DirectoryStream *findDirectoryStream(FileSystem *fileSystemPtr, dirDescriptor DD);
+int statEntry(FileSystem *fileSystemPtr, int inodeBlockNum, DirEntry *entry);
+void fillEntryInfo(FileSystem *fileSystemPtr, int inodeBlockNum, Inode *inodePtr, DirEntry *entry);
+int compareBatchPaths(const void *a, const void *b);
+int compareBatchInodes(const void *a, const void *b);
+int resolveBatchParent(FileSystem *fileSystemPtr, BatchSlot *slotPtr);
+int lookupBatchRun(FileSystem *fileSystemPtr, BatchSlot *slots, int count);
+int lookupBatchNode(FileSystem *fileSystemPtr, int blockNum, BatchSlot *slots, int count);
+int batchFailure(int op);
+int stageOp(FileSystem *fileSystemPtr, StagedOp op);
+void freeTransaction(Transaction *transaction);
+int checkStagedOp(FileSystem *fileSystemPtr, StagedOp *stop);
+int checkStagedRename(FileSystem *fileSystemPtr, StagedOp *stop, char *oldName, char *newName);
+int resolveStagedPath(FileSystem *fileSystemPtr, StagedOp *stop, char *path);
+int pathUnder(char *path, char *directory);
+int applyStagedOp(StagedOp *op);
+int writeStagedBlocks(FileSystem *fileSystemPtr);
+void unstageBlock(FileSystem *fileSystemPtr, int blockNum);
+int findStagedBlock(StagedBlocks *staged, int blockNum);
+int syncOp(FileSystem *fileSystemPtr, fileDescriptor FD, int result, int failure);
+int writeByte(fileDescriptor FD, unsigned int data);
+int readAheadBlock(FileSystem *fileSystemPtr, DynamicResource *dynamicResourcePtr, Inode *inodePtr, int index, char **payloadPtr);
+int readFsBlocks(FileSystem *fileSystemPtr, int blockNum, int count, void *blocks);
+int readFileBlocks(FileSystem *fileSystemPtr, Inode *inodePtr, int first, int blocks, char *out);
+off_t pendingFileSize(FileSystem *fileSystemPtr, int inodeBlockNum, off_t size);
+Dentry *findDentrySlot(FileSystem *fileSystemPtr, int parentBlockNum, char *name);
+void cacheDentry(FileSystem *fileSystemPtr, int parentBlockNum, char *name, int inodeBlockNum);
+void forgetDentry(FileSystem *fileSystemPtr, int parentBlockNum, char *name);
+void canonicalPath(char *path, char *canonical);
+Mapping *findMapping(FileSystem *fileSystemPtr, char *addr);
+int writeBackMapping(FileSystem *fileSystemPtr, Mapping *mapping);
+void releaseMapping(Mapping *mapping);
+int streamHostFile(FileSystem *fileSystemPtr, fileDescriptor FD, int host);
+int writeSlices(int host, ReadView *view);
+int writeDataVector(FileSystem *fileSystemPtr, Inode *inodePtr, off_t offset, const struct iovec *vectors, int count);
+int writeDataVectorAt(FileSystem *fileSystemPtr, Inode *inodePtr, BlockNode **link, int linkIndex, off_t offset,
+	const struct iovec *vectors, int count, BlockNode **lastBlockPtr);
+int writeVector(fileDescriptor FD, const struct iovec *iov, int iovcnt, off_t offset);
+int vectorLength(const struct iovec *iov, int iovcnt);
+int fsckFileSystem(FsckState *state);
+int fsckTypeChunk(void *arg, int first, int count, char *scratch);
+int fsckReach(FsckState *state, int blockNum, int type);
+int fsckInode(FsckState *state, int blockNum, int type);
+int fsckDirectory(FsckState *state, int nodeBlockNum);
+int fsckBlockListChunk(void *arg, int first, int count, char *scratch);
+int fsckCrossCheckChunk(void *arg, int first, int count, char *scratch);
+int fsckLog(FsckState *state);
 
 FileSystemNode *fsHead = NULL;
 
+//	file systems and their list nodes live as long as the process
+Pool fileSystemPool = POOL_INIT(FileSystem, 16);
+Pool fileSystemNodePool = POOL_INIT(FileSystemNode, 16);
+
 char *mountedFsName = NULL;
 
 /* Makes a blank TinyFS file system of size nBytes on the file specified by ‘filename’.
@@ -34,12 +157,18 @@ char *mountedFsName = NULL;
  * to 0x00, setting magic numbers, initializing and writing the superblock and inodes,
  * etc. Must return a specified success/error code.
  */
-int tfs_mkfs(char *filename, int nBytes) {
+int tfs_mkfs(char *filename, off_t nBytes) {
+	return tfs_mkfsFlags(filename, nBytes, 0);
+}
+
+/* Same as tfs_mkfs, with MKFS_* flags for the file system */
+int tfs_mkfsFlags(char *filename, off_t nBytes, int flags) {
 	fileDescriptor diskNum;
-	int blockCount;
+	int blockCount, segments = 0;
 	SuperBlock superblock;
 	Inode rootInode;
 	FileSystem fileSystem;
+	Pool blockNodePool = POOL_INIT(BlockNode, 1024);
 	void *freeBlockPtr;
 	char *creationTimestamp, *modificationTimestamp, *accessTimestamp;
 
@@ -62,8 +191,19 @@ int tfs_mkfs(char *filename, int nBytes) {
 		return MAKE_FS_ERROR;
 	}
 
+	//	a log keeps some of the disk back, so the file system sees fewer blocks
+	if(flags & MKFS_LOG) {
+		segments = (blockCount - 1) / LOG_SEGMENT_BLOCKS;
+
+		if(segments <= LOG_RESERVED_SEGMENTS) {
+			return MAKE_FS_ERROR;
+		}
+
+		blockCount = 1 + (segments - LOG_RESERVED_SEGMENTS) * LOG_SEGMENT_BLOCKS;
+	}
+
 	//	set up free block linked list (total blocks - 1 (for superblock) - 1 (for root inode))
-	freeBlockPtr = setupFreeBlockList(blockCount - 2);
+	freeBlockPtr = setupFreeBlockList(&blockNodePool, blockCount - 2);
 
 	//	superblock contains magic number and pointer to free blocks
 	superblock = (SuperBlock) {
@@ -80,9 +220,14 @@ int tfs_mkfs(char *filename, int nBytes) {
 		NULL,	//	root inode doesn't have any data blocks
 		creationTimestamp,
 		modificationTimestamp,
-		accessTimestamp
+		accessTimestamp,
+		NULL,
+		1,		//	root is the top directory,
+		0,		//	with no entries yet,
+		1		//	and is its own parent
 	};
 
+	//	on a log this is also the first block of segment 0
 	writeRootInode(diskNum, rootInode);
 
 	fileSystem = (FileSystem) {
@@ -92,9 +237,47 @@ int tfs_mkfs(char *filename, int nBytes) {
 		filename,
 		0,			//	not mounted
 		superblock,
-		NULL 		//	has empty dynamic resource table
+		NULL, 		//	has empty dynamic resource table
+		0,			//	blocks are allocated as data is written
+		{ 0, -1 },	//	defragmenter starts at the first block, moving nothing
+		0,			//	freed blocks stay in the image
+		calloc(blockCount, sizeof(int)),	//	no block is shared yet
+		flags & MKFS_COMPRESS ? 1 : 0,
+		flags & MKFS_DEDUP ? 1 : 0,
+		calloc(blockCount, sizeof(FingerprintNode *)),	//	one index bucket per block
+		calloc(blockCount, sizeof(uint64_t)),	//	no block is indexed yet
+		0,			//	no duplicate blocks found yet
+		flags & MKFS_LOG ? 1 : 0
 	};
 
+	fileSystem.dentryCache = calloc(DENTRY_CACHE_SIZE, sizeof(Dentry));
+	fileSystem.blockNodePool = blockNodePool;
+	fileSystem.resourcePool = (Pool) POOL_INIT(DynamicResource, 16);
+	fileSystem.resourceNodePool = (Pool) POOL_INIT(DynamicResourceNode, 16);
+
+	if(fileSystem.logStructured) {
+		fileSystem.size = (off_t) blockCount * BLOCKSIZE;
+
+		fileSystem.log = (LogState) {
+			malloc(blockCount * sizeof(int)),
+			malloc((1 + segments * LOG_SEGMENT_BLOCKS) * sizeof(int)),
+			calloc(segments, sizeof(int)),
+			segments,
+			0,		//	the log starts in segment 0,
+			2,		//	right after the root inode
+			0,
+			0
+		};
+
+		memset(fileSystem.log.blockMap, -1, blockCount * sizeof(int));
+		memset(fileSystem.log.diskBlockOwners, -1, (1 + segments * LOG_SEGMENT_BLOCKS) * sizeof(int));
+
+		fileSystem.log.blockMap[0] = 0;
+		fileSystem.log.blockMap[1] = 1;
+		fileSystem.log.diskBlockOwners[1] = 1;
+		fileSystem.log.segmentLive[0] = 1;
+	}
+
 	addFileSystem(fileSystem);
 
 	return MAKE_FS_SUCCESS;
@@ -134,6 +317,7 @@ int tfs_mount(char *filename) {
 
 int tfs_unmount() {
 	FileSystem *fileSystemPtr;
+	Mapping *mapping;
 
 	if(mountedFsName == NULL) {
 		return UNMOUNT_FS_FAILURE;
@@ -146,6 +330,32 @@ int tfs_unmount() {
 		return UNMOUNT_FS_FAILURE;
 	}
 
+	//	give any appends still held by open handles their blocks
+	if(flushAllPendingData(fileSystemPtr) < 0) {
+		return UNMOUNT_FS_FAILURE;
+	}
+
+	//	a transaction that wasn't committed goes away with the mount
+	if(fileSystemPtr->transaction != NULL) {
+		freeTransaction(fileSystemPtr->transaction);
+		fileSystemPtr->transaction = NULL;
+	}
+
+	//	mapped ranges are written back and go away with the mount
+	while(fileSystemPtr->mappings != NULL) {
+		if(writeBackMapping(fileSystemPtr, fileSystemPtr->mappings) < 0) {
+			return UNMOUNT_FS_FAILURE;
+		}
+
+		mapping = fileSystemPtr->mappings;
+		fileSystemPtr->mappings = mapping->next;
+		releaseMapping(mapping);
+	}
+
+	if(fileSystemPtr->durability >= DURABILITY_CLOSE && syncDisk(fileSystemPtr->diskNum) < 0) {
+		return UNMOUNT_FS_FAILURE;
+	}
+
 	//	set mounted to false, and clear mounted FS name
 	fileSystemPtr->mounted = 0;
 	mountedFsName = NULL;
@@ -158,75 +368,370 @@ int tfs_unmount() {
  * that can be used to reference this file while the filesystem is mounted. 
  */
 fileDescriptor tfs_openFile(char *name) {
+	return tfs_openFileFlags(name, 0);
+}
+
+/* Same as tfs_openFile, with OPEN_* flags for the handle */
+fileDescriptor tfs_openFileFlags(char *name, int flags) {
 	FileSystem *fileSystemPtr;
-	DynamicResource dynamicResource;
-	Inode inode;
-	int inodeBlockNum, FD;
-	char *permName = (char *) malloc(9);
-	char *creationTimestamp, *modificationTimestamp, *accessTimestamp;
+	int inodeBlockNum, parentBlockNum;
+	fileDescriptor FD;
+	char leafName[9], data[BLOCKSIZE];
 
-	creationTimestamp = (char *) malloc(30);
-	modificationTimestamp = (char *) malloc(30);
-	accessTimestamp = (char *) malloc(30);
+	fileSystemPtr = findFileSystem(mountedFsName);
 
-	getCurrentTime(creationTimestamp);
-	getCurrentTime(modificationTimestamp);
-	getCurrentTime(accessTimestamp);
+	if(fileSystemPtr == NULL) {
+		return OPEN_FILE_FAILURE;
+	}
 
-	if(strlen(name) > 8) {
+	//	-2 means the directory it would go in isn't there
+	if((inodeBlockNum = resolvePath(fileSystemPtr, name, &parentBlockNum, leafName)) == -2) {
 		return OPEN_FILE_FAILURE;
 	}
 
-	strcpy(permName, name);
+	if(inodeBlockNum < 0) {
+		//	file doesn't exist so create inode
+		if((inodeBlockNum = createInode(fileSystemPtr, parentBlockNum, leafName, 0)) < 0) {
+			return OPEN_FILE_FAILURE;
+		}
+	}
+	else {
+		//	directories can't be opened as files
+		if(readFsBlock(fileSystemPtr, inodeBlockNum, data) < 0 || ((Inode *)&data[2])->directory) {
+			return OPEN_FILE_FAILURE;
+		}
+	}
+
+	FD = openInode(fileSystemPtr, name, inodeBlockNum, flags);
+
+	return syncOp(fileSystemPtr, FD, FD, OPEN_FILE_FAILURE);
+}
+
+/* Creates directory 'path'. Its parent must exist and nothing may already be called
+ * 'path'. The new directory starts with no B-tree; its first entry gives it a root node.
+ */
+int tfs_mkdir(char *path) {
+	FileSystem *fileSystemPtr;
+	int parentBlockNum;
+	char leafName[9];
 
 	fileSystemPtr = findFileSystem(mountedFsName);
 
 	if(fileSystemPtr == NULL) {
-		return OPEN_FILE_FAILURE;
+		return MKDIR_FAILURE;
 	}
 
-	if((inodeBlockNum = findFile(*fileSystemPtr, name)) < 0) {
+	if(resolvePath(fileSystemPtr, path, &parentBlockNum, leafName) != -1) {
+		return MKDIR_FAILURE;
+	}
 
-		//	file doesn't exist so create inode
-		inodeBlockNum = getFreeBlock(fileSystemPtr);
+	if(createInode(fileSystemPtr, parentBlockNum, leafName, 1) < 0) {
+		return MKDIR_FAILURE;
+	}
 
-		//	error getting free block
-		if(inodeBlockNum < 0) {
-			return OPEN_FILE_FAILURE;
-		}
+	return syncOp(fileSystemPtr, -1, MKDIR_SUCCESS, MKDIR_FAILURE);
+}
 
-		//	create new inode and insert it
-		inode = (Inode) {
-			permName,
-			0,
-			READWRITE,
-			NULL,
-			creationTimestamp,
-			modificationTimestamp,
-			accessTimestamp
-		};
+/* Opens a directory stream. The stream only remembers where it is by name, so it holds no
+ * blocks of the directory between batches.
+ */
+dirDescriptor tfs_opendir(char *path, char *prefix, int flags) {
+	FileSystem *fileSystemPtr;
+	DirectoryStream *stream;
+	int inodeBlockNum, parentBlockNum;
+	char name[9], data[BLOCKSIZE];
 
-		inode.creationTimestamp = creationTimestamp;
-		inode.modificationTimestamp = modificationTimestamp;
-		inode.accessTimestamp = accessTimestamp;
+	if(prefix == NULL) prefix = "";
 
-		addInode(fileSystemPtr->diskNum, inode, inodeBlockNum);
+	if(strlen(prefix) > 8) {
+		return OPEN_DIR_FAILURE;
 	}
 
-	FD = fileSystemPtr->openCount++;
-	
-	dynamicResource = (DynamicResource) {
-		permName,
-		0,
-		FD,
-		inodeBlockNum
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL) {
+		return OPEN_DIR_FAILURE;
+	}
+
+	if((inodeBlockNum = resolvePath(fileSystemPtr, path, &parentBlockNum, name)) < 0) {
+		return OPEN_DIR_FAILURE;
+	}
+
+	if(readFsBlock(fileSystemPtr, inodeBlockNum, data) < 0 || !((Inode *)&data[2])->directory) {
+		return OPEN_DIR_FAILURE;
+	}
+
+	stream = malloc(sizeof(DirectoryStream));
+
+	*stream = (DirectoryStream) {
+		fileSystemPtr->openDirCount++,
+		inodeBlockNum,
+		"",
+		flags,
+		"",		//	before the first name
+		fileSystemPtr->directoryStreams
 	};
 
-	if(addDynamicResource(fileSystemPtr, dynamicResource) < 0) {
-		return OPEN_FILE_FAILURE;
+	strcpy(stream->prefix, prefix);
+
+	fileSystemPtr->directoryStreams = stream;
+
+	return stream->DD;
+}
+
+/* Reads the next batch of a directory stream */
+int tfs_readdir_r(dirDescriptor DD, DirEntry *entries, int count) {
+	FileSystem *fileSystemPtr;
+	DirectoryStream *stream;
+	Inode *inodePtr;
+	char data[BLOCKSIZE];
+	int filled = 0;
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL || entries == NULL || count < 0) {
+		return READ_DIR_R_FAILURE;
 	}
 
-	return FD;
+	if((stream = findDirectoryStream(fileSystemPtr, DD)) == NULL) {
+		return READ_DIR_R_FAILURE;
+	}
+
+	if(count == 0) {
+		return 0;
+	}
+
+	if(readFsBlock(fileSystemPtr, stream->inodeBlockNum, data) < 0) {
+		return READ_DIR_R_FAILURE;
+	}
+
+	inodePtr = (Inode *)&data[2];
+
+	if(inodePtr->directoryRoot != 0 &&
+			collectEntries(fileSystemPtr, inodePtr->directoryRoot, stream, entries, count, &filled) < 0) {
+		return READ_DIR_R_FAILURE;
+	}
+
+	if(filled > 0) {
+		strcpy(stream->last, entries[filled - 1].name);
+	}
+
+	return filled;
+}
+
+int tfs_closedir(dirDescriptor DD) {
+	FileSystem *fileSystemPtr;
+	DirectoryStream **link, *stream;
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL) {
+		return CLOSE_DIR_FAILURE;
+	}
+
+	for(link = &fileSystemPtr->directoryStreams; *link != NULL; link = &(*link)->next) {
+		if((*link)->DD == DD) {
+			stream = *link;
+			*link = stream->next;
+			free(stream);
+
+			return CLOSE_DIR_SUCCESS;
+		}
+	}
+
+	return CLOSE_DIR_FAILURE;
+}
+
+/* Runs a batch of operations in two passes: one looking every name up, in path order,
+ * and one over the inodes, in block number order.
+ */
+int tfs_batch(BatchOp *ops, int count) {
+	FileSystem *fileSystemPtr;
+	BatchSlot *slots, *slotPtr;
+	Inode *inodePtr;
+	char data[BLOCKSIZE], *modificationTimestamp;
+	int slot, runEnd, dirty, failed = 0;
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL || ops == NULL || count < 0) {
+		return BATCH_FAILURE;
+	}
+
+	slots = malloc(count * sizeof(BatchSlot));
+
+	for(slot = 0; slot < count; slot++) {
+		slots[slot].op = &ops[slot];
+		slots[slot].path = malloc(strlen(ops[slot].name) + 2);
+
+		canonicalPath(ops[slot].name, slots[slot].path);
+
+		slots[slot].parentLength = strrchr(slots[slot].path, '/') != NULL ?
+			strrchr(slots[slot].path, '/') - slots[slot].path : 0;
+	}
+
+	qsort(slots, count, sizeof(BatchSlot), compareBatchPaths);
+
+	//	each run of names in one directory is looked up in a single walk of its B-tree
+	for(slot = 0; slot < count; slot = runEnd) {
+		for(runEnd = slot + 1; runEnd < count && slots[runEnd].parentLength == slots[slot].parentLength &&
+				strncmp(slots[runEnd].path, slots[slot].path, slots[slot].parentLength) == 0; runEnd++);
+
+		if(lookupBatchRun(fileSystemPtr, &slots[slot], runEnd - slot) < 0) {
+			failed = 1;
+		}
+	}
+
+	qsort(slots, count, sizeof(BatchSlot), compareBatchInodes);
+
+	for(slot = 0; slot < count; slot = runEnd) {
+		for(runEnd = slot + 1; runEnd < count && slots[runEnd].inodeBlockNum == slots[slot].inodeBlockNum; runEnd++);
+
+		if(slots[slot].inodeBlockNum < 0 || flushFilePendingData(fileSystemPtr, slots[slot].inodeBlockNum) < 0 ||
+				readFsBlock(fileSystemPtr, slots[slot].inodeBlockNum, data) < 0) {
+			for(; slot < runEnd; slot++) {
+				slots[slot].op->result = batchFailure(slots[slot].op->op);
+				failed = 1;
+			}
+
+			continue;
+		}
+
+		inodePtr = (Inode *)&data[2];
+		dirty = 0;
+
+		for(slotPtr = &slots[slot]; slotPtr < &slots[runEnd]; slotPtr++) {
+			switch(slotPtr->op->op) {
+				case BATCH_OPEN:
+					slotPtr->op->result = inodePtr->directory ? OPEN_FILE_FAILURE :
+						openInode(fileSystemPtr, slotPtr->op->name, slotPtr->inodeBlockNum, 0);
+					break;
+
+				case BATCH_STAT:
+					memset(&slotPtr->op->info, 0, sizeof(DirEntry));
+					strcpy(slotPtr->op->info.name, slotPtr->inodeBlockNum == 1 ? "/" : inodePtr->name);
+					slotPtr->op->info.directory = inodePtr->directory;
+					fillEntryInfo(fileSystemPtr, slotPtr->inodeBlockNum, inodePtr, &slotPtr->op->info);
+					slotPtr->op->result = STAT_FILE_SUCCESS;
+					break;
+
+				case BATCH_MAKE_RO:
+				case BATCH_MAKE_RW:
+					inodePtr->filePermission = slotPtr->op->op == BATCH_MAKE_RO ? READONLY : READWRITE;
+					slotPtr->op->result = slotPtr->op->op == BATCH_MAKE_RO ? MAKE_RO_SUCCESS : MAKE_RW_SUCCESS;
+					dirty = 1;
+					break;
+
+				default:
+					slotPtr->op->result = BATCH_FAILURE;
+			}
+
+			if(slotPtr->op->result < 0) failed = 1;
+		}
+
+		if(dirty) {
+			modificationTimestamp = (char *) malloc(30);
+			getCurrentTime(modificationTimestamp);
+
+			inodePtr->modificationTimestamp = modificationTimestamp;
+
+			if(writeFsBlock(fileSystemPtr, slots[slot].inodeBlockNum, data) < 0) {
+				for(slotPtr = &slots[slot]; slotPtr < &slots[runEnd]; slotPtr++) {
+					if(slotPtr->op->op == BATCH_MAKE_RO || slotPtr->op->op == BATCH_MAKE_RW) {
+						slotPtr->op->result = batchFailure(slotPtr->op->op);
+					}
+				}
+
+				failed = 1;
+			}
+		}
+	}
+
+	for(slot = 0; slot < count; slot++) {
+		free(slots[slot].path);
+	}
+
+	free(slots);
+
+	return syncOp(fileSystemPtr, -1, failed ? BATCH_FAILURE : BATCH_SUCCESS, BATCH_FAILURE);
+}
+
+/* Starts staging writes, renames and deletes on the mounted file system */
+int tfs_begin() {
+	FileSystem *fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL || fileSystemPtr->transaction != NULL) {
+		return BEGIN_FAILURE;
+	}
+
+	fileSystemPtr->transaction = calloc(1, sizeof(Transaction));
+
+	return BEGIN_SUCCESS;
+}
+
+/* Checks every staged operation, then applies them with their block writes held back and
+ * writes those out in one ordered pass
+ */
+int tfs_commit() {
+	FileSystem *fileSystemPtr = findFileSystem(mountedFsName);
+	Transaction *transaction;
+	StagedOp *op;
+	int needed = 0, failed = 0;
+
+	if(fileSystemPtr == NULL || (transaction = fileSystemPtr->transaction) == NULL) {
+		return COMMIT_FAILURE;
+	}
+
+	for(op = transaction->ops; op != NULL; op = op->next) {
+		if(checkStagedOp(fileSystemPtr, op) < 0) {
+			failed = 1;
+			break;
+		}
+
+		//	every block of the new content may need a new block, and a rename may split
+		//	a directory node
+		needed += op->op == TXN_WRITE ? (op->size + BLOCKSIZE - 3) / (BLOCKSIZE - 2) :
+			op->op == TXN_RENAME ? 1 : 0;
+	}
+
+	if(failed || needed > countBlocks(fileSystemPtr->superblock.freeBlocks)) {
+		fileSystemPtr->transaction = NULL;
+		freeTransaction(transaction);
+
+		return COMMIT_FAILURE;
+	}
+
+	//	the operations run as they would outside a transaction, but write into memory
+	fileSystemPtr->transaction = NULL;
+	fileSystemPtr->stagedBlocks = calloc(1, sizeof(StagedBlocks));
+
+	for(op = transaction->ops; op != NULL && !failed; op = op->next) {
+		failed = applyStagedOp(op) < 0;
+	}
+
+	//	what was applied is written out even after a failure, so the disk matches memory
+	if(writeStagedBlocks(fileSystemPtr) < 0) {
+		failed = 1;
+	}
+
+	freeTransaction(transaction);
+
+	//	the whole transaction is made durable at once
+	return syncOp(fileSystemPtr, -1, failed ? COMMIT_FAILURE : COMMIT_SUCCESS, COMMIT_FAILURE);
+}
+
+/* Drops the staged operations */
+int tfs_abort() {
+	FileSystem *fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL || fileSystemPtr->transaction == NULL) {
+		return ABORT_FAILURE;
+	}
+
+	freeTransaction(fileSystemPtr->transaction);
+	fileSystemPtr->transaction = NULL;
+
+	return ABORT_SUCCESS;
 }
 
 /* Closes the file, de-allocates all system/disk resources, and removes table entry */
@@ -246,18 +751,24 @@ int tfs_closeFile(fileDescriptor FD) {
 		return CLOSE_FILE_FAILURE;
 	}
 
-	if (readBlock(fileSystemPtr->diskNum, dynamicResourcePtr->inodeBlockNum, buf) < 0) {
+	//	a file decompressed for writes through the handle is compressed again
+	if (flushPendingData(fileSystemPtr, dynamicResourcePtr) < 0 ||
+			recompressFile(fileSystemPtr, dynamicResourcePtr->inodeBlockNum) < 0) {
+		return CLOSE_FILE_FAILURE;
+	}
+
+	if (readFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, buf) < 0) {
 		return CLOSE_FILE_FAILURE;
 	}
 
 	inodePtr = (Inode *)&buf[2];
 	inodePtr->modificationTimestamp = modificationTimestamp;
 
-	if (writeBlock(fileSystemPtr->diskNum, dynamicResourcePtr->inodeBlockNum, inodePtr) < 0) {
+	if (writeFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, buf) < 0) {
 		return CLOSE_FILE_FAILURE;
 	}
 
-	if(fileSystemPtr == NULL) {
+	if(fileSystemPtr->durability >= DURABILITY_CLOSE && syncDisk(fileSystemPtr->diskNum) < 0) {
 		return CLOSE_FILE_FAILURE;
 	}
 
@@ -272,9 +783,8 @@ int tfs_closeFile(fileDescriptor FD) {
  	FileSystem *fileSystemPtr;
  	DynamicResource *dynamicResourcePtr;
  	Inode *inodePtr;
- 	BlockNode *currBlock;
- 	char inodeData[BLOCKSIZE], data[BLOCKSIZE];
- 	int blockNum, written = 0, writeSize, blockOffset;
+ 	char inodeData[BLOCKSIZE];
+ 	int written;
  	char *modificationTimestamp;
  	modificationTimestamp = (char *) malloc(30);
  	getCurrentTime(modificationTimestamp);
@@ -292,89 +802,62 @@ int tfs_closeFile(fileDescriptor FD) {
  		return WRITE_FILE_FAILURE;
  	}
 
- 	if(tfs_deleteFile(FD) < 0) {
- 		return WRITE_FILE_FAILURE;
- 	}
-
  	//	read in inode block
- 	if(readBlock(fileSystemPtr->diskNum, dynamicResourcePtr->inodeBlockNum, inodeData) < 0) {
+ 	if(readFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodeData) < 0) {
  		return WRITE_FILE_FAILURE;
  	}
 
  	inodePtr = (Inode *) &inodeData[2];
- 	inodePtr->modificationTimestamp = modificationTimestamp;
-
- 	if (writeBlock(fileSystemPtr->diskNum, dynamicResourcePtr->inodeBlockNum, inodePtr) < 0) {
- 		return WRITE_FILE_FAILURE;
- 	}
 
  	if (inodePtr->filePermission == READONLY) {
  		return WRITE_FILE_FAILURE;
  	}
 
-	blockNum = getFreeBlock(fileSystemPtr);
-
-	inodePtr->dataBlocks = malloc(sizeof(BlockNode));
-	*inodePtr->dataBlocks = (BlockNode) {
-		blockNum,
-		NULL
-	};
-
-	currBlock = inodePtr->dataBlocks;
- 	
-
- 	while(written < size) {
- 		//	read in data block
-	 	if(readBlock(fileSystemPtr->diskNum, blockNum, data) < 0) {
-	 		return WRITE_FILE_FAILURE;
-	 	}
-
-	 	//	set block to file extent
-		memset(&data[0], FILE_EXTENT, 1);
-
-		//	get offset into block (minus two to account for reserved first two bytes)
-		blockOffset = dynamicResourcePtr->seekOffset % (BLOCKSIZE - 2);
+ 	//	inside a transaction the content is only copied until it commits
+ 	if(fileSystemPtr->transaction != NULL) {
+ 		if(size < 0) {
+ 			return WRITE_FILE_FAILURE;
+ 		}
 
-		//	how much to write this time, minus two for first two bytes
-		writeSize = BLOCKSIZE - blockOffset - 2;
+ 		StagedOp op = { TXN_WRITE, FD, malloc(size > 0 ? size : 1), size };
 
-		//	adjust for when there is not much data left to write
-		if(size - written < writeSize) writeSize = size - written;
+ 		memcpy(op.data, buffer, size);
 
-		//	write buffer into data that will go into block
-		memcpy(&data[2 + blockOffset], buffer, writeSize);
+ 		return stageOp(fileSystemPtr, op) < 0 ? WRITE_FILE_FAILURE : WRITE_FILE_SUCCESS;
+ 	}
 
-		//	write data into block
-		if(writeBlock(fileSystemPtr->diskNum, currBlock->blockNum, data) < 0) {
-	 		return WRITE_FILE_FAILURE;
-	 	}
+ 	//	appends still held on the file's handles are replaced along with the rest of the content
+ 	dropFilePendingData(fileSystemPtr, dynamicResourcePtr->inodeBlockNum);
 
-		written += writeSize;
-		buffer += writeSize;
-		dynamicResourcePtr->seekOffset += writeSize;
+ 	//	the old content's compressed groups go with it
+ 	releaseExtents(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodePtr);
 
-		if(size - written > 0) {
-			blockNum = getFreeBlock(fileSystemPtr);
+ 	if(fileSystemPtr->compression) {
+ 		written = writeCompressedFile(fileSystemPtr, inodePtr, buffer, size);
+ 	}
+ 	else {
+ 		//	keep the blocks the new content fits in (including ones reserved by tfs_fallocate)
+ 		//	and hand the rest back, so rewriting a file doesn't reshuffle its layout
+ 		trimDataBlocks(fileSystemPtr, inodePtr, (size + BLOCKSIZE - 3) / (BLOCKSIZE - 2));
 
-			currBlock->next = malloc(sizeof(BlockNode));
-			*currBlock->next = (BlockNode) {
-				blockNum,
-				NULL
-			};
+ 		//	any blocks still missing are requested as a single run sized for the whole file
+ 		written = writeDataBlocks(fileSystemPtr, inodePtr, 0, buffer, size);
+ 	}
 
-			currBlock = currBlock->next;
-		}
+ 	if(written < 0) {
+ 		return WRITE_FILE_FAILURE;
  	}
 
  	dynamicResourcePtr->seekOffset = 0;
  	inodePtr->size = written;
+ 	inodePtr->modificationTimestamp = modificationTimestamp;
 
  	//	write back changes to inode block
- 	if(writeBlock(fileSystemPtr->diskNum, dynamicResourcePtr->inodeBlockNum, inodeData) < 0) {
+ 	if(writeFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodeData) < 0) {
  		return WRITE_FILE_FAILURE;
  	}
 
- 	return WRITE_FILE_SUCCESS;
+ 	return syncOp(fileSystemPtr, FD, WRITE_FILE_SUCCESS, WRITE_FILE_FAILURE);
  }
 
 DynamicResource *findResource(DynamicResourceNode *rsrcTable, int fd) {
@@ -408,7 +891,9 @@ int tfs_makeRO(char *name) {
 
 	inodeBlockNum = findFile(*fileSystemPtr, name);
 
-	if (readBlock(fileSystemPtr->diskNum, inodeBlockNum, inodeBuf) < 0) {
+	//	bytes still buffered on a handle were written while the file was writable
+	if (flushFilePendingData(fileSystemPtr, inodeBlockNum) < 0 ||
+			readFsBlock(fileSystemPtr, inodeBlockNum, inodeBuf) < 0) {
 		return MAKE_RO_FAILURE;
 	}
 
@@ -421,11 +906,11 @@ int tfs_makeRO(char *name) {
 
 	memcpy(&inodeBuf[2], inodePtr, sizeof(Inode));
 
-	if (writeBlock(fileSystemPtr->diskNum, inodeBlockNum, inodeBuf) < 0) {
+	if (writeFsBlock(fileSystemPtr, inodeBlockNum, inodeBuf) < 0) {
 		return MAKE_RO_FAILURE;
 	}
 	
-	return MAKE_RO_SUCCESS;
+	return syncOp(fileSystemPtr, -1, MAKE_RO_SUCCESS, MAKE_RO_FAILURE);
 }
 //Change the permissions of file 'name' to READWRITE
 int tfs_makeRW(char *name) {
@@ -445,7 +930,7 @@ int tfs_makeRW(char *name) {
 
 	inodeBlockNum = findFile(*fileSystemPtr, name);
 
-	if (readBlock(fileSystemPtr->diskNum, inodeBlockNum, inodeBuf) < 0) {
+	if (readFsBlock(fileSystemPtr, inodeBlockNum, inodeBuf) < 0) {
 		return MAKE_RW_FAILURE;
 	}
 
@@ -458,30 +943,28 @@ int tfs_makeRW(char *name) {
 	inodePtr->filePermission = READWRITE;
 	memcpy(&inodeBuf[2], inodePtr, sizeof(Inode));
 
-	if(writeBlock(fileSystemPtr->diskNum, inodeBlockNum, inodeBuf) < 0) {
+	if(writeFsBlock(fileSystemPtr, inodeBlockNum, inodeBuf) < 0) {
 		return MAKE_RW_FAILURE;
 	}
 
-	return MAKE_RW_SUCCESS;
+	return syncOp(fileSystemPtr, -1, MAKE_RW_SUCCESS, MAKE_RW_FAILURE);
 }
 
 int tfs_writeByte(fileDescriptor FD, unsigned int data) {
+	return syncOp(findFileSystem(mountedFsName), FD, writeByte(FD, data), WRITE_BYTE_FAILURE);
+}
+
+int writeByte(fileDescriptor FD, unsigned int data) {
 	FileSystem *fileSystemPtr;
 	DynamicResource *dynamicResourcePtr;
 	char inodeData[BLOCKSIZE];
-	char writeData[BLOCKSIZE];
-	char timeInode[BLOCKSIZE];
+	char byte = data;
 	Inode *inodePtr;
-	BlockNode *tmpPtr;
-	int offset;
-	char *modificationTimestamp;
-	modificationTimestamp = (char *) malloc(30);
-
-	getCurrentTime(modificationTimestamp);
 
 	fileSystemPtr = findFileSystem(mountedFsName);
 
-	if(fileSystemPtr == NULL) {
+	//	only whole-file writes, renames and deletes can be staged by a transaction
+	if(fileSystemPtr == NULL || fileSystemPtr->transaction != NULL) {
 		return WRITE_BYTE_FAILURE;
 	}
 
@@ -491,47 +974,60 @@ int tfs_writeByte(fileDescriptor FD, unsigned int data) {
 		return WRITE_BYTE_FAILURE;
 	}
 
-	if(readBlock(fileSystemPtr->diskNum, dynamicResourcePtr->inodeBlockNum, inodeData) < 0) {
- 		return WRITE_BYTE_FAILURE;
- 	}
- 	offset = dynamicResourcePtr->seekOffset / (BLOCKSIZE-2);
- 	inodePtr = (Inode *)&inodeData[2];
- 	inodePtr->modificationTimestamp = modificationTimestamp;
+	//	a pending run on an append handle already ends at the end of the file
+	if (dynamicResourcePtr->flags & OPEN_APPEND && dynamicResourcePtr->pendingSize > 0) {
+		dynamicResourcePtr->seekOffset = dynamicResourcePtr->pendingOffset + dynamicResourcePtr->pendingSize;
+	}
 
- 	if (inodePtr->filePermission == READONLY) {
+	if (dynamicResourcePtr->seekOffset >= MAX_FILE_SIZE) {
 		return WRITE_BYTE_FAILURE;
 	}
 
- 	tmpPtr = inodePtr->dataBlocks;
+	//	bytes continuing the handle's pending run in the same block stay in memory, and
+	//	with delayed allocation the run may go on past the block
+	if (dynamicResourcePtr->pendingSize > 0 && dynamicResourcePtr->seekOffset ==
+			dynamicResourcePtr->pendingOffset + dynamicResourcePtr->pendingSize &&
+			(fileSystemPtr->delayedAllocation || dynamicResourcePtr->seekOffset / (BLOCKSIZE - 2) ==
+			dynamicResourcePtr->pendingOffset / (BLOCKSIZE - 2))) {
+		return bufferPendingByte(fileSystemPtr, dynamicResourcePtr, byte);
+	}
 
- 	if (dynamicResourcePtr->seekOffset >= inodePtr->size) {
-		return READ_BYTE_FAILURE;
+	//	anywhere else the pending run has to reach the disk first
+	if (flushFilePendingData(fileSystemPtr, dynamicResourcePtr->inodeBlockNum) < 0) {
+		return WRITE_BYTE_FAILURE;
 	}
-	memcpy(&timeInode[2], inodePtr, sizeof(Inode));
-	if (writeBlock(fileSystemPtr->diskNum, dynamicResourcePtr->inodeBlockNum, timeInode) < 0) {
- 		return READ_BYTE_FAILURE;
- 	}
 
- 	while (offset > 0) {
- 		tmpPtr = tmpPtr->next;
- 		offset--;
- 	}
-
- 	if (readBlock(fileSystemPtr->diskNum, tmpPtr->blockNum, writeData)) {
+	if(readFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodeData) < 0) {
  		return WRITE_BYTE_FAILURE;
  	}
+ 	inodePtr = (Inode *)&inodeData[2];
 
- 	offset = dynamicResourcePtr->seekOffset % (BLOCKSIZE-2);
-	offset += 2;
-	writeData[offset] = data;
+ 	if (inodePtr->filePermission == READONLY) {
+		return WRITE_BYTE_FAILURE;
+	}
 
-	dynamicResourcePtr->seekOffset++;
+	//	a single byte can't be written into compressed content
+	if (decompressFile(fileSystemPtr, dynamicResourcePtr, inodeData) < 0) {
+		return WRITE_BYTE_FAILURE;
+	}
+
+ 	if (dynamicResourcePtr->flags & OPEN_APPEND) {
+ 		dynamicResourcePtr->seekOffset = inodePtr->size;
+ 	}
 
-	if(writeBlock(fileSystemPtr->diskNum, tmpPtr->blockNum, writeData) < 0) {
+	//	a byte past the end of file leaves a gap that has to read back as zeros, and
+	//	zeroing may have given a shared block a copy of its own
+	if (dynamicResourcePtr->seekOffset > inodePtr->size &&
+			(zeroRange(fileSystemPtr, inodePtr, inodePtr->size, dynamicResourcePtr->seekOffset) < 0 ||
+			writeFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodeData) < 0)) {
 		return WRITE_BYTE_FAILURE;
 	}
 
-	return WRITE_BYTE_SUCCESS;
+	//	the byte starts a new pending run; the block it lands in is only read and
+	//	written once the run is flushed
+	dynamicResourcePtr->pendingOffset = dynamicResourcePtr->seekOffset;
+
+	return bufferPendingByte(fileSystemPtr, dynamicResourcePtr, byte);
 }
 
 /* deletes a file and marks its blocks as free on disk.
@@ -548,12 +1044,7 @@ int tfs_deleteFile(fileDescriptor FD) {
 
 	DynamicResource *dynamicResourcePtr = findResource(fileSystemPtr->dynamicResourceTable, FD);
 	Inode *inodePtr;
-	BlockNode *tmpPtr;
 	char buf[BLOCKSIZE];
-	char timeInode[BLOCKSIZE];
-	char *clearBuf = calloc(1, BLOCKSIZE);
-
-
 	char *modificationTimestamp;
 	modificationTimestamp = (char *) malloc(30);
 
@@ -561,7 +1052,7 @@ int tfs_deleteFile(fileDescriptor FD) {
 		return DELETE_FILE_FAILURE;
 	}
 
-	if (readBlock(fileSystemPtr->diskNum, dynamicResourcePtr->inodeBlockNum, buf) < 0) {
+	if (readFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, buf) < 0) {
 		return DELETE_FILE_FAILURE;
 	}
 
@@ -572,42 +1063,34 @@ int tfs_deleteFile(fileDescriptor FD) {
 	if (inodePtr->filePermission == READONLY) {
 		return DELETE_FILE_FAILURE;
 	}
-	inodePtr->modificationTimestamp = modificationTimestamp;
-	memcpy(&timeInode[2], inodePtr, sizeof(Inode));
 
-	if (writeBlock(fileSystemPtr->diskNum, dynamicResourcePtr->inodeBlockNum, timeInode) < 0) {
-		return DELETE_FILE_FAILURE;
+	if(fileSystemPtr->transaction != NULL) {
+		return stageOp(fileSystemPtr, (StagedOp) { TXN_DELETE, FD }) < 0 ? DELETE_FILE_FAILURE : DELETE_FILE_SUCCESS;
 	}
 
-	tmpPtr = inodePtr->dataBlocks;
+	//	appends still held on the file's handles go with the rest of the content
+	dropFilePendingData(fileSystemPtr, dynamicResourcePtr->inodeBlockNum);
+	dynamicResourcePtr->seekOffset = 0;
 
-	memset(&clearBuf[0], FREE, 1);
-	memset(&clearBuf[1], MAGIC_NUMBER, 1);
+	releaseExtents(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodePtr);
 
-	while (tmpPtr != NULL) {
-		writeBlock(fileSystemPtr->diskNum, tmpPtr->blockNum, clearBuf);
-		tmpPtr = tmpPtr->next;
-	}
+	//	freeing only updates the free list, the blocks' old contents are left as garbage
+	blockListChanged(fileSystemPtr, inodePtr->dataBlocks);
+	releaseDataBlocks(fileSystemPtr, inodePtr->dataBlocks);
 
-	freeDataBlocks(inodePtr->dataBlocks);
 	inodePtr->dataBlocks = NULL;
 	inodePtr->size = 0;
-	return DELETE_FILE_SUCCESS;
-}
-
-
-//Free a deleted files data blocks
-void freeDataBlocks(BlockNode *blockHead) {
-	BlockNode *tmpHead = blockHead;
-	BlockNode *tmpPtr;
+	inodePtr->modificationTimestamp = modificationTimestamp;
 
-	while (tmpHead != NULL) {
-		tmpPtr = tmpHead;
-		tmpHead = tmpHead->next;
-		free(tmpPtr);
+	//	the inode is the only block written
+	if (writeFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, buf) < 0) {
+		return DELETE_FILE_FAILURE;
 	}
+
+	return syncOp(fileSystemPtr, FD, DELETE_FILE_SUCCESS, DELETE_FILE_FAILURE);
 }
 
+
 /* reads one byte from the file and copies it to buffer, using the current file pointer 
  * location and incrementing it by one upon success. If the file pointer is already at 
  * the end of the file then tfs_readByte() should return an error and not increment the 
@@ -622,10 +1105,9 @@ int tfs_readByte(fileDescriptor FD, char *buffer) {
 
 	DynamicResource *dynamicResourcePtr = findResource(fileSystemPtr->dynamicResourceTable, FD);
 	Inode *inodePtr;
-	BlockNode *tmpPtr;
 	char buf[BLOCKSIZE];
-	char timeInode[BLOCKSIZE];
-	int offset;
+	char *payload;
+	off_t offset;
 	char *accessTimestamp;
 	accessTimestamp = (char *) malloc(30);
 
@@ -635,346 +1117,4931 @@ int tfs_readByte(fileDescriptor FD, char *buffer) {
 		return READ_BYTE_FAILURE;
 	}
 
-	if (readBlock(fileSystemPtr->diskNum, dynamicResourcePtr->inodeBlockNum, buf) < 0) {
+	//	appends still held on any handle of the file must be readable
+	if (flushFilePendingData(fileSystemPtr, dynamicResourcePtr->inodeBlockNum) < 0) {
+		return READ_BYTE_FAILURE;
+	}
+
+	if (readFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, buf) < 0) {
 		return READ_BYTE_FAILURE;
 	}
 
 	inodePtr = (Inode *)&buf[2];
 
 	inodePtr->accessTimestamp = accessTimestamp;
-	memcpy(&timeInode[2], inodePtr, sizeof(Inode));
-	if (writeBlock(fileSystemPtr->diskNum, dynamicResourcePtr->inodeBlockNum, timeInode) < 0) {
+	if (writeFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, buf) < 0) {
 		return READ_BYTE_FAILURE;
 	}
 
 	if (dynamicResourcePtr->seekOffset > inodePtr->size) {
 		return READ_BYTE_FAILURE;
 	}
-	offset = dynamicResourcePtr->seekOffset / (BLOCKSIZE-2);
-	tmpPtr = inodePtr->dataBlocks;
 
-	while (offset > 0) {
-		tmpPtr = tmpPtr->next;
-		offset--;
+	//	compressed files are read from the handle's decompressed copy of a group
+	if (inodePtr->extents != NULL) {
+		offset = dynamicResourcePtr->seekOffset - dynamicResourcePtr->groupStart;
+
+		if (dynamicResourcePtr->seekOffset < inodePtr->size && (dynamicResourcePtr->groupExtent == NULL ||
+				offset < 0 || offset >= dynamicResourcePtr->groupExtent->rawSize)) {
+			if (loadCompressedGroup(fileSystemPtr, dynamicResourcePtr, inodePtr, dynamicResourcePtr->seekOffset) < 0) {
+				return READ_BYTE_FAILURE;
+			}
+
+			offset = dynamicResourcePtr->seekOffset - dynamicResourcePtr->groupStart;
+		}
+
+		*buffer = dynamicResourcePtr->seekOffset < inodePtr->size ? dynamicResourcePtr->groupData[offset] : 0;
+		dynamicResourcePtr->seekOffset++;
+
+		return READ_BYTE_SUCCESS;
 	}
 
-	if (readBlock(fileSystemPtr->diskNum, tmpPtr->blockNum, buf) < 0) {
+	if (readAheadBlock(fileSystemPtr, dynamicResourcePtr, inodePtr, dynamicResourcePtr->seekOffset / (BLOCKSIZE-2), &payload) < 0) {
 		return READ_BYTE_FAILURE;
 	}
 
 	offset = dynamicResourcePtr->seekOffset % (BLOCKSIZE-2);
-	offset += 2;
-	*buffer = (0xFF) & buf[offset];
+	*buffer = (0xFF) & payload[offset];
 	dynamicResourcePtr->seekOffset++;
 
 	return READ_BYTE_SUCCESS;
 }
 
-/* change the file pointer location to offset (absolute). Returns success/error codes. */
-int tfs_seek(fileDescriptor FD, int offset) {
-	FileSystem *fileSystemPtr = findFileSystem(mountedFsName);
+int tfs_readView(fileDescriptor FD, off_t offset, int len, ReadView *view) {
+	FileSystem *fileSystemPtr;
+	DynamicResource *dynamicResourcePtr, groupResource;
+	Inode *inodePtr;
+	char buf[BLOCKSIZE];
+	char *accessTimestamp;
+	int first, blocks, block, skip;
+	off_t position;
 
-	if(fileSystemPtr == NULL) {
-		return SEEK_FILE_FAILURE;
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL || view == NULL || offset < 0 || len < 0) {
+		return READ_VIEW_FAILURE;
 	}
 
-	DynamicResource *dynamicResourcePtr = findResource(fileSystemPtr->dynamicResourceTable, FD);
-	Inode *inodePtr;
-	BlockNode *tmpPtr;
-    char buf[BLOCKSIZE];
+	dynamicResourcePtr = findResource(fileSystemPtr->dynamicResourceTable, FD);
 
-	if (dynamicResourcePtr == NULL) {
-		return SEEK_FILE_FAILURE;
-	}
-	if (readBlock(fileSystemPtr->diskNum, dynamicResourcePtr->inodeBlockNum, buf) < 0) {
-		return SEEK_FILE_FAILURE;
+	if(dynamicResourcePtr == NULL) {
+		return READ_VIEW_FAILURE;
 	}
 
-	inodePtr = (Inode *)&buf[2];
-	if (offset > inodePtr->size) {
-		return SEEK_FILE_FAILURE;
+	//	bytes still held on any handle of the file must be in the view
+	if(flushFilePendingData(fileSystemPtr, dynamicResourcePtr->inodeBlockNum) < 0 ||
+			readFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, buf) < 0) {
+		return READ_VIEW_FAILURE;
 	}
 
-	dynamicResourcePtr->seekOffset = offset;
+	inodePtr = (Inode *)&buf[2];
 
-	return SEEK_FILE_SUCCESS;
-}
+	if(offset > inodePtr->size) {
+		return READ_VIEW_FAILURE;
+	}
 
-int tfs_readFileInfo(fileDescriptor FD) {
-	int result;
-	FileSystem *fileSystemPtr;
-	DynamicResource *dynamicResourcePtr;
-	Inode *inodePtr;
-    char buf[BLOCKSIZE];
+	if(len > inodePtr->size - offset) {
+		len = inodePtr->size - offset;
+	}
 
-	fileSystemPtr = findFileSystem(mountedFsName);
+	accessTimestamp = (char *) malloc(30);
+	getCurrentTime(accessTimestamp);
+	inodePtr->accessTimestamp = accessTimestamp;
 
-	if(fileSystemPtr == NULL) {
-		return READ_FILE_INFO_FAILURE;
+	if(writeFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, buf) < 0) {
+		return READ_VIEW_FAILURE;
 	}
 
-	dynamicResourcePtr = findResource(fileSystemPtr->dynamicResourceTable, FD);
+	*view = (ReadView) {
+		NULL,
+		0,
+		len,
+		NULL
+	};
 
-	if (dynamicResourcePtr == NULL) {
-		return SEEK_FILE_FAILURE;
-	}
-	if (readBlock(fileSystemPtr->diskNum, dynamicResourcePtr->inodeBlockNum, buf) < 0) {
-		return SEEK_FILE_FAILURE;
+	if(len == 0) {
+		return READ_VIEW_SUCCESS;
 	}
 
-	inodePtr = (Inode *)&buf[2];
+	//	each group is decompressed into its own part of the pinned buffer
+	if(inodePtr->extents != NULL) {
+		blocks = (len + COMPRESS_GROUP_SIZE - 1) / COMPRESS_GROUP_SIZE + 1;
+		view->slices = malloc(blocks * sizeof(ViewSlice));
+		view->pinned = malloc(blocks * COMPRESS_GROUP_SIZE);
+		groupResource = (DynamicResource) { NULL };
 
-	printf("File info for %s:\n", inodePtr->name);
-	printf("Creation time: %s", inodePtr->creationTimestamp);
-	printf("Modification time: %s", inodePtr->modificationTimestamp);
-	printf("Access time: %s", inodePtr->accessTimestamp);
+		for(position = offset; position < offset + len; position += view->slices[view->count++].length) {
+			groupResource.groupData = view->pinned + view->count * COMPRESS_GROUP_SIZE;
 
-	return 1;
-}
+			if(loadCompressedGroup(fileSystemPtr, &groupResource, inodePtr, position) < 0) {
+				tfs_releaseView(view);
+				return READ_VIEW_FAILURE;
+			}
 
-/* File listing and renaming */
+			view->slices[view->count] = (ViewSlice) {
+				groupResource.groupData + position - groupResource.groupStart,
+				groupResource.groupStart + groupResource.groupExtent->rawSize - position
+			};
 
-/* renames a file.  New name should be passed in. */
-int tfs_rename(char *oldName, char *newName) {
-	int result;
-	FileSystem *fileSystemPtr;
-	int inodeBlockNum;
+			if(view->slices[view->count].length > offset + len - position) {
+				view->slices[view->count].length = offset + len - position;
+			}
+		}
 
-	if(strlen(newName) > 8) {
-		return RENAME_FILE_FAILURE;
+		return READ_VIEW_SUCCESS;
 	}
 
-	if(strcmp(oldName, "/") == 0) {
-		return RENAME_FILE_FAILURE;
-	}
+	first = offset / (BLOCKSIZE - 2);
+	blocks = (offset + len - 1) / (BLOCKSIZE - 2) - first + 1;
 
-	fileSystemPtr = findFileSystem(mountedFsName);
+	//	holes and blocks past the end of the block list stay zero
+	view->slices = malloc(blocks * sizeof(ViewSlice));
+	view->pinned = calloc(blocks, BLOCKSIZE);
+	position = offset;
 
-	if(fileSystemPtr == NULL) {
-		return RENAME_FILE_FAILURE;
+	if(readFileBlocks(fileSystemPtr, inodePtr, first, blocks, view->pinned) < 0) {
+		tfs_releaseView(view);
+		return READ_VIEW_FAILURE;
 	}
 
-	inodeBlockNum = findFile(*fileSystemPtr, oldName);
+	for(block = 0; block < blocks; block++) {
+		skip = block == 0 ? offset % (BLOCKSIZE - 2) : 0;
+
+		view->slices[block] = (ViewSlice) {
+			view->pinned + block * BLOCKSIZE + 2 + skip,
+			BLOCKSIZE - 2 - skip
+		};
 
-	if(inodeBlockNum < 0) {
-		return RENAME_FILE_FAILURE;
+		if(view->slices[block].length > offset + len - position) {
+			view->slices[block].length = offset + len - position;
+		}
+
+		position += view->slices[block].length;
 	}
 
-	if((result = renameInode(fileSystemPtr, inodeBlockNum, newName)) < 0) {
-		return RENAME_FILE_FAILURE;
+	view->count = blocks;
+
+	return READ_VIEW_SUCCESS;
+}
+
+int tfs_releaseView(ReadView *view) {
+	if(view == NULL) {
+		return RELEASE_VIEW_FAILURE;
 	}
 
-	return renameDynamicResource(fileSystemPtr, inodeBlockNum, newName);
+	free(view->slices);
+	free(view->pinned);
+
+	*view = (ReadView) {
+		NULL,
+		0,
+		0,
+		NULL
+	};
+
+	return RELEASE_VIEW_SUCCESS;
 }
 
-/* lists all the files and directories on the disk */
-int tfs_readdir() {
-	char data[BLOCKSIZE];
+void *tfs_mmap(fileDescriptor FD, off_t offset, int len, int prot) {
 	FileSystem *fileSystemPtr;
-	Inode *inodePtr;
-	int block, blocks, result;
+	DynamicResource *dynamicResourcePtr;
+	Mapping *mapping;
+	ReadView view;
+	char data[BLOCKSIZE];
+	char *addr, *position;
+	int slice;
 
 	fileSystemPtr = findFileSystem(mountedFsName);
 
-	if(fileSystemPtr == NULL) {
-		return READ_DIR_FAILURE;
+	if(fileSystemPtr == NULL || len <= 0 || !(prot & MMAP_READ) || prot & ~(MMAP_READ | MMAP_WRITE)) {
+		return NULL;
 	}
 
-	blocks = fileSystemPtr->size / BLOCKSIZE;
-
-	for(block = 0; block < blocks; block++) {
-		if((result = readBlock(fileSystemPtr->diskNum, block, data)) < 0) {
-			return result;		//	means error reading block
-		}
+	dynamicResourcePtr = findResource(fileSystemPtr->dynamicResourceTable, FD);
 
-		if(data[0] == INODE) {
-			inodePtr = (Inode *)&data[2];
+	if(dynamicResourcePtr == NULL) {
+		return NULL;
+	}
 
-			printf("%s\n", inodePtr->name);
-		}
+	if(readFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, data) < 0) {
+		return NULL;
 	}
 
-	return 1;
-}
+	//	a read-only file can't be mapped for writing
+	if(prot & MMAP_WRITE && ((Inode *)&data[2])->filePermission == READONLY) {
+		return NULL;
+	}
 
-int setMagicNumbers(fileDescriptor diskNum, int blocks) {
-	int block, result = 1;
-	char *data = calloc(1, BLOCKSIZE);
+	if(tfs_readView(FD, offset, len, &view) < 0) {
+		return NULL;
+	}
 
-	//	set first byte of data to free block code
-	memset(&data[0], FREE, 1);
+	addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 
-	//	set second byte of data to magic number
-	memset(&data[1], MAGIC_NUMBER, 1);
+	if(addr == MAP_FAILED) {
+		tfs_releaseView(&view);
+		return NULL;
+	}
 
-	for(block = 0; block < blocks; block++) {
-		if((result = writeBlock(diskNum, block, data)) < 0) {
-			return result;
-		}
+	//	anonymous memory starts out zeroed, which covers anything past the end of file
+	for(slice = 0, position = addr; slice < view.count; position += view.slices[slice++].length) {
+		memcpy(position, view.slices[slice].data, view.slices[slice].length);
 	}
 
-	return result;
-}
+	tfs_releaseView(&view);
 
-int writeSuperBlock(fileDescriptor diskNum, SuperBlock superblock) {
-	char *data = calloc(1, BLOCKSIZE);
-	
-	//	set first byte of data to superblock block code
-	memset(&data[0], SUPERBLOCK, 1);
+	if(!(prot & MMAP_WRITE) && mprotect(addr, len, PROT_READ) < 0) {
+		munmap(addr, len);
+		return NULL;
+	}
 
-	//	set second byte of data to magic number
-	memset(&data[1], MAGIC_NUMBER, 1);
+	mapping = malloc(sizeof(Mapping));
+	*mapping = (Mapping) {
+		addr,
+		NULL,
+		dynamicResourcePtr->inodeBlockNum,
+		((Inode *)&data[2])->generation,
+		offset,
+		len,
+		fileSystemPtr->mappings
+	};
 
-	//	copy over superblock data
-	memcpy(&data[2], &(superblock), sizeof(superblock));
+	//	what the range held when it was read, to find the bytes written since
+	if(prot & MMAP_WRITE) {
+		mapping->shadow = malloc(len);
+		memcpy(mapping->shadow, addr, len);
+	}
 
-	return writeBlock(diskNum, 0, data);
+	fileSystemPtr->mappings = mapping;
+
+	return addr;
 }
 
-int writeRootInode(fileDescriptor diskNum, Inode rootInode) {
-	char *data = calloc(1, BLOCKSIZE);
-	int result;
-	
-	//	set first byte of data to inode block code
-	memset(&data[0], INODE, 1);
+int tfs_msync(void *addr) {
+	FileSystem *fileSystemPtr;
+	Mapping *mapping;
 
-	//	set second byte of data to magic number
-	memset(&data[1], MAGIC_NUMBER, 1);
+	fileSystemPtr = findFileSystem(mountedFsName);
 
-	//	copy over inode data
-	memcpy(&data[2], &(rootInode), sizeof(rootInode));
+	if(fileSystemPtr == NULL || (mapping = findMapping(fileSystemPtr, addr)) == NULL) {
+		return MSYNC_FAILURE;
+	}
 
-	//	write root inode and return status
-	return writeBlock(diskNum, 1, data);
+	if(writeBackMapping(fileSystemPtr, mapping) < 0 || syncDisk(fileSystemPtr->diskNum) < 0) {
+		return MSYNC_FAILURE;
+	}
+
+	return MSYNC_SUCCESS;
 }
 
-BlockNode *setupFreeBlockList(int freeBlockCount) {
-	int block;
+int tfs_munmap(void *addr) {
+	FileSystem *fileSystemPtr;
+	Mapping **link, *mapping;
 
-	BlockNode *curr, *head = malloc(sizeof(BlockNode));
+	fileSystemPtr = findFileSystem(mountedFsName);
 
-	//	first two blocks are used for superblock and root inode, so start at 2
-	head->blockNum = 2;
-	head->next = NULL;
+	if(fileSystemPtr == NULL || (mapping = findMapping(fileSystemPtr, addr)) == NULL) {
+		return MUNMAP_FAILURE;
+	}
 
-	curr = head;
+	//	the mapping stays if its changes can't be written back, so nothing is lost
+	if(writeBackMapping(fileSystemPtr, mapping) < 0) {
+		return MUNMAP_FAILURE;
+	}
 
-	for(block = 3; block < freeBlockCount; block++) {
-		curr->next = malloc(sizeof(BlockNode));
-		curr->next->blockNum = block;
-		curr->next->next = NULL;
+	for(link = &fileSystemPtr->mappings; *link != mapping; link = &(*link)->next);
 
-		curr = curr->next;
-	}
+	*link = mapping->next;
+	releaseMapping(mapping);
 
-	return head;
+	return syncOp(fileSystemPtr, -1, MUNMAP_SUCCESS, MUNMAP_FAILURE);
 }
 
-void addFileSystem(FileSystem fileSystem) {
-	FileSystemNode *curr;
+int tfs_importFile(char *hostPath, char *name) {
+	FileSystem *fileSystemPtr;
+	struct stat hostStat;
+	fileDescriptor FD;
+	int host, result;
 
-	FileSystem *fileSystemPtr = malloc(sizeof(FileSystem));
-	memcpy(fileSystemPtr, &fileSystem, sizeof(FileSystem));
-	
-	//	create head if it is null
-	if(fsHead == NULL) {
-		fsHead = malloc(sizeof(FileSystemNode));
-		*fsHead = (FileSystemNode) {
-			fileSystemPtr,
-			NULL
-		};
-	}
-	else {
-		curr = fsHead;
-		
-		while(curr->next != NULL) curr = curr->next;
-				
-		curr->next = malloc(sizeof(FileSystemNode));
-		*(curr->next) = (FileSystemNode) {
-			fileSystemPtr,
-			NULL
-		};
-	}
-}
+	fileSystemPtr = findFileSystem(mountedFsName);
 
-FileSystem *findFileSystem(char *filename) {
-	FileSystemNode *curr = fsHead;
-	if(curr == NULL) {
-		return NULL;
+	//	the content streams straight to the blocks, so a transaction couldn't stage it
+	if(fileSystemPtr == NULL || fileSystemPtr->transaction != NULL || (host = open(hostPath, O_RDONLY)) < 0) {
+		return IMPORT_FAILURE;
 	}
-	
-	else {
-		if(strcmp(curr->fileSystem->filename, filename) == 0) return curr->fileSystem;
-		
-		while(curr->next != NULL) {
-			curr = curr->next;
 
-			if(strcmp(curr->fileSystem->filename, filename) == 0) return curr->fileSystem;
-		}
-		
-		return NULL;
+	if(fstat(host, &hostStat) < 0 || hostStat.st_size > MAX_FILE_SIZE || (FD = tfs_openFile(name)) < 0) {
+		close(host);
+		return IMPORT_FAILURE;
 	}
-}
 
-int verifyFileSystem(FileSystem fileSystem) {
-	int block, blocks, result;
-	char *data = malloc(BLOCKSIZE);
-
-	blocks = fileSystem.size / BLOCKSIZE;
+	result = streamHostFile(fileSystemPtr, FD, host);
 
-	for(block = 0; block < blocks; block++) {
-		if((result = readBlock(fileSystem.diskNum, block, data)) < 0) {
-			return result;		//	means error reading block
-		}
+	close(host);
 
-		if(data[1] != MAGIC_NUMBER) {
-			return FS_VERIFY_FAILURE;
-		}
+	if(tfs_closeFile(FD) < 0 || result < 0) {
+		return IMPORT_FAILURE;
 	}
 
-	return 1;
+	return IMPORT_SUCCESS;
 }
 
-int findFile(FileSystem fileSystem, char *filename) {
-	int block, blocks, result;
-	char *data = malloc(BLOCKSIZE);
-	Inode *inodePtr;
+int tfs_exportFile(char *name, char *hostPath) {
+	FileSystem *fileSystemPtr;
+	ReadView view;
+	fileDescriptor FD;
+	char data[BLOCKSIZE], leafName[9];
+	int inodeBlockNum, parentBlockNum, host, length, result = EXPORT_SUCCESS;
+	off_t offset;
 
-	blocks = fileSystem.size / BLOCKSIZE;
+	fileSystemPtr = findFileSystem(mountedFsName);
 
-	for(block = 0; block < blocks; block++) {
-		if((result = readBlock(fileSystem.diskNum, block, data)) < 0) {
-			return result;		//	means error reading block
-		}
+	if(fileSystemPtr == NULL) {
+		return EXPORT_FAILURE;
+	}
 
-		if(data[0] == INODE) {
-			inodePtr = (Inode *)&data[2];
+	//	opening a file that isn't there would make it
+	if((inodeBlockNum = resolvePath(fileSystemPtr, name, &parentBlockNum, leafName)) < 0 ||
+			readFsBlock(fileSystemPtr, inodeBlockNum, data) < 0 || ((Inode *)&data[2])->directory) {
+		return EXPORT_FAILURE;
+	}
 
-			if(strcmp(inodePtr->name, filename) == 0) {
-				return block;
-			}
-		}
+	if((FD = tfs_openFile(name)) < 0) {
+		return EXPORT_FAILURE;
 	}
 
-	return -1;
-}
+	if((host = open(hostPath, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+		tfs_closeFile(FD);
+		return EXPORT_FAILURE;
+	}
+
+	//	a chunk shorter than asked for is the end of the file
+	for(offset = 0, length = HOST_COPY_CHUNK; result == EXPORT_SUCCESS && length == HOST_COPY_CHUNK; offset += length) {
+		view = (ReadView) {
+			NULL,
+			0,
+			0,
+			NULL
+		};
+
+		if(tfs_readView(FD, offset, HOST_COPY_CHUNK, &view) < 0 || writeSlices(host, &view) < 0) {
+			result = EXPORT_FAILURE;
+		}
+
+		length = view.length;
+		tfs_releaseView(&view);
+	}
+
+	if(close(host) < 0 || tfs_closeFile(FD) < 0) {
+		return EXPORT_FAILURE;
+	}
+
+	return result;
+}
+
+int tfs_pread(fileDescriptor FD, char *buffer, int len, off_t offset) {
+	FileSystem *fileSystemPtr;
+	DynamicResource *dynamicResourcePtr, groupResource;
+	DynamicResourceNode *curr;
+	Inode *inodePtr;
+	char inodeData[BLOCKSIZE], blockData[READ_AHEAD_MAX * BLOCKSIZE];
+	int first, blocks, block, skip, copySize;
+	off_t size, position, from, to;
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL || buffer == NULL || offset < 0 || len < 0) {
+		return PREAD_FAILURE;
+	}
+
+	dynamicResourcePtr = findResource(fileSystemPtr->dynamicResourceTable, FD);
+
+	if(dynamicResourcePtr == NULL || readFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodeData) < 0) {
+		return PREAD_FAILURE;
+	}
+
+	inodePtr = (Inode *)&inodeData[2];
+	size = pendingFileSize(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodePtr->size);
+
+	if(offset > size) {
+		return PREAD_FAILURE;
+	}
+
+	if(len > size - offset) {
+		len = size - offset;
+	}
+
+	//	each group is decompressed into a buffer of the call's own
+	if(inodePtr->extents != NULL) {
+		groupResource = (DynamicResource) { NULL };
+
+		for(position = offset; position < offset + len; position += copySize) {
+			if(loadCompressedGroup(fileSystemPtr, &groupResource, inodePtr, position) < 0) {
+				free(groupResource.groupData);
+				return PREAD_FAILURE;
+			}
+
+			copySize = groupResource.groupStart + groupResource.groupExtent->rawSize - position;
+
+			if(copySize > offset + len - position) copySize = offset + len - position;
+
+			memcpy(buffer + position - offset, groupResource.groupData + position - groupResource.groupStart, copySize);
+		}
+
+		free(groupResource.groupData);
+	}
+	else {
+		//	READ_AHEAD_MAX blocks at a time go through the same run reads as tfs_readView()
+		for(position = offset; position < offset + len; ) {
+			first = position / (BLOCKSIZE - 2);
+			blocks = (offset + len - 1) / (BLOCKSIZE - 2) - first + 1;
+
+			if(blocks > READ_AHEAD_MAX) blocks = READ_AHEAD_MAX;
+
+			memset(blockData, 0, blocks * BLOCKSIZE);
+
+			if(readFileBlocks(fileSystemPtr, inodePtr, first, blocks, blockData) < 0) {
+				return PREAD_FAILURE;
+			}
+
+			for(block = 0; block < blocks; block++, position += copySize) {
+				skip = position % (BLOCKSIZE - 2);
+				copySize = BLOCKSIZE - 2 - skip;
+
+				if(copySize > offset + len - position) copySize = offset + len - position;
+
+				memcpy(buffer + position - offset, blockData + block * BLOCKSIZE + 2 + skip, copySize);
+			}
+		}
+	}
+
+	//	bytes a handle of the file still holds are newer than the disk; they are copied
+	//	rather than flushed, so the call changes nothing another thread could see
+	for(curr = fileSystemPtr->dynamicResourceTable; curr != NULL; curr = curr->next) {
+		from = curr->dynamicResource->pendingOffset > offset ? curr->dynamicResource->pendingOffset : offset;
+		to = curr->dynamicResource->pendingOffset + curr->dynamicResource->pendingSize;
+
+		if(to > offset + len) to = offset + len;
+
+		if(curr->dynamicResource->inodeBlockNum == dynamicResourcePtr->inodeBlockNum &&
+				curr->dynamicResource->pendingSize > 0 && from < to) {
+			memcpy(buffer + from - offset, curr->dynamicResource->pendingData +
+				from - curr->dynamicResource->pendingOffset, to - from);
+		}
+	}
+
+	return len;
+}
+
+int tfs_readv(fileDescriptor FD, const struct iovec *iov, int iovcnt) {
+	FileSystem *fileSystemPtr;
+	DynamicResource *dynamicResourcePtr;
+	int result;
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL) {
+		return READV_FAILURE;
+	}
+
+	dynamicResourcePtr = findResource(fileSystemPtr->dynamicResourceTable, FD);
+
+	if(dynamicResourcePtr == NULL) {
+		return READV_FAILURE;
+	}
+
+	if((result = tfs_preadv(FD, iov, iovcnt, dynamicResourcePtr->seekOffset)) > 0) {
+		dynamicResourcePtr->seekOffset += result;
+	}
+
+	return result;
+}
+
+int tfs_preadv(fileDescriptor FD, const struct iovec *iov, int iovcnt, off_t offset) {
+	ReadView view = (ReadView) {
+		NULL,
+		0,
+		0,
+		NULL
+	};
+	int slice, slicePosition = 0, vector, total;
+	size_t vectorPosition = 0, copySize;
+
+	if((total = vectorLength(iov, iovcnt)) < 0 || tfs_readView(FD, offset, total, &view) < 0) {
+		return READV_FAILURE;
+	}
+
+	total = view.length;
+
+	//	each slice is copied into as many vectors as it spans, skipping empty ones
+	for(slice = 0, vector = 0; slice < view.count; ) {
+		copySize = view.slices[slice].length - slicePosition;
+
+		if(copySize > iov[vector].iov_len - vectorPosition) copySize = iov[vector].iov_len - vectorPosition;
+
+		memcpy((char *)iov[vector].iov_base + vectorPosition, view.slices[slice].data + slicePosition, copySize);
+		slicePosition += copySize;
+		vectorPosition += copySize;
+
+		if(slicePosition == view.slices[slice].length) {
+			slice++;
+			slicePosition = 0;
+		}
+
+		if(vectorPosition == iov[vector].iov_len) {
+			vector++;
+			vectorPosition = 0;
+		}
+	}
+
+	tfs_releaseView(&view);
+
+	return total;
+}
+
+int tfs_writev(fileDescriptor FD, const struct iovec *iov, int iovcnt) {
+	return syncOp(findFileSystem(mountedFsName), FD, writeVector(FD, iov, iovcnt, -1), WRITEV_FAILURE);
+}
+
+int tfs_pwritev(fileDescriptor FD, const struct iovec *iov, int iovcnt, off_t offset) {
+	if(offset < 0) {
+		return WRITEV_FAILURE;
+	}
+
+	return syncOp(findFileSystem(mountedFsName), FD, writeVector(FD, iov, iovcnt, offset), WRITEV_FAILURE);
+}
+
+/* Writes the vectors into the file open as FD at 'offset', or at the file pointer if it
+ * is negative, moving the file pointer past them in that case. The bytes go into the
+ * data blocks in one writeDataVector() and the inode is written once. Returns the number
+ * of bytes written or WRITEV_FAILURE.
+ */
+int writeVector(fileDescriptor FD, const struct iovec *iov, int iovcnt, off_t offset) {
+	FileSystem *fileSystemPtr;
+	DynamicResource *dynamicResourcePtr;
+	Inode *inodePtr;
+	char inodeData[BLOCKSIZE];
+	char *modificationTimestamp;
+	int total, advance = offset < 0;
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	//	only whole-file writes, renames and deletes can be staged by a transaction
+	if(fileSystemPtr == NULL || fileSystemPtr->transaction != NULL || (total = vectorLength(iov, iovcnt)) < 0) {
+		return WRITEV_FAILURE;
+	}
+
+	dynamicResourcePtr = findResource(fileSystemPtr->dynamicResourceTable, FD);
+
+	if(dynamicResourcePtr == NULL) {
+		return WRITEV_FAILURE;
+	}
+
+	//	bytes held on any handle of the file go first, so the vectors land over them
+	if(flushFilePendingData(fileSystemPtr, dynamicResourcePtr->inodeBlockNum) < 0 ||
+			readFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodeData) < 0) {
+		return WRITEV_FAILURE;
+	}
+
+	inodePtr = (Inode *)&inodeData[2];
+
+	if(inodePtr->filePermission == READONLY) {
+		return WRITEV_FAILURE;
+	}
+
+	if(advance) {
+		offset = dynamicResourcePtr->flags & OPEN_APPEND ? inodePtr->size : dynamicResourcePtr->seekOffset;
+	}
+
+	if(total == 0) {
+		return 0;
+	}
+
+	if(offset > MAX_FILE_SIZE - total || decompressFile(fileSystemPtr, dynamicResourcePtr, inodeData) < 0) {
+		return WRITEV_FAILURE;
+	}
+
+	//	a gap between the end of file and the write has to read back as zeros
+	if(offset > inodePtr->size && zeroRange(fileSystemPtr, inodePtr, inodePtr->size, offset) < 0) {
+		return WRITEV_FAILURE;
+	}
+
+	if(writeDataVector(fileSystemPtr, inodePtr, offset, iov, iovcnt) < 0) {
+		return WRITEV_FAILURE;
+	}
+
+	modificationTimestamp = (char *) malloc(30);
+	getCurrentTime(modificationTimestamp);
+	inodePtr->modificationTimestamp = modificationTimestamp;
+
+	if(offset + total > inodePtr->size) {
+		inodePtr->size = offset + total;
+	}
+
+	if(writeFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodeData) < 0) {
+		return WRITEV_FAILURE;
+	}
+
+	if(advance) {
+		dynamicResourcePtr->seekOffset = offset + total;
+	}
+
+	return total;
+}
+
+/* Returns the number of bytes the vectors hold, or -1 if they are malformed or hold more
+ * than a file can
+ */
+int vectorLength(const struct iovec *iov, int iovcnt) {
+	int vector, total = 0;
+
+	if(iovcnt < 0 || (iov == NULL && iovcnt > 0)) {
+		return -1;
+	}
+
+	for(vector = 0; vector < iovcnt; vector++) {
+		if(iov[vector].iov_len > (size_t)(INT32_MAX - total)) {
+			return -1;
+		}
+
+		total += iov[vector].iov_len;
+	}
+
+	return total;
+}
+
+/* change the file pointer location to offset (absolute). Returns success/error codes.
+ * The offset may be past the end of file; writing there leaves a hole behind.
+ */
+int tfs_seek(fileDescriptor FD, off_t offset) {
+	FileSystem *fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL) {
+		return SEEK_FILE_FAILURE;
+	}
+
+	DynamicResource *dynamicResourcePtr = findResource(fileSystemPtr->dynamicResourceTable, FD);
+
+	if (dynamicResourcePtr == NULL) {
+		return SEEK_FILE_FAILURE;
+	}
+	if (flushFilePendingData(fileSystemPtr, dynamicResourcePtr->inodeBlockNum) < 0) {
+		return SEEK_FILE_FAILURE;
+	}
+	if (offset < 0) {
+		return SEEK_FILE_FAILURE;
+	}
+
+	dynamicResourcePtr->seekOffset = offset;
+
+	return SEEK_FILE_SUCCESS;
+}
+
+/* Reserves data blocks for the byte range [offset, offset + len) of an open file, taking
+ * them from the free list as one contiguous run whenever the disk has one. Holes in the
+ * range inside the file are filled with zeroed blocks. The file size is left alone;
+ * appends and rewrites fill the reserved blocks before asking for more.
+ */
+int tfs_fallocate(fileDescriptor FD, off_t offset, off_t len) {
+	FileSystem *fileSystemPtr;
+	DynamicResource *dynamicResourcePtr;
+	Inode *inodePtr;
+	char inodeData[BLOCKSIZE];
+
+	if(offset < 0 || len <= 0 || len > MAX_FILE_SIZE - offset) {
+		return FALLOCATE_FAILURE;
+	}
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	//	only whole-file writes, renames and deletes can be staged by a transaction
+	if(fileSystemPtr == NULL || fileSystemPtr->transaction != NULL) {
+		return FALLOCATE_FAILURE;
+	}
+
+	dynamicResourcePtr = findResource(fileSystemPtr->dynamicResourceTable, FD);
+
+	if(dynamicResourcePtr == NULL) {
+		return FALLOCATE_FAILURE;
+	}
+
+	if(readFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodeData) < 0) {
+		return FALLOCATE_FAILURE;
+	}
+
+	inodePtr = (Inode *)&inodeData[2];
+
+	if(inodePtr->filePermission == READONLY) {
+		return FALLOCATE_FAILURE;
+	}
+
+	if(decompressFile(fileSystemPtr, dynamicResourcePtr, inodeData) < 0) {
+		return FALLOCATE_FAILURE;
+	}
+
+	blockListChanged(fileSystemPtr, inodePtr->dataBlocks);
+
+	//	reserved blocks past the end of file keep whatever garbage they hold until data is
+	//	written into them; the end counts bytes held back past it, since the gap before
+	//	them was zeroed while it was still holes
+	if(fillHoles(fileSystemPtr, &inodePtr->dataBlocks, 0, offset / (BLOCKSIZE - 2), (offset + len - 1) / (BLOCKSIZE - 2),
+			pendingFileSize(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodePtr->size)) < 0) {
+		return FALLOCATE_FAILURE;
+	}
+
+	if(writeFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodeData) < 0) {
+		return FALLOCATE_FAILURE;
+	}
+
+	return syncOp(fileSystemPtr, FD, FALLOCATE_SUCCESS, FALLOCATE_FAILURE);
+}
+
+/* Sets the size of an open file to len bytes. Shrinking hands back every block past the
+ * new end of file; extending leaves a hole, so only blocks already reserved past the old
+ * end of file are written.
+ */
+int tfs_truncate(fileDescriptor FD, off_t len) {
+	FileSystem *fileSystemPtr;
+	DynamicResource *dynamicResourcePtr;
+	Inode *inodePtr;
+	char inodeData[BLOCKSIZE];
+	char *modificationTimestamp;
+
+	if(len < 0 || len > MAX_FILE_SIZE) {
+		return TRUNCATE_FAILURE;
+	}
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	//	only whole-file writes, renames and deletes can be staged by a transaction
+	if(fileSystemPtr == NULL || fileSystemPtr->transaction != NULL) {
+		return TRUNCATE_FAILURE;
+	}
+
+	dynamicResourcePtr = findResource(fileSystemPtr->dynamicResourceTable, FD);
+
+	if(dynamicResourcePtr == NULL) {
+		return TRUNCATE_FAILURE;
+	}
+
+	if(flushFilePendingData(fileSystemPtr, dynamicResourcePtr->inodeBlockNum) < 0) {
+		return TRUNCATE_FAILURE;
+	}
+
+	if(readFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodeData) < 0) {
+		return TRUNCATE_FAILURE;
+	}
+
+	inodePtr = (Inode *)&inodeData[2];
+
+	if(inodePtr->filePermission == READONLY) {
+		return TRUNCATE_FAILURE;
+	}
+
+	if(decompressFile(fileSystemPtr, dynamicResourcePtr, inodeData) < 0) {
+		return TRUNCATE_FAILURE;
+	}
+
+	if(len < inodePtr->size) {
+		trimDataBlocks(fileSystemPtr, inodePtr, (len + BLOCKSIZE - 3) / (BLOCKSIZE - 2));
+	}
+	else if(len > inodePtr->size &&
+			zeroRange(fileSystemPtr, inodePtr, inodePtr->size, len) < 0) {
+		return TRUNCATE_FAILURE;
+	}
+
+	modificationTimestamp = (char *) malloc(30);
+	getCurrentTime(modificationTimestamp);
+
+	inodePtr->size = len;
+	inodePtr->modificationTimestamp = modificationTimestamp;
+
+	if(writeFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodeData) < 0) {
+		return TRUNCATE_FAILURE;
+	}
+
+	return syncOp(fileSystemPtr, FD, TRUNCATE_SUCCESS, TRUNCATE_FAILURE);
+}
+
+/* Turns delayed allocation on or off for the mounted file system. Turning it off flushes
+ * the appends every open handle is holding.
+ */
+int tfs_setDelayedAlloc(int enabled) {
+	FileSystem *fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL) {
+		return DELAYED_ALLOC_FAILURE;
+	}
+
+	if(!enabled && flushAllPendingData(fileSystemPtr) < 0) {
+		return DELAYED_ALLOC_FAILURE;
+	}
+
+	fileSystemPtr->delayedAllocation = enabled ? 1 : 0;
+
+	return DELAYED_ALLOC_SUCCESS;
+}
+
+/* Turns discarding of freed blocks on or off for the mounted file system */
+int tfs_setDiscard(int enabled) {
+	FileSystem *fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL) {
+		return DISCARD_FAILURE;
+	}
+
+	fileSystemPtr->discard = enabled ? 1 : 0;
+
+	return DISCARD_SUCCESS;
+}
+
+/* Sets the durability level of the mounted file system */
+int tfs_setDurability(int level) {
+	FileSystem *fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL || level < DURABILITY_NONE || level > DURABILITY_SYNC) {
+		return DURABILITY_FAILURE;
+	}
+
+	fileSystemPtr->durability = level;
+
+	return DURABILITY_SUCCESS;
+}
+
+/* Gives every open handle's held back appends their blocks and syncs the image */
+int tfs_sync() {
+	FileSystem *fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL || flushAllPendingData(fileSystemPtr) < 0 || syncDisk(fileSystemPtr->diskNum) < 0) {
+		return SYNC_FAILURE;
+	}
+
+	return SYNC_SUCCESS;
+}
+
+/* Gives the handle's held back appends their blocks, compresses the file again if writes
+ * decompressed it, and syncs the image
+ */
+int tfs_fsync(fileDescriptor FD) {
+	FileSystem *fileSystemPtr = findFileSystem(mountedFsName);
+	DynamicResource *dynamicResourcePtr;
+
+	if(fileSystemPtr == NULL) {
+		return SYNC_FAILURE;
+	}
+
+	dynamicResourcePtr = findResource(fileSystemPtr->dynamicResourceTable, FD);
+
+	if(dynamicResourcePtr == NULL || flushPendingData(fileSystemPtr, dynamicResourcePtr) < 0 ||
+			recompressFile(fileSystemPtr, dynamicResourcePtr->inodeBlockNum) < 0 ||
+			syncDisk(fileSystemPtr->diskNum) < 0) {
+		return SYNC_FAILURE;
+	}
+
+	return SYNC_SUCCESS;
+}
+
+/* Runs one step of the online defragmenter, doing at most 'budget' block reads and
+ * writes. Files are visited in inode block order; the cursor and any half-finished move
+ * are kept on the file system so the next step carries on where this one stopped.
+ */
+int tfs_defrag(int budget) {
+	FileSystem *fileSystemPtr;
+	DefragState *state;
+	char data[BLOCKSIZE];
+	int blocks, result, used = 0;
+
+	//	copying a block takes a read and a write, so smaller budgets could never move anything
+	if(budget < 2) {
+		return DEFRAG_FAILURE;
+	}
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL) {
+		return DEFRAG_FAILURE;
+	}
+
+	//	the log already lays blocks out in the order they are written
+	if(fileSystemPtr->logStructured) {
+		return DEFRAG_COMPLETE;
+	}
+
+	state = &fileSystemPtr->defrag;
+	blocks = fileSystemPtr->size / BLOCKSIZE;
+
+	while(used < budget) {
+		//	finish the file being moved before looking for another
+		if(state->inodeBlockNum >= 0) {
+			if((result = continueDefragMove(fileSystemPtr, budget - used)) < 0) {
+				return DEFRAG_FAILURE;
+			}
+
+			//	budget left is too small for the next copy
+			if(result == 0) {
+				break;
+			}
+
+			used += result;
+			continue;
+		}
+
+		//	end of a pass, which is the end of the job if it moved nothing
+		if(state->cursor >= blocks) {
+			state->cursor = 0;
+
+			if(state->moved == 0) {
+				return DEFRAG_COMPLETE;
+			}
+
+			state->moved = 0;
+			continue;
+		}
+
+		if(readFsBlock(fileSystemPtr, state->cursor, data) < 0) {
+			return DEFRAG_FAILURE;
+		}
+
+		used++;
+
+		if(data[0] == INODE && state->cursor != 1) {
+			startDefragMove(fileSystemPtr, state->cursor, (Inode *)&data[2]);
+		}
+
+		state->cursor++;
+	}
+
+	return DEFRAG_IN_PROGRESS;
+}
+
+/* Fills 'info' with file and free space fragmentation counts for the mounted file system */
+int tfs_fragInfo(FragInfo *info) {
+	FileSystem *fileSystemPtr;
+	Inode *inodePtr;
+	char data[BLOCKSIZE];
+	int block, blocks;
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	//	bytes held back on handles may still need blocks
+	if(fileSystemPtr == NULL || info == NULL || flushAllPendingData(fileSystemPtr) < 0) {
+		return FRAG_INFO_FAILURE;
+	}
+
+	*info = (FragInfo) {
+		0,
+		0,
+		0,
+		countBlocks(fileSystemPtr->superblock.freeBlocks),
+		countExtents(fileSystemPtr->superblock.freeBlocks)
+	};
+
+	blocks = fileSystemPtr->size / BLOCKSIZE;
+
+	//	block 1 is the root inode, which never has data blocks
+	for(block = 2; block < blocks; block++) {
+		if(readFsBlock(fileSystemPtr, block, data) < 0) {
+			return FRAG_INFO_FAILURE;
+		}
+
+		inodePtr = (Inode *)&data[2];
+
+		if(data[0] == INODE && !inodePtr->directory) {
+			info->files++;
+			info->dataBlocks += countDataBlocks(inodePtr->dataBlocks);
+			info->extents += countExtents(inodePtr->dataBlocks);
+		}
+	}
+
+	return FRAG_INFO_SUCCESS;
+}
+
+/* Fills 'info' with the mounted file system's logical and distinct data block counts */
+int tfs_dedupInfo(DedupInfo *info) {
+	FileSystem *fileSystemPtr;
+	BlockNode *currBlock;
+	char data[BLOCKSIZE], *counted;
+	int block, blocks;
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL || info == NULL || flushAllPendingData(fileSystemPtr) < 0) {
+		return DEDUP_INFO_FAILURE;
+	}
+
+	blocks = fileSystemPtr->size / BLOCKSIZE;
+	counted = calloc(blocks, 1);
+
+	*info = (DedupInfo) {
+		0,
+		0,
+		fileSystemPtr->dedupHits
+	};
+
+	for(block = 2; block < blocks; block++) {
+		if(readFsBlock(fileSystemPtr, block, data) < 0) {
+			free(counted);
+			return DEDUP_INFO_FAILURE;
+		}
+
+		if(data[0] != INODE) continue;
+
+		for(currBlock = ((Inode *)&data[2])->dataBlocks; currBlock != NULL; currBlock = currBlock->next) {
+			if(currBlock->blockNum == HOLE_BLOCK) continue;
+
+			info->logicalBlocks++;
+
+			if(!counted[currBlock->blockNum]) {
+				counted[currBlock->blockNum] = 1;
+				info->physicalBlocks++;
+			}
+		}
+	}
+
+	free(counted);
+
+	return DEDUP_INFO_SUCCESS;
+}
+
+/* Runs the segment cleaner of the mounted log-structured file system for one step */
+int tfs_clean(int budget) {
+	FileSystem *fileSystemPtr;
+	int segment, result, used = 0;
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	//	moving a block takes a read and a write
+	if(fileSystemPtr == NULL || !fileSystemPtr->logStructured || budget < 2) {
+		return CLEAN_FAILURE;
+	}
+
+	while(used + 2 <= budget) {
+		if((segment = findCleanVictim(fileSystemPtr)) < 0) {
+			return CLEAN_COMPLETE;
+		}
+
+		if((result = cleanSegment(fileSystemPtr, segment, budget - used)) < 0) {
+			return CLEAN_FAILURE;
+		}
+
+		used += result;
+	}
+
+	return findCleanVictim(fileSystemPtr) < 0 ? CLEAN_COMPLETE : CLEAN_IN_PROGRESS;
+}
+
+/* Fills 'info' with the segment and block counts of the mounted log-structured file system */
+int tfs_logInfo(LogInfo *info) {
+	FileSystem *fileSystemPtr;
+	LogState *log;
+	int segment, written;
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL || !fileSystemPtr->logStructured || info == NULL ||
+			flushAllPendingData(fileSystemPtr) < 0) {
+		return LOG_INFO_FAILURE;
+	}
+
+	log = &fileSystemPtr->log;
+
+	*info = (LogInfo) {
+		log->segments,
+		0,
+		0,
+		0,
+		log->cleanedBlocks
+	};
+
+	for(segment = 0; segment < log->segments; segment++) {
+		info->liveBlocks += log->segmentLive[segment];
+
+		//	only the head is part written, every other segment was filled before it was left
+		if(segment == log->headSegment) {
+			written = log->head - (1 + segment * LOG_SEGMENT_BLOCKS);
+		}
+		else if(log->segmentLive[segment] == 0) {
+			info->cleanSegments++;
+			written = 0;
+		}
+		else {
+			written = LOG_SEGMENT_BLOCKS;
+		}
+
+		info->deadBlocks += written - log->segmentLive[segment];
+	}
+
+	return LOG_INFO_SUCCESS;
+}
+
+/* Checks the mounted file system. The block census and the cross-check run over the scan
+ * pool a chunk of blocks at a time, and the block lists a chunk of inodes at a time.
+ * Following the directory trees and snapshots is left to this thread, since it is
+ * pointer chasing through blocks read one at a time.
+ */
+int tfs_fsck(FsckInfo *info) {
+	FileSystem *fileSystemPtr;
+	FsckState state;
+	int blocks, result;
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	//	bytes held back on handles may still need blocks
+	if(fileSystemPtr == NULL || info == NULL || flushAllPendingData(fileSystemPtr) < 0) {
+		return FSCK_FAILURE;
+	}
+
+	blocks = fileSystemPtr->size / BLOCKSIZE;
+
+	*info = (FsckInfo) {
+		blocks
+	};
+
+	state = (FsckState) {
+		fileSystemPtr,
+		calloc(blocks, 1),
+		calloc(blocks, 1),
+		calloc(blocks, sizeof(int)),
+		malloc(16 * sizeof(int)),
+		0,
+		16
+	};
+
+	state.info = info;
+	pthread_mutex_init(&state.lock, NULL);
+
+	if(fsckFileSystem(&state) < 0) {
+		result = FSCK_FAILURE;
+	}
+	else if(info->badBlocks || info->doubleFree || info->freeInUse || info->leakedBlocks ||
+			info->orphanInodes || info->wrongType || info->badReferences || info->refCountErrors ||
+			info->logErrors) {
+		result = FSCK_INCONSISTENT;
+	}
+	else {
+		result = FSCK_SUCCESS;
+	}
+
+	free(state.types);
+	free(state.freeListed);
+	free(state.references);
+	free(state.inodeBlocks);
+	pthread_mutex_destroy(&state.lock);
+
+	return result;
+}
+
+/* Runs the passes of tfs_fsck(), filling in state->info. Returns -1 if a block can't be
+ * read, 0 otherwise.
+ */
+int fsckFileSystem(FsckState *state) {
+	FileSystem *fileSystemPtr = state->fileSystem;
+	FsckInfo *info = state->info;
+	Snapshot *snapshotPtr;
+	BlockNode *currBlock;
+	char data[BLOCKSIZE];
+	int block, file;
+
+	//	every block's type, read a chunk at a time
+	if(scanItems(info->blocks, SCAN_CHUNK_BLOCKS, SCAN_CHUNK_BLOCKS * BLOCKSIZE, fsckTypeChunk, state) < 0) {
+		return -1;
+	}
+
+	for(currBlock = fileSystemPtr->superblock.freeBlocks; currBlock != NULL; currBlock = currBlock->next) {
+		if(currBlock->blockNum < 0 || currBlock->blockNum >= info->blocks) {
+			info->badReferences++;
+		}
+		else if(state->freeListed[currBlock->blockNum]++ > 0) {
+			info->doubleFree++;
+		}
+	}
+
+	fsckReach(state, 0, SUPERBLOCK);
+
+	if(fsckInode(state, 1, INODE) < 0) {
+		return -1;
+	}
+
+	//	a deleted snapshot's block is written back as free, so any other holds a snapshot
+	for(block = 0; block < info->blocks; block++) {
+		if(state->types[block] != SNAPSHOT || !fsckReach(state, block, SNAPSHOT)) continue;
+
+		if(readFsBlock(fileSystemPtr, block, data) < 0) {
+			return -1;
+		}
+
+		snapshotPtr = (Snapshot *)&data[2];
+
+		for(file = 0; file < snapshotPtr->fileCount; file++) {
+			if(fsckInode(state, snapshotPtr->inodeBlocks[file], SNAPSHOT_INODE) < 0) {
+				return -1;
+			}
+		}
+	}
+
+	//	a file being defragmented holds the run it is moving onto until the move is done
+	if(fileSystemPtr->defrag.inodeBlockNum >= 0) {
+		for(block = 0; block < fileSystemPtr->defrag.length; block++) {
+			fsckReach(state, fileSystemPtr->defrag.targetBlock + block, -1);
+		}
+	}
+
+	if(scanItems(state->inodeCount, FSCK_CHUNK_INODES, 0, fsckBlockListChunk, state) < 0 ||
+			scanItems(info->blocks, SCAN_CHUNK_BLOCKS, 0, fsckCrossCheckChunk, state) < 0) {
+		return -1;
+	}
+
+	if(fileSystemPtr->logStructured) {
+		info->logErrors += fsckLog(state);
+	}
+
+	return 0;
+}
+
+/* Records the type of 'count' blocks from 'first' on, read with one call */
+int fsckTypeChunk(void *arg, int first, int count, char *scratch) {
+	FsckState *state = arg;
+	char *data;
+	int block, badBlocks = 0;
+
+	if(readFsBlocks(state->fileSystem, first, count, scratch) < 0) {
+		return -1;
+	}
+
+	for(block = 0; block < count; block++) {
+		data = &scratch[block * BLOCKSIZE];
+
+		if(data[1] == MAGIC_NUMBER) {
+			state->types[first + block] = data[0];
+		}
+		//	a block discarded from the image reads back as all zeros
+		else if(data[0] != 0 || data[1] != 0) {
+			badBlocks++;
+		}
+	}
+
+	pthread_mutex_lock(&state->lock);
+	state->info->badBlocks += badBlocks;
+	pthread_mutex_unlock(&state->lock);
+
+	return 0;
+}
+
+/* Marks a metadata block as reached, checking it is of 'type' unless that is -1. Returns 1
+ * if it hadn't been reached before, 0 if it is out of range or had, so a caller only
+ * follows a block the first time.
+ */
+int fsckReach(FsckState *state, int blockNum, int type) {
+	if(blockNum < 0 || blockNum >= state->info->blocks || state->references[blockNum] > 0) {
+		state->info->badReferences++;
+
+		return 0;
+	}
+
+	state->references[blockNum]++;
+
+	if(type >= 0 && state->types[blockNum] != type) {
+		state->info->wrongType++;
+	}
+
+	return 1;
+}
+
+/* Reaches an inode of 'type' and, for a live directory, everything in its B-tree. Each
+ * inode reached is listed for its block list to be walked later.
+ */
+int fsckInode(FsckState *state, int blockNum, int type) {
+	char data[BLOCKSIZE];
+	Inode *inodePtr = (Inode *)&data[2];
+
+	if(!fsckReach(state, blockNum, type) || state->types[blockNum] != type) {
+		return 0;
+	}
+
+	if(state->inodeCount == state->inodeCapacity) {
+		state->inodeCapacity *= 2;
+		state->inodeBlocks = realloc(state->inodeBlocks, state->inodeCapacity * sizeof(int));
+	}
+
+	state->inodeBlocks[state->inodeCount++] = blockNum;
+
+	if(type != INODE) {
+		return 0;
+	}
+
+	if(readFsBlock(state->fileSystem, blockNum, data) < 0) {
+		return -1;
+	}
+
+	return inodePtr->directory && inodePtr->directoryRoot != 0 ? fsckDirectory(state, inodePtr->directoryRoot) : 0;
+}
+
+/* Reaches a directory B-tree node, the inodes of its entries and its children */
+int fsckDirectory(FsckState *state, int nodeBlockNum) {
+	DirectoryNode node;
+	int index;
+
+	if(!fsckReach(state, nodeBlockNum, DIRECTORY) || state->types[nodeBlockNum] != DIRECTORY) {
+		return 0;
+	}
+
+	if(readDirectoryNode(state->fileSystem, nodeBlockNum, &node) < 0) {
+		return -1;
+	}
+
+	if(node.count < 0 || node.count > DIRECTORY_NODE_ENTRIES) {
+		state->info->badReferences++;
+
+		return 0;
+	}
+
+	for(index = 0; index < node.count; index++) {
+		if(fsckInode(state, node.entries[index].inodeBlockNum, INODE) < 0) {
+			return -1;
+		}
+	}
+
+	//	a leaf has no children
+	for(index = 0; node.children[0] != 0 && index <= node.count; index++) {
+		if(fsckDirectory(state, node.children[index]) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* Walks the block lists of inodes [first, first + count) of the inodes reached, counting a
+ * reference for each data block. Blocks holding the file's content must be data blocks;
+ * blocks reserved past it may hold anything.
+ */
+int fsckBlockListChunk(void *arg, int first, int count, char *scratch) {
+	FsckState *state = arg;
+	CompressedExtent *extent;
+	BlockNode *currBlock;
+	Inode *inodePtr;
+	char data[BLOCKSIZE];
+	int inode, index, contentBlocks, badReferences = 0, wrongType = 0;
+
+	//	block lists are in memory, only the inode blocks are read
+	(void) scratch;
+
+	for(inode = first; inode < first + count; inode++) {
+		if(readFsBlock(state->fileSystem, state->inodeBlocks[inode], data) < 0) {
+			return -1;
+		}
+
+		inodePtr = (Inode *)&data[2];
+
+		//	compressed groups take fewer blocks than the content they hold
+		if(inodePtr->extents != NULL) {
+			for(contentBlocks = 0, extent = inodePtr->extents; extent != NULL; extent = extent->next) {
+				contentBlocks += (extent->compressedSize + BLOCKSIZE - 3) / (BLOCKSIZE - 2);
+			}
+		}
+		else {
+			contentBlocks = (inodePtr->size + BLOCKSIZE - 3) / (BLOCKSIZE - 2);
+		}
+
+		for(index = 0, currBlock = inodePtr->dataBlocks; currBlock != NULL; index++, currBlock = currBlock->next) {
+			if(currBlock->blockNum == HOLE_BLOCK) continue;
+
+			if(currBlock->blockNum < 0 || currBlock->blockNum >= state->info->blocks) {
+				badReferences++;
+				continue;
+			}
+
+			__atomic_fetch_add(&state->references[currBlock->blockNum], 1, __ATOMIC_RELAXED);
+
+			if(index < contentBlocks && state->types[currBlock->blockNum] != FILE_EXTENT) {
+				wrongType++;
+			}
+		}
+	}
+
+	pthread_mutex_lock(&state->lock);
+	state->info->badReferences += badReferences;
+	state->info->wrongType += wrongType;
+	pthread_mutex_unlock(&state->lock);
+
+	return 0;
+}
+
+/* Checks blocks [first, first + count) against the free list, the references found and
+ * the reference counts
+ */
+int fsckCrossCheckChunk(void *arg, int first, int count, char *scratch) {
+	FsckState *state = arg;
+	FileSystem *fileSystemPtr = state->fileSystem;
+	FsckInfo found = { 0 };
+	int block, references, diskBlock;
+
+	//	everything checked here is already in memory
+	(void) scratch;
+
+	for(block = first; block < first + count; block++) {
+		references = state->references[block];
+
+		if(state->freeListed[block]) {
+			found.freeBlocks++;
+
+			if(references > 0) found.freeInUse++;
+		}
+		else if(references == 0) {
+			found.leakedBlocks++;
+
+			if(state->types[block] == INODE) found.orphanInodes++;
+		}
+
+		if(references > 0) found.usedBlocks++;
+
+		//	a block in one list may keep a count of 1 from when it was shared
+		if(references > 1 ? fileSystemPtr->refCounts[block] != references : fileSystemPtr->refCounts[block] > 1) {
+			found.refCountErrors++;
+		}
+
+		//	the superblock is written in place, outside the log
+		if(fileSystemPtr->logStructured && block > 0 && (diskBlock = fileSystemPtr->log.blockMap[block]) >= 0) {
+			if(diskBlock > fileSystemPtr->log.segments * LOG_SEGMENT_BLOCKS ||
+					fileSystemPtr->log.diskBlockOwners[diskBlock] != block) {
+				found.logErrors++;
+			}
+
+			//	freeing a block drops its latest version
+			if(state->freeListed[block]) found.logErrors++;
+		}
+	}
+
+	pthread_mutex_lock(&state->lock);
+	state->info->freeBlocks += found.freeBlocks;
+	state->info->usedBlocks += found.usedBlocks;
+	state->info->freeInUse += found.freeInUse;
+	state->info->leakedBlocks += found.leakedBlocks;
+	state->info->orphanInodes += found.orphanInodes;
+	state->info->refCountErrors += found.refCountErrors;
+	state->info->logErrors += found.logErrors;
+	pthread_mutex_unlock(&state->lock);
+
+	return 0;
+}
+
+/* Checks that every disk block of the log holding a block is the one the block map finds
+ * for it, and that each segment's live count matches. Returns the errors found.
+ */
+int fsckLog(FsckState *state) {
+	LogState *log = &state->fileSystem->log;
+	int segment, diskBlock, blockNum, live, errors = 0;
+
+	for(segment = 0; segment < log->segments; segment++) {
+		live = 0;
+
+		for(diskBlock = 1 + segment * LOG_SEGMENT_BLOCKS; diskBlock < 1 + (segment + 1) * LOG_SEGMENT_BLOCKS; diskBlock++) {
+			if((blockNum = log->diskBlockOwners[diskBlock]) < 0) continue;
+
+			live++;
+
+			if(blockNum >= state->info->blocks || log->blockMap[blockNum] != diskBlock) {
+				errors++;
+			}
+		}
+
+		if(live != log->segmentLive[segment]) {
+			errors++;
+		}
+	}
+
+	return errors;
+}
+
+/* Copies 'source' to 'dest' by sharing its block list. Every shared block gains a
+ * reference, and the first write to either file copies just the blocks it touches.
+ */
+int tfs_copyFile(char *source, char *dest) {
+	FileSystem *fileSystemPtr;
+	Inode *sourcePtr, *destPtr, inode;
+	char sourceData[BLOCKSIZE], destData[BLOCKSIZE];
+	int sourceBlockNum, destBlockNum, parentBlockNum, created = 0;
+	char *destName = (char *) malloc(9);
+	char *creationTimestamp, *modificationTimestamp, *accessTimestamp;
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	//	only whole-file writes, renames and deletes can be staged by a transaction
+	if(fileSystemPtr == NULL || fileSystemPtr->transaction != NULL) {
+		return COPY_FILE_FAILURE;
+	}
+
+	if((sourceBlockNum = findFile(*fileSystemPtr, source)) < 0) {
+		return COPY_FILE_FAILURE;
+	}
+
+	if((destBlockNum = resolvePath(fileSystemPtr, dest, &parentBlockNum, destName)) == -2) {
+		return COPY_FILE_FAILURE;
+	}
+
+	if(destBlockNum == sourceBlockNum) {
+		return syncOp(fileSystemPtr, -1, COPY_FILE_SUCCESS, COPY_FILE_FAILURE);
+	}
+
+	//	appends held on the source's handles are part of what gets copied
+	if(flushFilePendingData(fileSystemPtr, sourceBlockNum) < 0) {
+		return COPY_FILE_FAILURE;
+	}
+
+	if(readFsBlock(fileSystemPtr, sourceBlockNum, sourceData) < 0) {
+		return COPY_FILE_FAILURE;
+	}
+
+	sourcePtr = (Inode *)&sourceData[2];
+
+	if(sourcePtr->directory) {
+		return COPY_FILE_FAILURE;
+	}
+
+	modificationTimestamp = (char *) malloc(30);
+	getCurrentTime(modificationTimestamp);
+
+	if(destBlockNum >= 0) {
+		if(readFsBlock(fileSystemPtr, destBlockNum, destData) < 0) {
+			return COPY_FILE_FAILURE;
+		}
+
+		destPtr = (Inode *)&destData[2];
+
+		if(destPtr->filePermission == READONLY || destPtr->directory) {
+			return COPY_FILE_FAILURE;
+		}
+
+		//	the old content goes the same way as in tfs_deleteFile()
+		dropFilePendingData(fileSystemPtr, destBlockNum);
+		releaseExtents(fileSystemPtr, destBlockNum, destPtr);
+		blockListChanged(fileSystemPtr, destPtr->dataBlocks);
+		releaseDataBlocks(fileSystemPtr, destPtr->dataBlocks);
+	}
+	else {
+		if((destBlockNum = getFreeBlock(fileSystemPtr)) < 0) {
+			return COPY_FILE_FAILURE;
+		}
+
+		creationTimestamp = (char *) malloc(30);
+		accessTimestamp = (char *) malloc(30);
+
+		getCurrentTime(creationTimestamp);
+		getCurrentTime(accessTimestamp);
+
+		inode = (Inode) {
+			destName,
+			0,
+			READWRITE,
+			NULL,
+			creationTimestamp,
+			modificationTimestamp,
+			accessTimestamp
+		};
+
+		memset(destData, 0, BLOCKSIZE);
+		memset(&destData[0], INODE, 1);
+		memset(&destData[1], MAGIC_NUMBER, 1);
+		memcpy(&destData[2], &inode, sizeof(Inode));
+
+		destPtr = (Inode *)&destData[2];
+		destPtr->parentBlockNum = parentBlockNum;
+		destPtr->generation = ++fileSystemPtr->inodeGeneration;
+		created = 1;
+	}
+
+	destPtr->dataBlocks = shareBlockList(fileSystemPtr, sourcePtr->dataBlocks);
+	destPtr->extents = copyExtents(sourcePtr->extents);
+	destPtr->size = sourcePtr->size;
+	destPtr->modificationTimestamp = modificationTimestamp;
+
+	if(writeFsBlock(fileSystemPtr, destBlockNum, destData) < 0) {
+		return COPY_FILE_FAILURE;
+	}
+
+	//	a new copy goes into its directory once its inode is on disk
+	if(created && insertEntry(fileSystemPtr, parentBlockNum, destName, destBlockNum, 0) < 0) {
+		//	the shared blocks lose the reference the copy took and the inode block goes back
+		//	the way createInode() gives it back
+		releaseDataBlocks(fileSystemPtr, destPtr->dataBlocks);
+		freeExtents(destPtr->extents);
+
+		memset(destData, 0, BLOCKSIZE);
+		memset(&destData[0], FREE, 1);
+		memset(&destData[1], MAGIC_NUMBER, 1);
+
+		writeFsBlock(fileSystemPtr, destBlockNum, destData);
+		releaseBlock(fileSystemPtr, destBlockNum);
+
+		free(destName);
+		free(creationTimestamp);
+		free(modificationTimestamp);
+		free(accessTimestamp);
+
+		return COPY_FILE_FAILURE;
+	}
+
+	return syncOp(fileSystemPtr, -1, COPY_FILE_SUCCESS, COPY_FILE_FAILURE);
+}
+
+/* Snapshots every file on the mounted file system. The files are gathered from the
+ * directory trees first, so a disk without room for the snapshot's inodes fails before
+ * any block is shared.
+ */
+int tfs_snapshot(char *name) {
+	FileSystem *fileSystemPtr;
+	Snapshot snapshot;
+	SnapshotNode *snapshotNode;
+	SnapshotFiles files = { NULL, NULL, 0, 0 };
+	BlockNode *freeBlock;
+	Inode *inodePtr;
+	char data[BLOCKSIZE];
+	int file, freeBlocks = 0, snapshotBlockNum;
+	char *snapshotName, *creationTimestamp;
+
+	if(strlen(name) > 8) {
+		return SNAPSHOT_FAILURE;
+	}
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL || findSnapshot(fileSystemPtr, name) >= 0) {
+		return SNAPSHOT_FAILURE;
+	}
+
+	//	appends held on open handles are part of the point in time
+	if(flushAllPendingData(fileSystemPtr) < 0) {
+		return SNAPSHOT_FAILURE;
+	}
+
+	//	every live file is reached from the root inode, which never has data blocks itself
+	if(readFsBlock(fileSystemPtr, 1, data) < 0) {
+		return SNAPSHOT_FAILURE;
+	}
+
+	inodePtr = (Inode *)&data[2];
+
+	if(inodePtr->directoryRoot != 0 && collectFiles(fileSystemPtr, inodePtr->directoryRoot, "", &files) < 0) {
+		freeSnapshotFiles(&files, 0);
+
+		return SNAPSHOT_FAILURE;
+	}
+
+	//	only as much of the free list is counted as the snapshot needs
+	for(freeBlock = fileSystemPtr->superblock.freeBlocks; freeBlock != NULL && freeBlocks <= files.count;
+			freeBlock = freeBlock->next) {
+		freeBlocks++;
+	}
+
+	if(freeBlocks < files.count + 1) {
+		freeSnapshotFiles(&files, 0);
+
+		return SNAPSHOT_FAILURE;
+	}
+
+	snapshotName = (char *) malloc(9);
+	strcpy(snapshotName, name);
+
+	creationTimestamp = (char *) malloc(30);
+	getCurrentTime(creationTimestamp);
+
+	snapshot = (Snapshot) {
+		snapshotName,
+		creationTimestamp,
+		0,
+		malloc(sizeof(int) * (files.count + 1))
+	};
+
+	snapshotBlockNum = getFreeBlock(fileSystemPtr);
+
+	for(file = 0; file < files.count; file++) {
+		if(freezeInode(fileSystemPtr, &snapshot, files.inodeBlocks[file], files.paths[file]) < 0) break;
+	}
+
+	//	the paths of the files frozen now name their frozen inodes
+	freeSnapshotFiles(&files, file < files.count ? file + 1 : file);
+
+	memset(data, 0, BLOCKSIZE);
+	memset(&data[0], SNAPSHOT, 1);
+	memset(&data[1], MAGIC_NUMBER, 1);
+	memcpy(&data[2], &snapshot, sizeof(Snapshot));
+
+	//	a snapshot that can't be finished gives back everything taken for it
+	if(file < files.count || writeFsBlock(fileSystemPtr, snapshotBlockNum, data) < 0) {
+		releaseSnapshotInodes(fileSystemPtr, &snapshot);
+		releaseBlock(fileSystemPtr, snapshotBlockNum);
+
+		free(snapshot.inodeBlocks);
+		free(snapshotName);
+		free(creationTimestamp);
+
+		return SNAPSHOT_FAILURE;
+	}
+
+	snapshotNode = malloc(sizeof(SnapshotNode));
+	*snapshotNode = (SnapshotNode) {
+		snapshotName,
+		snapshotBlockNum,
+		fileSystemPtr->snapshots
+	};
+
+	fileSystemPtr->snapshots = snapshotNode;
+
+	return syncOp(fileSystemPtr, -1, SNAPSHOT_SUCCESS, SNAPSHOT_FAILURE);
+}
+
+/* Adds a frozen copy of the live inode at inodeBlockNum to 'snapshotPtr', named by its
+ * full path 'path' since its directory may be renamed, and with a block list holding the
+ * same blocks. On failure nothing taken for it is left behind and 'path' is freed.
+ */
+int freezeInode(FileSystem *fileSystemPtr, Snapshot *snapshotPtr, int inodeBlockNum, char *path) {
+	char data[BLOCKSIZE];
+	Inode *inodePtr = (Inode *)&data[2];
+	int frozenBlockNum;
+
+	if(readFsBlock(fileSystemPtr, inodeBlockNum, data) < 0 || (frozenBlockNum = getFreeBlock(fileSystemPtr)) < 0) {
+		free(path);
+		return -1;
+	}
+
+	inodePtr->name = path;
+	inodePtr->filePermission = READONLY;
+	inodePtr->dataBlocks = shareBlockList(fileSystemPtr, inodePtr->dataBlocks);
+	inodePtr->extents = copyExtents(inodePtr->extents);
+
+	memset(&data[0], SNAPSHOT_INODE, 1);
+
+	if(writeFsBlock(fileSystemPtr, frozenBlockNum, data) < 0) {
+		releaseDataBlocks(fileSystemPtr, inodePtr->dataBlocks);
+		freeExtents(inodePtr->extents);
+		releaseBlock(fileSystemPtr, frozenBlockNum);
+		free(path);
+
+		return -1;
+	}
+
+	snapshotPtr->inodeBlocks[snapshotPtr->fileCount++] = frozenBlockNum;
+
+	return 0;
+}
+
+/* Gives back a snapshot's frozen inodes. Each drops its reference on the blocks it shares
+ * with the live files, so only blocks the snapshot alone held are freed, and its block
+ * goes back on the free list. Returns -1 if a frozen inode can't be read.
+ */
+int releaseSnapshotInodes(FileSystem *fileSystemPtr, Snapshot *snapshotPtr) {
+	char data[BLOCKSIZE];
+	Inode *inodePtr = (Inode *)&data[2];
+	int file;
+
+	for(file = 0; file < snapshotPtr->fileCount; file++) {
+		if(readFsBlock(fileSystemPtr, snapshotPtr->inodeBlocks[file], data) < 0) {
+			return -1;
+		}
+
+		releaseDataBlocks(fileSystemPtr, inodePtr->dataBlocks);
+		freeExtents(inodePtr->extents);
+		free(inodePtr->name);
+		releaseBlock(fileSystemPtr, snapshotPtr->inodeBlocks[file]);
+	}
+
+	return 0;
+}
+
+/* Frees the paths of files [first, count) of 'files' and the lists holding them. Paths
+ * before 'first' already belong to frozen inodes.
+ */
+void freeSnapshotFiles(SnapshotFiles *files, int first) {
+	for(; first < files->count; first++) free(files->paths[first]);
+
+	free(files->inodeBlocks);
+	free(files->paths);
+}
+
+/* Opens file 'name' as it was when snapshot 'snapshotName' was taken. Names follow the
+ * same rules as tfs_openFile(): no path component may be longer than 8 characters.
+ */
+fileDescriptor tfs_openSnapshotFile(char *snapshotName, char *name) {
+	FileSystem *fileSystemPtr;
+	DynamicResource dynamicResource;
+	Snapshot *snapshotPtr;
+	Inode *inodePtr;
+	char snapshotData[BLOCKSIZE], inodeData[BLOCKSIZE];
+	int snapshotBlockNum, file, FD;
+	char *permName, *path, *component;
+
+	if(strlen(snapshotName) > 8) {
+		return OPEN_SNAPSHOT_FILE_FAILURE;
+	}
+
+	for(component = name; *component != '\0'; component += strcspn(component, "/")) {
+		while(*component == '/') component++;
+
+		if(strcspn(component, "/") > 8) {
+			return OPEN_SNAPSHOT_FILE_FAILURE;
+		}
+	}
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL) {
+		return OPEN_SNAPSHOT_FILE_FAILURE;
+	}
+
+	if((snapshotBlockNum = findSnapshot(fileSystemPtr, snapshotName)) < 0) {
+		return OPEN_SNAPSHOT_FILE_FAILURE;
+	}
+
+	if(readFsBlock(fileSystemPtr, snapshotBlockNum, snapshotData) < 0) {
+		return OPEN_SNAPSHOT_FILE_FAILURE;
+	}
+
+	snapshotPtr = (Snapshot *)&snapshotData[2];
+
+	//	frozen inodes are named by the path the file had when the snapshot was taken
+	path = (char *) malloc(strlen(name) + 2);
+	canonicalPath(name, path);
+
+	for(file = 0; file < snapshotPtr->fileCount; file++) {
+		if(readFsBlock(fileSystemPtr, snapshotPtr->inodeBlocks[file], inodeData) < 0) {
+			free(path);
+			return OPEN_SNAPSHOT_FILE_FAILURE;
+		}
+
+		inodePtr = (Inode *)&inodeData[2];
+
+		if(strcmp(inodePtr->name, path) == 0) break;
+	}
+
+	free(path);
+
+	if(file == snapshotPtr->fileCount) {
+		return OPEN_SNAPSHOT_FILE_FAILURE;
+	}
+
+	permName = (char *) malloc(strlen(name) + 1);
+	strcpy(permName, name);
+
+	FD = fileSystemPtr->openCount++;
+
+	//	the frozen inode is read-only, so every write through the handle is refused
+	dynamicResource = (DynamicResource) {
+		permName,
+		0,
+		FD,
+		snapshotPtr->inodeBlocks[file]
+	};
+
+	if(addDynamicResource(fileSystemPtr, dynamicResource) < 0) {
+		return OPEN_SNAPSHOT_FILE_FAILURE;
+	}
+
+	return FD;
+}
+
+/* Deletes snapshot 'name'. Its frozen inodes drop their reference on every block they
+ * share with the live files, so only the blocks the snapshot alone held are freed.
+ */
+int tfs_deleteSnapshot(char *name) {
+	FileSystem *fileSystemPtr;
+	DynamicResourceNode *curr;
+	SnapshotNode **link, *snapshotNode;
+	Snapshot *snapshotPtr;
+	char snapshotData[BLOCKSIZE];
+	int snapshotBlockNum, file;
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL) {
+		return DELETE_SNAPSHOT_FAILURE;
+	}
+
+	if((snapshotBlockNum = findSnapshot(fileSystemPtr, name)) < 0) {
+		return DELETE_SNAPSHOT_FAILURE;
+	}
+
+	if(readFsBlock(fileSystemPtr, snapshotBlockNum, snapshotData) < 0) {
+		return DELETE_SNAPSHOT_FAILURE;
+	}
+
+	snapshotPtr = (Snapshot *)&snapshotData[2];
+
+	for(curr = fileSystemPtr->dynamicResourceTable; curr != NULL; curr = curr->next) {
+		for(file = 0; file < snapshotPtr->fileCount; file++) {
+			if(curr->dynamicResource->inodeBlockNum == snapshotPtr->inodeBlocks[file]) {
+				return DELETE_SNAPSHOT_FAILURE;
+			}
+		}
+	}
+
+	if(releaseSnapshotInodes(fileSystemPtr, snapshotPtr) < 0) {
+		return DELETE_SNAPSHOT_FAILURE;
+	}
+
+	//	the snapshot goes off the list before its name is freed
+	for(link = &fileSystemPtr->snapshots; (*link)->blockNum != snapshotBlockNum; link = &(*link)->next);
+
+	snapshotNode = *link;
+	*link = snapshotNode->next;
+	free(snapshotNode);
+
+	free(snapshotPtr->inodeBlocks);
+	free(snapshotPtr->name);
+	free(snapshotPtr->creationTimestamp);
+
+	//	the snapshot block is the only one tfs_fsck() finds by scanning, so it alone is
+	//	marked free
+	memset(snapshotData, 0, BLOCKSIZE);
+	memset(&snapshotData[0], FREE, 1);
+	memset(&snapshotData[1], MAGIC_NUMBER, 1);
+
+	if(writeFsBlock(fileSystemPtr, snapshotBlockNum, snapshotData) < 0) {
+		return DELETE_SNAPSHOT_FAILURE;
+	}
+
+	releaseBlock(fileSystemPtr, snapshotBlockNum);
+
+	return syncOp(fileSystemPtr, -1, DELETE_SNAPSHOT_SUCCESS, DELETE_SNAPSHOT_FAILURE);
+}
+
+
+int tfs_readFileInfo(fileDescriptor FD) {
+	int result;
+	FileSystem *fileSystemPtr;
+	DynamicResource *dynamicResourcePtr;
+	Inode *inodePtr;
+    char buf[BLOCKSIZE];
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL) {
+		return READ_FILE_INFO_FAILURE;
+	}
+
+	dynamicResourcePtr = findResource(fileSystemPtr->dynamicResourceTable, FD);
+
+	if (dynamicResourcePtr == NULL) {
+		return SEEK_FILE_FAILURE;
+	}
+	if (flushFilePendingData(fileSystemPtr, dynamicResourcePtr->inodeBlockNum) < 0 ||
+			readFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, buf) < 0) {
+		return SEEK_FILE_FAILURE;
+	}
+
+	inodePtr = (Inode *)&buf[2];
+
+	printf("File info for %s:\n", inodePtr->name);
+	printf("Creation time: %s", inodePtr->creationTimestamp);
+	printf("Modification time: %s", inodePtr->modificationTimestamp);
+	printf("Access time: %s", inodePtr->accessTimestamp);
+
+	return 1;
+}
+
+/* File listing and renaming */
+
+/* renames a file or directory.  New path should be passed in, and may be in another
+ * directory, which must already exist.  A directory can't be moved under itself. */
+int tfs_rename(char *oldName, char *newName) {
+	FileSystem *fileSystemPtr;
+	int inodeBlockNum, oldParentBlockNum, newParentBlockNum, blockNum;
+	char oldLeaf[9], newLeaf[9], data[BLOCKSIZE];
+	Inode *inodePtr;
+
+	fileSystemPtr = findFileSystem(mountedFsName);
+
+	if(fileSystemPtr == NULL) {
+		return RENAME_FILE_FAILURE;
+	}
+
+	//	inside a transaction the names are checked against the renames staged before it
+	if(fileSystemPtr->transaction != NULL) {
+		StagedOp op = { TXN_RENAME, -1, NULL, 0, malloc(strlen(oldName) + 1), malloc(strlen(newName) + 1) };
+
+		if(checkStagedRename(fileSystemPtr, NULL, oldName, newName) < 0) {
+			free(op.oldName);
+			free(op.newName);
+
+			return RENAME_FILE_FAILURE;
+		}
+
+		strcpy(op.oldName, oldName);
+		strcpy(op.newName, newName);
+
+		return stageOp(fileSystemPtr, op) < 0 ? RENAME_FILE_FAILURE : RENAME_FILE_SUCCESS;
+	}
+
+	inodeBlockNum = resolvePath(fileSystemPtr, oldName, &oldParentBlockNum, oldLeaf);
+
+	//	the root can't be renamed, and the new name must be free
+	if(inodeBlockNum <= 1 || resolvePath(fileSystemPtr, newName, &newParentBlockNum, newLeaf) != -1) {
+		return RENAME_FILE_FAILURE;
+	}
+
+	for(blockNum = newParentBlockNum; blockNum > 1; blockNum = inodePtr->parentBlockNum) {
+		if(blockNum == inodeBlockNum || readFsBlock(fileSystemPtr, blockNum, data) < 0) {
+			return RENAME_FILE_FAILURE;
+		}
+
+		inodePtr = (Inode *)&data[2];
+	}
+
+	if(readFsBlock(fileSystemPtr, inodeBlockNum, data) < 0) {
+		return RENAME_FILE_FAILURE;
+	}
+
+	inodePtr = (Inode *)&data[2];
+
+	//	the new entry goes in first so a failure never leaves the file without a name
+	if(insertEntry(fileSystemPtr, newParentBlockNum, newLeaf, inodeBlockNum, inodePtr->directory) < 0) {
+		return RENAME_FILE_FAILURE;
+	}
+
+	if(removeEntry(fileSystemPtr, oldParentBlockNum, oldLeaf) < 0) {
+		removeEntry(fileSystemPtr, newParentBlockNum, newLeaf);
+
+		return RENAME_FILE_FAILURE;
+	}
+
+	if(renameInode(fileSystemPtr, inodeBlockNum, newLeaf, newParentBlockNum) < 0) {
+		return RENAME_FILE_FAILURE;
+	}
+
+	return syncOp(fileSystemPtr, -1, renameDynamicResource(fileSystemPtr, inodeBlockNum, newName), RENAME_FILE_FAILURE);
+}
+
+/* lists the files and directories in the root directory in name order, directories
+ * with a trailing '/' */
+int tfs_readdir() {
+	DirEntry entries[16];
+	dirDescriptor DD;
+	int entry, filled;
+
+	if((DD = tfs_opendir("/", NULL, 0)) < 0) {
+		return READ_DIR_FAILURE;
+	}
+
+	printf("/\n");
+
+	while((filled = tfs_readdir_r(DD, entries, 16)) > 0) {
+		for(entry = 0; entry < filled; entry++) {
+			printf("%s%s\n", entries[entry].name, entries[entry].directory ? "/" : "");
+		}
+	}
+
+	tfs_closedir(DD);
+
+	if(filled < 0) {
+		return READ_DIR_FAILURE;
+	}
+
+	return 1;
+}
+
+/* Writes every block of a new disk as a free block. The disk is split into chunks of
+ * SCAN_CHUNK_BLOCKS, each written with one call by whichever scan worker takes it.
+ */
+int setMagicNumbers(fileDescriptor diskNum, int blocks) {
+	return scanItems(blocks, SCAN_CHUNK_BLOCKS, SCAN_CHUNK_BLOCKS * BLOCKSIZE, formatChunk, &diskNum);
+}
+
+/* Writes 'count' free blocks from 'first' on for setMagicNumbers() */
+int formatChunk(void *arg, int first, int count, char *scratch) {
+	int block;
+
+	memset(scratch, 0, count * BLOCKSIZE);
+
+	for(block = 0; block < count; block++) {
+		//	set first byte of each block to free block code and second to magic number
+		memset(&scratch[block * BLOCKSIZE], FREE, 1);
+		memset(&scratch[block * BLOCKSIZE + 1], MAGIC_NUMBER, 1);
+	}
+
+	return writeBlocks(*(fileDescriptor *)arg, first, count, scratch);
+}
+
+int writeSuperBlock(fileDescriptor diskNum, SuperBlock superblock) {
+	char data[BLOCKSIZE] = { 0 };
+	
+	//	set first byte of data to superblock block code
+	memset(&data[0], SUPERBLOCK, 1);
+
+	//	set second byte of data to magic number
+	memset(&data[1], MAGIC_NUMBER, 1);
+
+	//	copy over superblock data
+	memcpy(&data[2], &(superblock), sizeof(superblock));
+
+	return writeBlock(diskNum, 0, data);
+}
+
+int writeRootInode(fileDescriptor diskNum, Inode rootInode) {
+	char data[BLOCKSIZE] = { 0 };
+	
+	//	set first byte of data to inode block code
+	memset(&data[0], INODE, 1);
+
+	//	set second byte of data to magic number
+	memset(&data[1], MAGIC_NUMBER, 1);
+
+	//	copy over inode data
+	memcpy(&data[2], &(rootInode), sizeof(rootInode));
+
+	//	write root inode and return status
+	return writeBlock(diskNum, 1, data);
+}
+
+/* Builds the free list of a new file system out of blockNodePool, whose nodes all come
+ * from one slab
+ */
+BlockNode *setupFreeBlockList(Pool *blockNodePool, int freeBlockCount) {
+	int block;
+
+	BlockNode *curr, *head;
+
+	poolReserve(blockNodePool, freeBlockCount);
+	head = poolAlloc(blockNodePool);
+
+	//	first two blocks are used for superblock and root inode, so start at 2
+	head->blockNum = 2;
+	head->next = NULL;
+
+	curr = head;
+
+	for(block = 3; block < freeBlockCount + 2; block++) {
+		curr->next = poolAlloc(blockNodePool);
+		curr->next->blockNum = block;
+		curr->next->next = NULL;
+
+		curr = curr->next;
+	}
+
+	return head;
+}
+
+void addFileSystem(FileSystem fileSystem) {
+	FileSystemNode *curr;
+
+	FileSystem *fileSystemPtr = poolAlloc(&fileSystemPool);
+	memcpy(fileSystemPtr, &fileSystem, sizeof(FileSystem));
+	
+	//	create head if it is null
+	if(fsHead == NULL) {
+		fsHead = poolAlloc(&fileSystemNodePool);
+		*fsHead = (FileSystemNode) {
+			fileSystemPtr,
+			NULL
+		};
+	}
+	else {
+		curr = fsHead;
+		
+		while(curr->next != NULL) curr = curr->next;
+				
+		curr->next = poolAlloc(&fileSystemNodePool);
+		*(curr->next) = (FileSystemNode) {
+			fileSystemPtr,
+			NULL
+		};
+	}
+}
+
+FileSystem *findFileSystem(char *filename) {
+	FileSystemNode *curr = fsHead;
+	if(curr == NULL) {
+		return NULL;
+	}
+	
+	else {
+		if(strcmp(curr->fileSystem->filename, filename) == 0) return curr->fileSystem;
+		
+		while(curr->next != NULL) {
+			curr = curr->next;
+
+			if(strcmp(curr->fileSystem->filename, filename) == 0) return curr->fileSystem;
+		}
+		
+		return NULL;
+	}
+}
+
+/* Checks that every block of a file system carries the magic number. The blocks are read
+ * SCAN_CHUNK_BLOCKS at a time by a pool of scan workers, and the first bad block stops
+ * them all.
+ */
+int verifyFileSystem(FileSystem fileSystem) {
+	int result;
+
+	if((result = scanItems(fileSystem.size / BLOCKSIZE, SCAN_CHUNK_BLOCKS, SCAN_CHUNK_BLOCKS * BLOCKSIZE,
+			verifyChunk, &fileSystem)) < 0) {
+		return result;
+	}
+
+	return 1;
+}
+
+/* Checks 'count' blocks from 'first' on for verifyFileSystem(), reading them in one go */
+int verifyChunk(void *arg, int first, int count, char *scratch) {
+	char *data;
+	int block, result;
+
+	if((result = readFsBlocks(arg, first, count, scratch)) < 0) {
+		return result;		//	means error reading block
+	}
+
+	for(block = 0; block < count; block++) {
+		data = &scratch[block * BLOCKSIZE];
+
+		//	a block discarded from the image reads back as all zeros
+		if(data[1] != MAGIC_NUMBER && (data[0] != 0 || data[1] != 0)) {
+			return FS_VERIFY_FAILURE;
+		}
+	}
+
+	return 0;
+}
+
+int findFile(FileSystem fileSystem, char *filename) {
+	int parentBlockNum, inodeBlockNum;
+	char name[9];
+
+	if((inodeBlockNum = resolvePath(&fileSystem, filename, &parentBlockNum, name)) < 0) {
+		return -1;
+	}
+
+	return inodeBlockNum;
+}
+
+/* Walks 'path' down from the root directory, one directory lookup per component. Sets
+ * *parentBlockNumPtr to the inode block of the directory the last component is in and
+ * copies that component into 'name'. Returns the inode block the path names, -1 if only
+ * its last component is missing, or -2 if the path can't name anything: a directory on
+ * the way is missing or isn't a directory, or a component is longer than 8 characters.
+ */
+int resolvePath(FileSystem *fileSystemPtr, char *path, int *parentBlockNumPtr, char *name) {
+	int blockNum = 1, length;
+	char *end;
+
+	*parentBlockNumPtr = 1;
+	strcpy(name, "/");
+
+	while(*path == '/') path++;
+
+	while(*path != '\0') {
+		if((end = strchr(path, '/')) == NULL) end = path + strlen(path);
+
+		if((length = end - path) > 8 || blockNum < 0) {
+			return -2;
+		}
+
+		memcpy(name, path, length);
+		name[length] = '\0';
+
+		*parentBlockNumPtr = blockNum;
+
+		if((blockNum = lookupEntry(fileSystemPtr, blockNum, name)) == -2) {
+			return -2;
+		}
+
+		for(path = end; *path == '/'; path++);
+	}
+
+	return blockNum;
+}
+
+/* Finds 'name' in a directory, going to the dentry cache first and the directory's B-tree
+ * after. Returns its inode block, -1 if it isn't there, or -2 if the directory isn't one
+ * or can't be read.
+ */
+int lookupEntry(FileSystem *fileSystemPtr, int directoryBlockNum, char *name) {
+	Dentry *slot = findDentrySlot(fileSystemPtr, directoryBlockNum, name);
+	DirectoryNode node;
+	char data[BLOCKSIZE];
+	Inode *inodePtr;
+	int blockNum, index;
+
+	if(slot->parentBlockNum == directoryBlockNum && strcmp(slot->name, name) == 0) {
+		return slot->inodeBlockNum;
+	}
+
+	if(readFsBlock(fileSystemPtr, directoryBlockNum, data) < 0) {
+		return -2;
+	}
+
+	inodePtr = (Inode *)&data[2];
+
+	if(!inodePtr->directory) {
+		return -2;
+	}
+
+	//	a leaf's children are all 0, which ends the walk
+	for(blockNum = inodePtr->directoryRoot; blockNum != 0; blockNum = node.children[index]) {
+		if(readDirectoryNode(fileSystemPtr, blockNum, &node) < 0) {
+			return -2;
+		}
+
+		index = findEntryIndex(&node, name);
+
+		if(index < node.count && strcmp(node.entries[index].name, name) == 0) {
+			cacheDentry(fileSystemPtr, directoryBlockNum, name, node.entries[index].inodeBlockNum);
+
+			return node.entries[index].inodeBlockNum;
+		}
+	}
+
+	return -1;
+}
+
+/* Adds 'name' to a directory's B-tree. Full nodes are split on the way down, so there is
+ * always room in the parent for the entry a split moves up; when the root is full the
+ * tree grows a level and the directory's inode gets the new root. Returns -1 on failure.
+ */
+int insertEntry(FileSystem *fileSystemPtr, int directoryBlockNum, char *name, int inodeBlockNum, int directory) {
+	DirectoryNode root, newRoot;
+	DirectoryEntry entry;
+	char data[BLOCKSIZE];
+	Inode *inodePtr;
+	int rootBlockNum, newRootBlockNum;
+
+	memset(&entry, 0, sizeof(DirectoryEntry));
+	strcpy(entry.name, name);
+	entry.directory = directory;
+	entry.inodeBlockNum = inodeBlockNum;
+
+	if(readFsBlock(fileSystemPtr, directoryBlockNum, data) < 0) {
+		return -1;
+	}
+
+	inodePtr = (Inode *)&data[2];
+
+	if((rootBlockNum = inodePtr->directoryRoot) == 0) {
+		if((rootBlockNum = getFreeBlock(fileSystemPtr)) < 0) {
+			return -1;
+		}
+
+		memset(&root, 0, sizeof(DirectoryNode));
+		root.count = 1;
+		root.entries[0] = entry;
+
+		if(writeDirectoryNode(fileSystemPtr, rootBlockNum, &root) < 0) {
+			return -1;
+		}
+
+		inodePtr->directoryRoot = rootBlockNum;
+
+		if(writeFsBlock(fileSystemPtr, directoryBlockNum, data) < 0) {
+			return -1;
+		}
+	}
+	else {
+		if(readDirectoryNode(fileSystemPtr, rootBlockNum, &root) < 0) {
+			return -1;
+		}
+
+		if(root.count == DIRECTORY_NODE_ENTRIES) {
+			if((newRootBlockNum = getFreeBlock(fileSystemPtr)) < 0) {
+				return -1;
+			}
+
+			memset(&newRoot, 0, sizeof(DirectoryNode));
+			newRoot.children[0] = rootBlockNum;
+
+			if(splitDirectoryNode(fileSystemPtr, newRootBlockNum, &newRoot, 0, &root) < 0) {
+				return -1;
+			}
+
+			inodePtr->directoryRoot = newRootBlockNum;
+
+			if(writeFsBlock(fileSystemPtr, directoryBlockNum, data) < 0) {
+				return -1;
+			}
+
+			rootBlockNum = newRootBlockNum;
+			root = newRoot;
+		}
+
+		if(insertIntoNode(fileSystemPtr, rootBlockNum, &root, &entry) < 0) {
+			return -1;
+		}
+	}
+
+	cacheDentry(fileSystemPtr, directoryBlockNum, name, inodeBlockNum);
+
+	return 0;
+}
+
+/* Takes 'name' out of a directory's B-tree. Nodes on the way down are topped up to more
+ * than the minimum first, so the entry can come out of a leaf without a node underflowing;
+ * a root left with no entries is dropped and the tree loses a level. Returns -1 if the
+ * name isn't there or on failure.
+ */
+int removeEntry(FileSystem *fileSystemPtr, int directoryBlockNum, char *name) {
+	DirectoryNode root;
+	char data[BLOCKSIZE];
+	Inode *inodePtr;
+	int rootBlockNum;
+
+	forgetDentry(fileSystemPtr, directoryBlockNum, name);
+
+	if(readFsBlock(fileSystemPtr, directoryBlockNum, data) < 0) {
+		return -1;
+	}
+
+	inodePtr = (Inode *)&data[2];
+
+	if((rootBlockNum = inodePtr->directoryRoot) == 0) {
+		return -1;
+	}
+
+	if(readDirectoryNode(fileSystemPtr, rootBlockNum, &root) < 0 ||
+			deleteFromNode(fileSystemPtr, rootBlockNum, &root, name) < 0) {
+		return -1;
+	}
+
+	if(root.count == 0) {
+		inodePtr->directoryRoot = root.children[0];
+		releaseBlock(fileSystemPtr, rootBlockNum);
+
+		if(writeFsBlock(fileSystemPtr, directoryBlockNum, data) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int readDirectoryNode(FileSystem *fileSystemPtr, int blockNum, DirectoryNode *node) {
+	char data[BLOCKSIZE];
+
+	if(readFsBlock(fileSystemPtr, blockNum, data) < 0) {
+		return -1;
+	}
+
+	memcpy(node, &data[2], sizeof(DirectoryNode));
+
+	return 0;
+}
+
+int writeDirectoryNode(FileSystem *fileSystemPtr, int blockNum, DirectoryNode *node) {
+	char data[BLOCKSIZE];
+
+	memset(data, 0, BLOCKSIZE);
+	memset(&data[0], DIRECTORY, 1);
+	memset(&data[1], MAGIC_NUMBER, 1);
+	memcpy(&data[2], node, sizeof(DirectoryNode));
+
+	return writeFsBlock(fileSystemPtr, blockNum, data);
+}
+
+/* returns the index of the first entry of a node that doesn't sort before 'name' */
+int findEntryIndex(DirectoryNode *node, char *name) {
+	int index = 0;
+
+	while(index < node->count && strcmp(node->entries[index].name, name) < 0) index++;
+
+	return index;
+}
+
+/* Splits the full child at 'index' of a node in two, moving its middle entry up into the
+ * node, which must have room for it. Writes all three nodes.
+ */
+int splitDirectoryNode(FileSystem *fileSystemPtr, int parentBlockNum, DirectoryNode *parent, int index, DirectoryNode *child) {
+	DirectoryNode sibling;
+	int siblingBlockNum;
+
+	if((siblingBlockNum = getFreeBlock(fileSystemPtr)) < 0) {
+		return -1;
+	}
+
+	memset(&sibling, 0, sizeof(DirectoryNode));
+	sibling.count = DIRECTORY_DEGREE - 1;
+	memcpy(sibling.entries, &child->entries[DIRECTORY_DEGREE], (DIRECTORY_DEGREE - 1) * sizeof(DirectoryEntry));
+	memcpy(sibling.children, &child->children[DIRECTORY_DEGREE], DIRECTORY_DEGREE * sizeof(int));
+
+	memmove(&parent->entries[index + 1], &parent->entries[index], (parent->count - index) * sizeof(DirectoryEntry));
+	memmove(&parent->children[index + 2], &parent->children[index + 1], (parent->count - index) * sizeof(int));
+
+	parent->entries[index] = child->entries[DIRECTORY_DEGREE - 1];
+	parent->children[index + 1] = siblingBlockNum;
+	parent->count++;
+
+	child->count = DIRECTORY_DEGREE - 1;
+	memset(&child->entries[DIRECTORY_DEGREE - 1], 0, DIRECTORY_DEGREE * sizeof(DirectoryEntry));
+	memset(&child->children[DIRECTORY_DEGREE], 0, DIRECTORY_DEGREE * sizeof(int));
+
+	if(writeDirectoryNode(fileSystemPtr, parent->children[index], child) < 0 ||
+			writeDirectoryNode(fileSystemPtr, siblingBlockNum, &sibling) < 0) {
+		return -1;
+	}
+
+	return writeDirectoryNode(fileSystemPtr, parentBlockNum, parent);
+}
+
+/* Merges the children either side of entry 'index' of a node into the left one, along with
+ * the entry, and frees the right one. Both children must hold the minimum number of
+ * entries. Writes the node and the merged child.
+ */
+int mergeDirectoryNodes(FileSystem *fileSystemPtr, int parentBlockNum, DirectoryNode *parent, int index, DirectoryNode *left, DirectoryNode *right) {
+	int rightBlockNum = parent->children[index + 1];
+
+	left->entries[left->count] = parent->entries[index];
+	memcpy(&left->entries[left->count + 1], right->entries, right->count * sizeof(DirectoryEntry));
+	memcpy(&left->children[left->count + 1], right->children, (right->count + 1) * sizeof(int));
+	left->count += 1 + right->count;
+
+	memmove(&parent->entries[index], &parent->entries[index + 1], (parent->count - index - 1) * sizeof(DirectoryEntry));
+	memmove(&parent->children[index + 1], &parent->children[index + 2], (parent->count - index - 1) * sizeof(int));
+	parent->count--;
+
+	memset(&parent->entries[parent->count], 0, sizeof(DirectoryEntry));
+	parent->children[parent->count + 1] = 0;
+
+	releaseBlock(fileSystemPtr, rightBlockNum);
+
+	if(writeDirectoryNode(fileSystemPtr, parent->children[index], left) < 0) {
+		return -1;
+	}
+
+	return writeDirectoryNode(fileSystemPtr, parentBlockNum, parent);
+}
+
+/* Inserts an entry below a node that isn't full, splitting any full child before stepping
+ * down into it.
+ */
+int insertIntoNode(FileSystem *fileSystemPtr, int blockNum, DirectoryNode *node, DirectoryEntry *entry) {
+	DirectoryNode child;
+	int index;
+
+	while(node->children[0] != 0) {
+		index = findEntryIndex(node, entry->name);
+
+		if(readDirectoryNode(fileSystemPtr, node->children[index], &child) < 0) {
+			return -1;
+		}
+
+		if(child.count == DIRECTORY_NODE_ENTRIES) {
+			if(splitDirectoryNode(fileSystemPtr, blockNum, node, index, &child) < 0) {
+				return -1;
+			}
+
+			//	the entry goes into whichever half it sorts into
+			if(strcmp(entry->name, node->entries[index].name) > 0) {
+				index++;
+
+				if(readDirectoryNode(fileSystemPtr, node->children[index], &child) < 0) {
+					return -1;
+				}
+			}
+		}
+
+		blockNum = node->children[index];
+		*node = child;
+	}
+
+	index = findEntryIndex(node, entry->name);
+
+	memmove(&node->entries[index + 1], &node->entries[index], (node->count - index) * sizeof(DirectoryEntry));
+	node->entries[index] = *entry;
+	node->count++;
+
+	return writeDirectoryNode(fileSystemPtr, blockNum, node);
+}
+
+/* Deletes 'name' from the subtree under a node holding more than the minimum number of
+ * entries (or the root). Before stepping down into a child holding only the minimum, the
+ * child borrows an entry from a sibling through the node or is merged with one, so no
+ * node underflows on the way back. Returns -1 if the name isn't there or on failure.
+ */
+int deleteFromNode(FileSystem *fileSystemPtr, int blockNum, DirectoryNode *node, char *name) {
+	DirectoryNode child, left, right;
+	DirectoryEntry replacement;
+	int index = findEntryIndex(node, name);
+
+	if(index < node->count && strcmp(node->entries[index].name, name) == 0) {
+		if(node->children[0] == 0) {
+			memmove(&node->entries[index], &node->entries[index + 1], (node->count - index - 1) * sizeof(DirectoryEntry));
+			node->count--;
+			memset(&node->entries[node->count], 0, sizeof(DirectoryEntry));
+
+			return writeDirectoryNode(fileSystemPtr, blockNum, node);
+		}
+
+		if(readDirectoryNode(fileSystemPtr, node->children[index], &left) < 0 ||
+				readDirectoryNode(fileSystemPtr, node->children[index + 1], &right) < 0) {
+			return -1;
+		}
+
+		//	an inner entry is replaced by its neighbour from a child that can spare one
+		if(left.count >= DIRECTORY_DEGREE || right.count >= DIRECTORY_DEGREE) {
+			if(findEdgeEntry(fileSystemPtr, node->children[left.count >= DIRECTORY_DEGREE ? index : index + 1],
+					left.count >= DIRECTORY_DEGREE, &replacement) < 0) {
+				return -1;
+			}
+
+			node->entries[index] = replacement;
+
+			if(writeDirectoryNode(fileSystemPtr, blockNum, node) < 0) {
+				return -1;
+			}
+
+			if(left.count >= DIRECTORY_DEGREE) {
+				return deleteFromNode(fileSystemPtr, node->children[index], &left, replacement.name);
+			}
+
+			return deleteFromNode(fileSystemPtr, node->children[index + 1], &right, replacement.name);
+		}
+
+		//	otherwise the entry is merged down between the two children and deleted from there
+		if(mergeDirectoryNodes(fileSystemPtr, blockNum, node, index, &left, &right) < 0) {
+			return -1;
+		}
+
+		return deleteFromNode(fileSystemPtr, node->children[index], &left, name);
+	}
+
+	if(node->children[0] == 0) {
+		return -1;
+	}
+
+	if(readDirectoryNode(fileSystemPtr, node->children[index], &child) < 0) {
+		return -1;
+	}
+
+	if(child.count == DIRECTORY_DEGREE - 1) {
+		if(index > 0 && readDirectoryNode(fileSystemPtr, node->children[index - 1], &left) < 0) {
+			return -1;
+		}
+
+		if(index < node->count && readDirectoryNode(fileSystemPtr, node->children[index + 1], &right) < 0) {
+			return -1;
+		}
+
+		if(index > 0 && left.count >= DIRECTORY_DEGREE) {
+			//	the entry before the child comes down into it and the left sibling's last goes up
+			memmove(&child.entries[1], &child.entries[0], child.count * sizeof(DirectoryEntry));
+			memmove(&child.children[1], &child.children[0], (child.count + 1) * sizeof(int));
+			child.entries[0] = node->entries[index - 1];
+			child.children[0] = left.children[left.count];
+			child.count++;
+
+			node->entries[index - 1] = left.entries[left.count - 1];
+
+			left.children[left.count] = 0;
+			left.count--;
+			memset(&left.entries[left.count], 0, sizeof(DirectoryEntry));
+
+			if(writeDirectoryNode(fileSystemPtr, node->children[index - 1], &left) < 0 ||
+					writeDirectoryNode(fileSystemPtr, node->children[index], &child) < 0 ||
+					writeDirectoryNode(fileSystemPtr, blockNum, node) < 0) {
+				return -1;
+			}
+		}
+		else if(index < node->count && right.count >= DIRECTORY_DEGREE) {
+			//	the entry after the child comes down into it and the right sibling's first goes up
+			child.entries[child.count] = node->entries[index];
+			child.children[child.count + 1] = right.children[0];
+			child.count++;
+
+			node->entries[index] = right.entries[0];
+
+			memmove(&right.entries[0], &right.entries[1], (right.count - 1) * sizeof(DirectoryEntry));
+			memmove(&right.children[0], &right.children[1], right.count * sizeof(int));
+			right.count--;
+			memset(&right.entries[right.count], 0, sizeof(DirectoryEntry));
+			right.children[right.count + 1] = 0;
+
+			if(writeDirectoryNode(fileSystemPtr, node->children[index + 1], &right) < 0 ||
+					writeDirectoryNode(fileSystemPtr, node->children[index], &child) < 0 ||
+					writeDirectoryNode(fileSystemPtr, blockNum, node) < 0) {
+				return -1;
+			}
+		}
+		else if(index < node->count) {
+			if(mergeDirectoryNodes(fileSystemPtr, blockNum, node, index, &child, &right) < 0) {
+				return -1;
+			}
+		}
+		else {
+			if(mergeDirectoryNodes(fileSystemPtr, blockNum, node, index - 1, &left, &child) < 0) {
+				return -1;
+			}
+
+			child = left;
+			index--;
+		}
+	}
+
+	return deleteFromNode(fileSystemPtr, node->children[index], &child, name);
+}
+
+/* finds the last entry (or the first, when 'last' is 0) of the subtree under a node */
+int findEdgeEntry(FileSystem *fileSystemPtr, int blockNum, int last, DirectoryEntry *entry) {
+	DirectoryNode node;
+
+	if(readDirectoryNode(fileSystemPtr, blockNum, &node) < 0) {
+		return -1;
+	}
+
+	while(node.children[0] != 0) {
+		if(readDirectoryNode(fileSystemPtr, node.children[last ? node.count : 0], &node) < 0) {
+			return -1;
+		}
+	}
+
+	*entry = node.entries[last ? node.count - 1 : 0];
+
+	return 0;
+}
+
+/* Adds the entries under a B-tree node that sort after the stream's last name and start
+ * with its prefix to entries[*filledPtr] onwards, in order. Subtrees holding only names
+ * before those are skipped. Returns 1 once 'count' entries are filled or a name past the
+ * prefix turns up, since nothing after it can match, 0 to go on, or -1 on failure.
+ */
+int collectEntries(FileSystem *fileSystemPtr, int blockNum, DirectoryStream *stream, DirEntry *entries, int count, int *filledPtr) {
+	DirectoryNode node;
+	DirectoryEntry *entryPtr;
+	int index = 0, prefixLength = strlen(stream->prefix), result;
+
+	if(readDirectoryNode(fileSystemPtr, blockNum, &node) < 0) {
+		return -1;
+	}
+
+	while(index < node.count && (strcmp(node.entries[index].name, stream->last) <= 0 ||
+			strncmp(node.entries[index].name, stream->prefix, prefixLength) < 0)) {
+		index++;
+	}
+
+	for(; index <= node.count; index++) {
+		if(node.children[index] != 0 &&
+				(result = collectEntries(fileSystemPtr, node.children[index], stream, entries, count, filledPtr)) != 0) {
+			return result;
+		}
+
+		if(index == node.count) break;
+
+		entryPtr = &node.entries[index];
+
+		if(strncmp(entryPtr->name, stream->prefix, prefixLength) > 0) {
+			return 1;
+		}
+
+		memset(&entries[*filledPtr], 0, sizeof(DirEntry));
+		strcpy(entries[*filledPtr].name, entryPtr->name);
+		entries[*filledPtr].directory = entryPtr->directory;
+
+		if((stream->flags & DIR_STAT) && statEntry(fileSystemPtr, entryPtr->inodeBlockNum, &entries[*filledPtr]) < 0) {
+			return -1;
+		}
+
+		if(++*filledPtr == count) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* orders batch operations by the directory they are in, then by name */
+int compareBatchPaths(const void *a, const void *b) {
+	const BatchSlot *slotA = a, *slotB = b;
+	int result;
+
+	if((result = strncmp(slotA->path, slotB->path,
+			slotA->parentLength < slotB->parentLength ? slotA->parentLength : slotB->parentLength)) != 0) {
+		return result;
+	}
+
+	if(slotA->parentLength != slotB->parentLength) {
+		return slotA->parentLength - slotB->parentLength;
+	}
+
+	return strcmp(slotA->path, slotB->path);
+}
+
+int compareBatchInodes(const void *a, const void *b) {
+	return ((const BatchSlot *)a)->inodeBlockNum - ((const BatchSlot *)b)->inodeBlockNum;
+}
+
+/* Looks up a run of batch operations whose names are in the same directory, creating
+ * the names BATCH_OPEN asks for that aren't there. Returns -1 if a creation failed.
+ */
+int lookupBatchRun(FileSystem *fileSystemPtr, BatchSlot *slots, int count) {
+	char data[BLOCKSIZE];
+	Inode *inodePtr;
+	int slot, parentBlockNum, result = 0;
+
+	parentBlockNum = resolveBatchParent(fileSystemPtr, &slots[0]);
+
+	for(slot = 0; slot < count; slot++) {
+		if(slots[slot].path[0] == '\0') {
+			slots[slot].inodeBlockNum = 1;		//	the root itself
+		}
+		else if(parentBlockNum < 0 || strlen(&slots[slot].path[slots[slot].parentLength + 1]) > 8) {
+			slots[slot].inodeBlockNum = -2;
+		}
+		else {
+			slots[slot].inodeBlockNum = -1;
+		}
+	}
+
+	if(parentBlockNum < 0) {
+		return 0;
+	}
+
+	if(readFsBlock(fileSystemPtr, parentBlockNum, data) < 0 || !((Inode *)&data[2])->directory) {
+		for(slot = 0; slot < count; slot++) {
+			if(slots[slot].inodeBlockNum == -1) slots[slot].inodeBlockNum = -2;
+		}
+
+		return 0;
+	}
+
+	inodePtr = (Inode *)&data[2];
+
+	if(inodePtr->directoryRoot != 0 && lookupBatchNode(fileSystemPtr, inodePtr->directoryRoot, slots, count) < 0) {
+		return -1;
+	}
+
+	for(slot = 0; slot < count; slot++) {
+		//	a name given more than once is created once
+		if(slots[slot].inodeBlockNum == -1 && slot > 0 && strcmp(slots[slot].path, slots[slot - 1].path) == 0) {
+			slots[slot].inodeBlockNum = slots[slot - 1].inodeBlockNum;
+		}
+
+		if(slots[slot].inodeBlockNum == -1 && slots[slot].op->op == BATCH_OPEN &&
+				(slots[slot].inodeBlockNum = createInode(fileSystemPtr, parentBlockNum,
+				&slots[slot].path[slots[slot].parentLength + 1], 0)) < 0) {
+			slots[slot].inodeBlockNum = -2;
+			result = -1;
+		}
+	}
+
+	//	and operations on it sorted before the one creating it find it too
+	for(slot = count - 2; slot >= 0; slot--) {
+		if(slots[slot].inodeBlockNum == -1 && strcmp(slots[slot].path, slots[slot + 1].path) == 0) {
+			slots[slot].inodeBlockNum = slots[slot + 1].inodeBlockNum;
+		}
+	}
+
+	return result;
+}
+
+/* Finds the names of a run of batch operations, sorted, in the B-tree under a node. The
+ * names going to the same child are looked up together, so each node on the way is read
+ * once for all of them. Operations already resolved are passed over.
+ */
+int lookupBatchNode(FileSystem *fileSystemPtr, int blockNum, BatchSlot *slots, int count) {
+	DirectoryNode node;
+	char *name;
+	int slot, runEnd, index;
+
+	if(readDirectoryNode(fileSystemPtr, blockNum, &node) < 0) {
+		return -1;
+	}
+
+	for(slot = 0; slot < count; slot = runEnd) {
+		runEnd = slot + 1;
+
+		if(slots[slot].inodeBlockNum != -1) continue;
+
+		name = &slots[slot].path[slots[slot].parentLength + 1];
+		index = findEntryIndex(&node, name);
+
+		if(index < node.count && strcmp(node.entries[index].name, name) == 0) {
+			slots[slot].inodeBlockNum = node.entries[index].inodeBlockNum;
+			continue;
+		}
+
+		if(node.children[0] == 0) continue;
+
+		//	the names before the next entry go down into the same child
+		while(runEnd < count && (index == node.count || slots[runEnd].inodeBlockNum != -1 ||
+				strcmp(&slots[runEnd].path[slots[runEnd].parentLength + 1], node.entries[index].name) < 0)) {
+			runEnd++;
+		}
+
+		if(lookupBatchNode(fileSystemPtr, node.children[index], &slots[slot], runEnd - slot) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* returns the inode block of the directory a batch operation's name is in, or -2 */
+int resolveBatchParent(FileSystem *fileSystemPtr, BatchSlot *slotPtr) {
+	int blockNum, parentBlockNum;
+	char saved = slotPtr->path[slotPtr->parentLength], name[9];
+
+	slotPtr->path[slotPtr->parentLength] = '\0';
+	blockNum = resolvePath(fileSystemPtr, slotPtr->path, &parentBlockNum, name);
+	slotPtr->path[slotPtr->parentLength] = saved;
+
+	return blockNum < 0 ? -2 : blockNum;
+}
+
+/* returns the code a batch operation fails with */
+int batchFailure(int op) {
+	switch(op) {
+		case BATCH_OPEN:
+			return OPEN_FILE_FAILURE;
+		case BATCH_STAT:
+			return READ_FILE_INFO_FAILURE;
+		case BATCH_MAKE_RO:
+			return MAKE_RO_FAILURE;
+		case BATCH_MAKE_RW:
+			return MAKE_RW_FAILURE;
+		default:
+			return BATCH_FAILURE;
+	}
+}
+
+/* Adds a copy of 'op' to the end of the open transaction */
+int stageOp(FileSystem *fileSystemPtr, StagedOp op) {
+	Transaction *transaction = fileSystemPtr->transaction;
+	StagedOp *opPtr = malloc(sizeof(StagedOp));
+
+	*opPtr = op;
+	opPtr->next = NULL;
+
+	if(transaction->lastOp == NULL) {
+		transaction->ops = opPtr;
+	}
+	else {
+		transaction->lastOp->next = opPtr;
+	}
+
+	transaction->lastOp = opPtr;
+
+	return 0;
+}
+
+void freeTransaction(Transaction *transaction) {
+	StagedOp *op;
+
+	while((op = transaction->ops) != NULL) {
+		transaction->ops = op->next;
+
+		free(op->data);
+		free(op->oldName);
+		free(op->newName);
+		free(op);
+	}
+
+	free(transaction);
+}
+
+/* Checks that staged operation 'stop' would succeed after the ones staged before it.
+ * Returns 0 if it would and -1 if not.
+ */
+int checkStagedOp(FileSystem *fileSystemPtr, StagedOp *stop) {
+	DynamicResource *dynamicResourcePtr;
+	char data[BLOCKSIZE];
+
+	if(stop->op == TXN_RENAME) {
+		return checkStagedRename(fileSystemPtr, stop, stop->oldName, stop->newName);
+	}
+
+	//	the handle may have been closed, or the file made read-only, since it was staged
+	dynamicResourcePtr = findResource(fileSystemPtr->dynamicResourceTable, stop->FD);
+
+	if(dynamicResourcePtr == NULL || readFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, data) < 0 ||
+			((Inode *)&data[2])->filePermission == READONLY) {
+		return -1;
+	}
+
+	//	a negative size would be copied as a huge one
+	if(stop->op == TXN_WRITE && stop->size < 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Checks a rename the way tfs_rename() does, but against the names the renames staged
+ * before 'stop' (every staged one when it is NULL) will have left. Returns 0 if it would
+ * succeed and -1 if not.
+ */
+int checkStagedRename(FileSystem *fileSystemPtr, StagedOp *stop, char *oldName, char *newName) {
+	char *oldPath, *newPath;
+	int result = -1;
+
+	oldPath = malloc(strlen(oldName) + 2);
+	newPath = malloc(strlen(newName) + 2);
+
+	canonicalPath(oldName, oldPath);
+	canonicalPath(newName, newPath);
+
+	//	the root can't be renamed, the new name must be free and a directory can't be moved
+	//	into itself
+	if(resolveStagedPath(fileSystemPtr, stop, oldPath) > 1 &&
+			resolveStagedPath(fileSystemPtr, stop, newPath) == -1 && pathUnder(newPath, oldPath) < 0) {
+		result = 0;
+	}
+
+	free(oldPath);
+	free(newPath);
+
+	return result;
+}
+
+/* Looks up canonical path 'path' as it will be once the renames staged before 'stop' are
+ * applied, by taking it back through them, latest first, to the name it has now. Returns
+ * what resolvePath() would then: the inode block, -1 if the name will be free in a
+ * directory that exists, or -2 otherwise.
+ */
+int resolveStagedPath(FileSystem *fileSystemPtr, StagedOp *stop, char *path) {
+	StagedOp *op, **renames;
+	int count = 0, i, length, result = 0, parentBlockNum;
+	char *current, *mapped, name[9];
+
+	for(op = fileSystemPtr->transaction->ops; op != stop; op = op->next) {
+		if(op->op == TXN_RENAME) count++;
+	}
+
+	renames = malloc(count * sizeof(StagedOp *));
+	count = 0;
+
+	for(op = fileSystemPtr->transaction->ops; op != stop; op = op->next) {
+		if(op->op == TXN_RENAME) renames[count++] = op;
+	}
+
+	current = malloc(strlen(path) + 1);
+	strcpy(current, path);
+
+	for(i = count - 1; i >= 0 && result == 0; i--) {
+		mapped = malloc(strlen(current) + strlen(renames[i]->oldName) + strlen(renames[i]->newName) + 3);
+		canonicalPath(renames[i]->oldName, mapped);
+		canonicalPath(renames[i]->newName, mapped + strlen(mapped) + 1);
+
+		if((length = pathUnder(current, mapped + strlen(mapped) + 1)) >= 0) {
+			//	moved here by this rename, so it was under the old name before it
+			strcat(mapped, current + length);
+			free(current);
+			current = mapped;
+			continue;
+		}
+
+		//	moved away by this rename, leaving its parent but nothing under it
+		if((length = pathUnder(current, mapped)) >= 0) {
+			result = current[length] == '\0' ? -1 : -2;
+		}
+
+		free(mapped);
+	}
+
+	if(result == 0) {
+		result = resolvePath(fileSystemPtr, current, &parentBlockNum, name);
+	}
+
+	free(current);
+	free(renames);
+
+	return result;
+}
+
+/* Returns the length of canonical path 'directory' if canonical path 'path' is it or is
+ * under it, or -1 if not
+ */
+int pathUnder(char *path, char *directory) {
+	int length = strlen(directory);
+
+	if(strncmp(path, directory, length) != 0 || (path[length] != '\0' && path[length] != '/')) {
+		return -1;
+	}
+
+	return length;
+}
+
+int applyStagedOp(StagedOp *op) {
+	switch(op->op) {
+		case TXN_WRITE:
+			return tfs_writeFile(op->FD, op->data, op->size);
+		case TXN_RENAME:
+			return tfs_rename(op->oldName, op->newName);
+		case TXN_DELETE:
+			return tfs_deleteFile(op->FD);
+		default:
+			return -1;
+	}
+}
+
+/* Writes out and frees the blocks a commit held in memory, data blocks first so nothing
+ * on disk points to a block before its content is there, each group in block order.
+ */
+int writeStagedBlocks(FileSystem *fileSystemPtr) {
+	StagedBlocks *staged = fileSystemPtr->stagedBlocks;
+	StagedBlock *stagedBlock;
+	int index, pass, result = 0;
+
+	fileSystemPtr->stagedBlocks = NULL;
+
+	for(pass = 0; pass < 2; pass++) {
+		for(index = 0; index < staged->count; index++) {
+			stagedBlock = &staged->blocks[index];
+
+			if((stagedBlock->data[0] == FILE_EXTENT) != (pass == 0)) {
+				continue;
+			}
+
+			if(writeFsBlock(fileSystemPtr, stagedBlock->blockNum, stagedBlock->data) < 0) {
+				result = -1;
+			}
+		}
+	}
+
+	for(index = 0; index < staged->count; index++) {
+		free(staged->blocks[index].data);
+	}
+
+	free(staged->blocks);
+	free(staged);
+
+	return result;
+}
+
+/* Points 'payloadPtr' at the payload of block 'index' of an uncompressed file, from the
+ * handle's read-ahead window. A miss reads the block and, if the handle's reads look
+ * sequential, the blocks after it into a new window, consecutive blocks with one call.
+ * Holes and blocks past the end of the block list read as zeros. Returns 0 or -1.
+ */
+int readAheadBlock(FileSystem *fileSystemPtr, DynamicResource *dynamicResourcePtr, Inode *inodePtr, int index, char **payloadPtr) {
+	BlockNode *blockNode, *runNode;
+	char blocks[(READ_AHEAD_MAX + 1) * BLOCKSIZE];
+	int count, filled, run, i;
+
+	if(dynamicResourcePtr->readAheadCount > 0 && index >= dynamicResourcePtr->readAheadStart &&
+			index < dynamicResourcePtr->readAheadStart + dynamicResourcePtr->readAheadCount) {
+		if(dynamicResourcePtr->readAheadGeneration == fileSystemPtr->dataGeneration) {
+			*payloadPtr = dynamicResourcePtr->readAheadData + (index - dynamicResourcePtr->readAheadStart) * (BLOCKSIZE - 2);
+
+			return 0;
+		}
+
+		//	the window went stale, but the reads that led to it still count
+	}
+	else if(index == 0 || (dynamicResourcePtr->readAheadCount > 0 && index == dynamicResourcePtr->readAheadStart + dynamicResourcePtr->readAheadCount)) {
+		//	like Linux readahead, the window ramps up while the scan goes on
+		dynamicResourcePtr->readAheadSize = dynamicResourcePtr->readAheadSize == 0 ? READ_AHEAD_MIN :
+			dynamicResourcePtr->readAheadSize * 2 > READ_AHEAD_MAX ? READ_AHEAD_MAX : dynamicResourcePtr->readAheadSize * 2;
+	}
+	else {
+		dynamicResourcePtr->readAheadSize = 0;
+	}
+
+	if(dynamicResourcePtr->readAheadData == NULL) {
+		dynamicResourcePtr->readAheadData = malloc((READ_AHEAD_MAX + 1) * (BLOCKSIZE - 2));
+	}
+
+	blockNode = findDataBlock(inodePtr->dataBlocks, index);
+
+	for(count = 0, runNode = blockNode; runNode != NULL && count < 1 + dynamicResourcePtr->readAheadSize; runNode = runNode->next) {
+		count++;
+	}
+
+	//	past the end of the block list is a hole
+	if(count == 0) {
+		memset(dynamicResourcePtr->readAheadData, 0, BLOCKSIZE - 2);
+		count = 1;
+	}
+
+	for(filled = 0; blockNode != NULL && filled < count; filled += run) {
+		if(blockNode->blockNum == HOLE_BLOCK) {
+			memset(dynamicResourcePtr->readAheadData + filled * (BLOCKSIZE - 2), 0, BLOCKSIZE - 2);
+			blockNode = blockNode->next;
+			run = 1;
+			continue;
+		}
+
+		//	a run of consecutive blocks is read with one call
+		for(run = 1, runNode = blockNode->next; filled + run < count && runNode != NULL &&
+				runNode->blockNum == blockNode->blockNum + run; runNode = runNode->next) {
+			run++;
+		}
+
+		if(readFsBlocks(fileSystemPtr, blockNode->blockNum, run, blocks) < 0) {
+			dynamicResourcePtr->readAheadCount = 0;
+
+			return -1;
+		}
+
+		for(i = 0; i < run; i++) {
+			memcpy(dynamicResourcePtr->readAheadData + (filled + i) * (BLOCKSIZE - 2), &blocks[i * BLOCKSIZE + 2], BLOCKSIZE - 2);
+		}
+
+		blockNode = runNode;
+	}
+
+	dynamicResourcePtr->readAheadStart = index;
+	dynamicResourcePtr->readAheadCount = count;
+	dynamicResourcePtr->readAheadGeneration = fileSystemPtr->dataGeneration;
+
+	*payloadPtr = dynamicResourcePtr->readAheadData;
+
+	return 0;
+}
+
+/* Syncs the image after an operation that returned 'result' if the file system's
+ * durability level or the handle 'FD' the operation went through asks for it. Whatever
+ * the operation wrote is synced even if it failed part way. Returns 'result', or 'failure'
+ * if the sync fails.
+ */
+int syncOp(FileSystem *fileSystemPtr, fileDescriptor FD, int result, int failure) {
+	DynamicResource *dynamicResourcePtr;
+
+	//	a committing transaction syncs once all of its operations are written out
+	if(fileSystemPtr == NULL || fileSystemPtr->stagedBlocks != NULL) {
+		return result;
+	}
+
+	dynamicResourcePtr = findResource(fileSystemPtr->dynamicResourceTable, FD);
+
+	if(fileSystemPtr->durability < DURABILITY_SYNC &&
+			(dynamicResourcePtr == NULL || !(dynamicResourcePtr->flags & OPEN_SYNC))) {
+		return result;
+	}
+
+	//	bytes held back on the handle aren't on disk to sync
+	if(dynamicResourcePtr != NULL && flushPendingData(fileSystemPtr, dynamicResourcePtr) < 0) {
+		return failure;
+	}
+
+	if(syncDisk(fileSystemPtr->diskNum) < 0 && result >= 0) {
+		return failure;
+	}
+
+	return result;
+}
+
+/* drops a freed block held by a committing transaction, so it isn't written out */
+void unstageBlock(FileSystem *fileSystemPtr, int blockNum) {
+	StagedBlocks *staged = fileSystemPtr->stagedBlocks;
+	int index;
+
+	if(staged == NULL || (index = findStagedBlock(staged, blockNum)) == staged->count ||
+			staged->blocks[index].blockNum != blockNum) {
+		return;
+	}
+
+	free(staged->blocks[index].data);
+
+	memmove(&staged->blocks[index], &staged->blocks[index + 1], (staged->count - index - 1) * sizeof(StagedBlock));
+	staged->count--;
+}
+
+/* Returns where blockNum is among a commit's staged blocks, or where it would go if it
+ * isn't one of them
+ */
+int findStagedBlock(StagedBlocks *staged, int blockNum) {
+	int low = 0, high = staged->count, middle;
+
+	while(low < high) {
+		middle = (low + high) / 2;
+
+		if(staged->blocks[middle].blockNum < blockNum) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+
+	return low;
+}
+
+DirectoryStream *findDirectoryStream(FileSystem *fileSystemPtr, dirDescriptor DD) {
+	DirectoryStream *stream;
+
+	for(stream = fileSystemPtr->directoryStreams; stream != NULL; stream = stream->next) {
+		if(stream->DD == DD) {
+			return stream;
+		}
+	}
+
+	return NULL;
+}
+
+/* fills in the inode fields of a DIR_STAT entry */
+int statEntry(FileSystem *fileSystemPtr, int inodeBlockNum, DirEntry *entry) {
+	char data[BLOCKSIZE];
+
+	if(readFsBlock(fileSystemPtr, inodeBlockNum, data) < 0) {
+		return -1;
+	}
+
+	fillEntryInfo(fileSystemPtr, inodeBlockNum, (Inode *)&data[2], entry);
+
+	return 0;
+}
+
+void fillEntryInfo(FileSystem *fileSystemPtr, int inodeBlockNum, Inode *inodePtr, DirEntry *entry) {
+	entry->size = pendingFileSize(fileSystemPtr, inodeBlockNum, inodePtr->size);
+	entry->filePermission = inodePtr->filePermission;
+	entry->creationTimestamp = inodePtr->creationTimestamp;
+	entry->modificationTimestamp = inodePtr->modificationTimestamp;
+	entry->accessTimestamp = inodePtr->accessTimestamp;
+}
+
+/* returns a file's size counting appends its open handles are still holding */
+off_t pendingFileSize(FileSystem *fileSystemPtr, int inodeBlockNum, off_t size) {
+	DynamicResourceNode *curr;
+	DynamicResource *dynamicResourcePtr;
+
+	for(curr = fileSystemPtr->dynamicResourceTable; curr != NULL; curr = curr->next) {
+		dynamicResourcePtr = curr->dynamicResource;
+
+		if(dynamicResourcePtr->inodeBlockNum == inodeBlockNum && dynamicResourcePtr->pendingSize > 0 &&
+				dynamicResourcePtr->pendingOffset + dynamicResourcePtr->pendingSize > size) {
+			size = dynamicResourcePtr->pendingOffset + dynamicResourcePtr->pendingSize;
+		}
+	}
+
+	return size;
+}
+
+/* returns the dentry cache slot a (directory, name) pair maps to */
+Dentry *findDentrySlot(FileSystem *fileSystemPtr, int parentBlockNum, char *name) {
+	uint32_t hash = 2166136261u ^ parentBlockNum;
+
+	for(; *name != '\0'; name++) {
+		hash = (hash ^ (unsigned char)*name) * 16777619u;
+	}
+
+	return &fileSystemPtr->dentryCache[hash % DENTRY_CACHE_SIZE];
+}
+
+void cacheDentry(FileSystem *fileSystemPtr, int parentBlockNum, char *name, int inodeBlockNum) {
+	Dentry *slot = findDentrySlot(fileSystemPtr, parentBlockNum, name);
+
+	slot->parentBlockNum = parentBlockNum;
+	strcpy(slot->name, name);
+	slot->inodeBlockNum = inodeBlockNum;
+}
+
+void forgetDentry(FileSystem *fileSystemPtr, int parentBlockNum, char *name) {
+	Dentry *slot = findDentrySlot(fileSystemPtr, parentBlockNum, name);
+
+	if(slot->parentBlockNum == parentBlockNum && strcmp(slot->name, name) == 0) {
+		slot->parentBlockNum = 0;
+	}
+}
+
+/* Copies 'path' into 'canonical' (at least strlen(path) + 2 bytes) in the form frozen
+ * inodes are named by: a '/' before every component and no empty components.
+ */
+void canonicalPath(char *path, char *canonical) {
+	while(*path != '\0') {
+		while(*path == '/') path++;
+
+		if(*path == '\0') break;
+
+		*canonical++ = '/';
+
+		while(*path != '\0' && *path != '/') *canonical++ = *path++;
+	}
+
+	*canonical = '\0';
+}
+
+/* returns the SNAPSHOT block of snapshot 'name', or -1 if there is none */
+int findSnapshot(FileSystem *fileSystemPtr, char *name) {
+	SnapshotNode *curr;
+
+	for(curr = fileSystemPtr->snapshots; curr != NULL; curr = curr->next) {
+		if(strcmp(curr->name, name) == 0) {
+			return curr->blockNum;
+		}
+	}
+
+	return -1;
+}
+
+/* Adds every file in the directory B-tree rooted at node nodeBlockNum to 'files',
+ * descending into subdirectories. 'path' is the directory's full path. Returns -1 if a
+ * block can't be read.
+ */
+int collectFiles(FileSystem *fileSystemPtr, int nodeBlockNum, char *path, SnapshotFiles *files) {
+	DirectoryNode node;
+	char data[BLOCKSIZE], *entryPath;
+	Inode *inodePtr = (Inode *)&data[2];
+	int index, result = 0;
+
+	if(readDirectoryNode(fileSystemPtr, nodeBlockNum, &node) < 0) {
+		return -1;
+	}
+
+	for(index = 0; index < node.count && result == 0; index++) {
+		entryPath = malloc(strlen(path) + strlen(node.entries[index].name) + 2);
+		sprintf(entryPath, "%s/%s", path, node.entries[index].name);
+
+		if(!node.entries[index].directory) {
+			if(files->count == files->capacity) {
+				files->capacity = files->capacity ? files->capacity * 2 : 16;
+				files->inodeBlocks = realloc(files->inodeBlocks, files->capacity * sizeof(int));
+				files->paths = realloc(files->paths, files->capacity * sizeof(char *));
+			}
+
+			files->inodeBlocks[files->count] = node.entries[index].inodeBlockNum;
+			files->paths[files->count++] = entryPath;
+
+			continue;
+		}
+
+		//	a directory with no entries yet has no tree
+		if(readFsBlock(fileSystemPtr, node.entries[index].inodeBlockNum, data) < 0) {
+			result = -1;
+		}
+		else if(inodePtr->directoryRoot != 0) {
+			result = collectFiles(fileSystemPtr, inodePtr->directoryRoot, entryPath, files);
+		}
+
+		free(entryPath);
+	}
+
+	//	a leaf has no children
+	for(index = 0; result == 0 && node.children[0] != 0 && index <= node.count; index++) {
+		result = collectFiles(fileSystemPtr, node.children[index], path, files);
+	}
+
+	return result;
+}
+
+
+int getFreeBlock(FileSystem *fileSystemPtr) {
+	BlockNode *node = fileSystemPtr->superblock.freeBlocks;
+	int freeBlockNum;
+
+	if(node == NULL) {
+		return -1;
+	}
+
+	freeBlockNum = node->blockNum;
+	fileSystemPtr->superblock.freeBlocks = node->next;
+	poolFree(&fileSystemPtr->blockNodePool, node);
+
+	return freeBlockNum;
+}
+
+/* Returns the first block number of the lowest run of count consecutive free blocks, or
+ * -1 if the free list has no run that long. The free list is kept sorted by block number,
+ * so runs are found in one pass.
+ */
+int findFreeBlockRun(FileSystem *fileSystemPtr, int count) {
+	BlockNode *curr;
+	int runLength = 0, startBlock = -1, lastBlock = -1;
+
+	for(curr = fileSystemPtr->superblock.freeBlocks; curr != NULL; curr = curr->next) {
+		if(runLength > 0 && curr->blockNum == lastBlock + 1) {
+			runLength++;
+		}
+		else {
+			startBlock = curr->blockNum;
+			runLength = 1;
+		}
+
+		lastBlock = curr->blockNum;
+
+		if(runLength == count) {
+			return startBlock;
+		}
+	}
+
+	return -1;
+}
+
+/* takes the lowest run of count consecutive blocks off the free list, returns its first block or -1 */
+int getFreeBlockRun(FileSystem *fileSystemPtr, int count) {
+	BlockNode **link = &fileSystemPtr->superblock.freeBlocks;
+	BlockNode *curr;
+	int startBlock;
+
+	if((startBlock = findFreeBlockRun(fileSystemPtr, count)) < 0) {
+		return -1;
+	}
+
+	while((*link)->blockNum != startBlock) link = &(*link)->next;
+
+	//	unlink the whole run, freeing its nodes
+	while(*link != NULL && (*link)->blockNum < startBlock + count) {
+		curr = *link;
+		*link = curr->next;
+		poolFree(&fileSystemPtr->blockNodePool, curr);
+	}
+
+	return startBlock;
+}
+
+/* Appends count free blocks to the end of a block list. The blocks are requested as one
+ * run first, then as progressively smaller runs, so a file only fragments when free space
+ * itself is fragmented. Nothing is taken if there aren't count free blocks in total.
+ */
+int allocateBlocks(FileSystem *fileSystemPtr, BlockNode **blockListPtr, int count) {
+	BlockNode **tailPtr = blockListPtr;
+	int runLength = count, startBlock, block;
+
+	if(countBlocks(fileSystemPtr->superblock.freeBlocks) < count) {
+		return -1;
+	}
+
+	while(*tailPtr != NULL) tailPtr = &(*tailPtr)->next;
+
+	while(count > 0) {
+		if(runLength > count) runLength = count;
+
+		if((startBlock = getFreeBlockRun(fileSystemPtr, runLength)) < 0) {
+			runLength = (runLength + 1) / 2;
+			continue;
+		}
+
+		for(block = startBlock; block < startBlock + runLength; block++) {
+			*tailPtr = poolAlloc(&fileSystemPtr->blockNodePool);
+			**tailPtr = (BlockNode) {
+				block,
+				NULL
+			};
+
+			tailPtr = &(*tailPtr)->next;
+		}
+
+		count -= runLength;
+	}
+
+	return 0;
+}
+
+/* puts a block back on the free list, keeping the list sorted by block number */
+void releaseBlock(FileSystem *fileSystemPtr, int blockNum) {
+	BlockNode **link = &fileSystemPtr->superblock.freeBlocks;
+	BlockNode *node = poolAlloc(&fileSystemPtr->blockNodePool);
+
+	unindexBlock(fileSystemPtr, blockNum);
+	unmapLogBlock(fileSystemPtr, blockNum);
+	unstageBlock(fileSystemPtr, blockNum);
+
+	while(*link != NULL && (*link)->blockNum < blockNum) link = &(*link)->next;
+
+	*node = (BlockNode) {
+		blockNum,
+		*link
+	};
+
+	*link = node;
+}
+
+/* Gives a block list back to the free list. Only the in-memory free list changes; the
+ * blocks' old contents stay on disk as garbage until they are allocated and written
+ * again. The list's own nodes are spliced into the free list, and because block lists are
+ * mostly ascending the search for each insertion point starts from the previous one, so
+ * freeing a file costs a pass over its block list rather than a write per block. With
+ * discard on, each run of freed blocks is also punched out of the backing image.
+ */
+void releaseDataBlocks(FileSystem *fileSystemPtr, BlockNode *blockHead) {
+	BlockNode **link = &fileSystemPtr->superblock.freeBlocks;
+	BlockNode *node, *lastNode = NULL;
+	int runStart = -1, runLength = 0;
+
+	while(blockHead != NULL) {
+		node = blockHead;
+		blockHead = blockHead->next;
+
+		//	holes have no block to give back
+		if(node->blockNum == HOLE_BLOCK) {
+			poolFree(&fileSystemPtr->blockNodePool, node);
+			continue;
+		}
+
+		//	a block a snapshot still holds stays allocated
+		if(fileSystemPtr->refCounts[node->blockNum] > 1) {
+			fileSystemPtr->refCounts[node->blockNum]--;
+			poolFree(&fileSystemPtr->blockNodePool, node);
+			continue;
+		}
+
+		fileSystemPtr->refCounts[node->blockNum] = 0;
+		unindexBlock(fileSystemPtr, node->blockNum);
+		unmapLogBlock(fileSystemPtr, node->blockNum);
+		unstageBlock(fileSystemPtr, node->blockNum);
+
+		//	only go back to the front of the free list when the block list steps backwards
+		if(lastNode == NULL || node->blockNum < lastNode->blockNum) {
+			link = &fileSystemPtr->superblock.freeBlocks;
+		}
+
+		while(*link != NULL && (*link)->blockNum < node->blockNum) link = &(*link)->next;
+
+		node->next = *link;
+		*link = node;
+		lastNode = node;
+
+		//	the log discards whole segments instead
+		if(fileSystemPtr->discard && !fileSystemPtr->logStructured) {
+			if(runLength > 0 && node->blockNum == runStart + runLength) {
+				runLength++;
+			}
+			else {
+				if(runLength > 0) discardBlocks(fileSystemPtr->diskNum, runStart, runLength);
+
+				runStart = node->blockNum;
+				runLength = 1;
+			}
+		}
+	}
+
+	if(runLength > 0) {
+		discardBlocks(fileSystemPtr->diskNum, runStart, runLength);
+	}
+}
+
+int countBlocks(BlockNode *blockHead) {
+	int count = 0;
+
+	for(; blockHead != NULL; blockHead = blockHead->next) count++;
+
+	return count;
+}
+
+/* counts the entries of a block map that have a disk block behind them, leaving out holes */
+int countDataBlocks(BlockNode *blockHead) {
+	int count = 0;
+
+	for(; blockHead != NULL; blockHead = blockHead->next) {
+		if(blockHead->blockNum != HOLE_BLOCK) count++;
+	}
+
+	return count;
+}
+
+/* returns the index'th block of a block list, or NULL if the list is shorter */
+BlockNode *findDataBlock(BlockNode *blockHead, int index) {
+	while(blockHead != NULL && index > 0) {
+		blockHead = blockHead->next;
+		index--;
+	}
+
+	return blockHead;
+}
+
+/* returns the first entry of a block list at or after blockHead that is not a hole */
+BlockNode *nextDataBlock(BlockNode *blockHead) {
+	while(blockHead != NULL && blockHead->blockNum == HOLE_BLOCK) blockHead = blockHead->next;
+
+	return blockHead;
+}
+
+/* counts the runs of consecutive block numbers in a block list, not counting holes */
+int countExtents(BlockNode *blockHead) {
+	int extents = 0, lastBlock = -2;
+
+	for(; blockHead != NULL; blockHead = blockHead->next) {
+		if(blockHead->blockNum == HOLE_BLOCK) continue;
+
+		if(blockHead->blockNum != lastBlock + 1) extents++;
+
+		lastBlock = blockHead->blockNum;
+	}
+
+	return extents;
+}
+
+/* Cuts a file's block list down to its first 'blocks' blocks and frees the rest */
+void trimDataBlocks(FileSystem *fileSystemPtr, Inode *inodePtr, int blocks) {
+	BlockNode *lastBlock, *extraBlocks = NULL;
+
+	blockListChanged(fileSystemPtr, inodePtr->dataBlocks);
+
+	if(blocks == 0) {
+		extraBlocks = inodePtr->dataBlocks;
+		inodePtr->dataBlocks = NULL;
+	}
+	else if((lastBlock = findDataBlock(inodePtr->dataBlocks, blocks - 1)) != NULL) {
+		extraBlocks = lastBlock->next;
+		lastBlock->next = NULL;
+	}
+
+	releaseDataBlocks(fileSystemPtr, extraBlocks);
+}
+
+/* takes blockNum + 1 off the free list if it is free, so appended blocks follow the ones
+ * before them, otherwise the lowest free block. Returns the block taken or -1.
+ */
+int getFreeBlockAfter(FileSystem *fileSystemPtr, int blockNum) {
+	BlockNode **link = &fileSystemPtr->superblock.freeBlocks;
+	BlockNode *curr;
+
+	while(*link != NULL && (*link)->blockNum <= blockNum) link = &(*link)->next;
+
+	if(blockNum >= 0 && *link != NULL && (*link)->blockNum == blockNum + 1) {
+		curr = *link;
+		*link = curr->next;
+		poolFree(&fileSystemPtr->blockNodePool, curr);
+
+		return blockNum + 1;
+	}
+
+	return getFreeBlockRun(fileSystemPtr, 1);
+}
+
+/* Gives a block list entry a block of its own if its block is shared with a snapshot or
+ * another file, so the caller can write to it without changing the others. The caller
+ * writes the whole new block. Returns -1 if there is no free block to copy onto.
+ */
+int unshareBlock(FileSystem *fileSystemPtr, BlockNode *blockNode) {
+	int blockNum;
+
+	//	written in place, so its contents no longer match its fingerprint
+	if(fileSystemPtr->refCounts[blockNode->blockNum] <= 1) {
+		unindexBlock(fileSystemPtr, blockNode->blockNum);
+		return 0;
+	}
+
+	if((blockNum = getFreeBlockAfter(fileSystemPtr, blockNode->blockNum)) < 0) {
+		return -1;
+	}
+
+	fileSystemPtr->refCounts[blockNode->blockNum]--;
+	blockNode->blockNum = blockNum;
+
+	return 0;
+}
+
+/* Returns a copy of a block list holding the same blocks, counting the new reference to
+ * each of them.
+ */
+BlockNode *shareBlockList(FileSystem *fileSystemPtr, BlockNode *blockHead) {
+	BlockNode *newBlocks = NULL, **tailPtr = &newBlocks;
+	int *refCount;
+
+	for(; blockHead != NULL; blockHead = blockHead->next) {
+		if(blockHead->blockNum != HOLE_BLOCK) {
+			refCount = &fileSystemPtr->refCounts[blockHead->blockNum];
+			*refCount = (*refCount > 1 ? *refCount : 1) + 1;
+		}
+
+		*tailPtr = poolAlloc(&fileSystemPtr->blockNodePool);
+		**tailPtr = (BlockNode) {
+			blockHead->blockNum,
+			NULL
+		};
+
+		tailPtr = &(*tailPtr)->next;
+	}
+
+	return newBlocks;
+}
+
+/* counts the blocks of a block list that another block list also holds */
+int countSharedBlocks(FileSystem *fileSystemPtr, BlockNode *blockHead) {
+	int count = 0;
+
+	for(; blockHead != NULL; blockHead = blockHead->next) {
+		if(blockHead->blockNum != HOLE_BLOCK && fileSystemPtr->refCounts[blockHead->blockNum] > 1) count++;
+	}
+
+	return count;
+}
+
+/* 64 bit FNV-1a hash of a block's payload. Zero is kept to mean "not indexed". */
+uint64_t fingerprintBlock(char *payload) {
+	uint64_t hash = 14695981039346656037ULL;
+	int i;
+
+	for(i = 0; i < BLOCKSIZE - 2; i++) {
+		hash ^= (unsigned char)payload[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash == 0 ? 1 : hash;
+}
+
+/* Looks a block about to be written up in the fingerprint index. If a stored block already
+ * has exactly the same contents, the block list entry is pointed at it and the block it
+ * held is given back, so the caller has nothing to write. Returns 1 in that case, 0 if
+ * the block has to be written, and -1 if a candidate could not be read.
+ */
+int dedupBlock(FileSystem *fileSystemPtr, BlockNode *blockNode, char *data) {
+	FingerprintNode *entry;
+	char stored[BLOCKSIZE];
+	uint64_t fingerprint = fingerprintBlock(&data[2]);
+	int blockCount = fileSystemPtr->size / BLOCKSIZE;
+	int *refCount;
+
+	for(entry = fileSystemPtr->fingerprintIndex[fingerprint % blockCount]; entry != NULL; entry = entry->next) {
+		if(entry->fingerprint != fingerprint) continue;
+
+		//	only a byte for byte match counts, the hash just finds candidates
+		if(readFsBlock(fileSystemPtr, entry->blockNum, stored) < 0) {
+			return -1;
+		}
+
+		if(memcmp(stored, data, BLOCKSIZE) == 0) break;
+	}
+
+	if(entry == NULL) {
+		return 0;
+	}
+
+	//	rewriting a block with what it already holds
+	if(entry->blockNum == blockNode->blockNum) {
+		return 1;
+	}
+
+	if(fileSystemPtr->refCounts[blockNode->blockNum] > 1) {
+		fileSystemPtr->refCounts[blockNode->blockNum]--;
+	}
+	else {
+		fileSystemPtr->refCounts[blockNode->blockNum] = 0;
+		releaseBlock(fileSystemPtr, blockNode->blockNum);
+	}
+
+	refCount = &fileSystemPtr->refCounts[entry->blockNum];
+	*refCount = (*refCount > 1 ? *refCount : 1) + 1;
+
+	blockNode->blockNum = entry->blockNum;
+	fileSystemPtr->dedupHits++;
+
+	return 1;
+}
+
+/* adds a block that was just written to the fingerprint index */
+void indexBlock(FileSystem *fileSystemPtr, int blockNum, char *data) {
+	FingerprintNode *entry = malloc(sizeof(FingerprintNode));
+	uint64_t fingerprint = fingerprintBlock(&data[2]);
+	FingerprintNode **bucket;
+
+	unindexBlock(fileSystemPtr, blockNum);
+
+	bucket = &fileSystemPtr->fingerprintIndex[fingerprint % (fileSystemPtr->size / BLOCKSIZE)];
+
+	*entry = (FingerprintNode) {
+		fingerprint,
+		blockNum,
+		*bucket
+	};
+
+	*bucket = entry;
+	fileSystemPtr->blockFingerprints[blockNum] = fingerprint;
+}
+
+/* drops a block from the fingerprint index, if it is in it */
+void unindexBlock(FileSystem *fileSystemPtr, int blockNum) {
+	FingerprintNode **link, *entry;
+	uint64_t fingerprint;
+
+	if(!fileSystemPtr->dedup || (fingerprint = fileSystemPtr->blockFingerprints[blockNum]) == 0) {
+		return;
+	}
+
+	link = &fileSystemPtr->fingerprintIndex[fingerprint % (fileSystemPtr->size / BLOCKSIZE)];
+
+	while((*link)->blockNum != blockNum) link = &(*link)->next;
+
+	entry = *link;
+	*link = entry->next;
+	free(entry);
+
+	fileSystemPtr->blockFingerprints[blockNum] = 0;
+}
+
+/* Reads a file system block. On a log-structured file system the block is read from
+ * wherever its latest version was written; a block never written since it was last freed
+ * reads as a free block, the same as it would straight after tfs_mkfs().
+ */
+int readFsBlock(FileSystem *fileSystemPtr, int blockNum, void *block) {
+	StagedBlocks *staged = fileSystemPtr->stagedBlocks;
+	int diskBlock, index;
+
+	//	a committing transaction's writes haven't reached the disk yet
+	if(staged != NULL && (index = findStagedBlock(staged, blockNum)) < staged->count &&
+			staged->blocks[index].blockNum == blockNum) {
+		memcpy(block, staged->blocks[index].data, BLOCKSIZE);
+
+		return 0;
+	}
+
+	if(!fileSystemPtr->logStructured) {
+		return readBlock(fileSystemPtr->diskNum, blockNum, block);
+	}
+
+	if(blockNum < 0 || blockNum >= fileSystemPtr->size / BLOCKSIZE) {
+		return DISK_PAST_LIMITS;
+	}
+
+	if((diskBlock = fileSystemPtr->log.blockMap[blockNum]) < 0) {
+		memset(block, 0, BLOCKSIZE);
+		memset(block, FREE, 1);
+		memset((char *)block + 1, MAGIC_NUMBER, 1);
+
+		return 0;
+	}
+
+	return readBlock(fileSystemPtr->diskNum, diskBlock, block);
+}
+
+/* Reads 'blocks' of a file's data blocks from index 'first' on into 'blocks' * BLOCKSIZE
+ * bytes at 'out', one readFsBlocks() per run of consecutive blocks. Holes and blocks past
+ * the end of the block list are left as they are in 'out'. Nothing but 'out' is written,
+ * so any number of threads may read the same file this way at once.
+ */
+int readFileBlocks(FileSystem *fileSystemPtr, Inode *inodePtr, int first, int blocks, char *out) {
+	BlockNode *currBlock = findDataBlock(inodePtr->dataBlocks, first);
+	int block, runStart = 0, runLength = 0;
+
+	for(block = 0; block <= blocks; block++) {
+		//	a run of consecutive blocks ends here, so it is read in one go
+		if(runLength > 0 && (block == blocks || currBlock == NULL || currBlock->blockNum == HOLE_BLOCK ||
+				currBlock->blockNum != runStart + runLength)) {
+			if(readFsBlocks(fileSystemPtr, runStart, runLength, out + (block - runLength) * BLOCKSIZE) < 0) {
+				return -1;
+			}
+
+			runLength = 0;
+		}
+
+		if(block == blocks) break;
+
+		if(currBlock != NULL && currBlock->blockNum != HOLE_BLOCK) {
+			if(runLength == 0) runStart = currBlock->blockNum;
+			runLength++;
+		}
+
+		if(currBlock != NULL) currBlock = currBlock->next;
+	}
+
+	return 0;
+}
+
+/* Reads 'count' consecutive file system blocks from blockNum on. Outside a log, and with
+ * no transaction committing, they are read from the disk with one call.
+ */
+int readFsBlocks(FileSystem *fileSystemPtr, int blockNum, int count, void *blocks) {
+	int i;
+
+	if(!fileSystemPtr->logStructured && fileSystemPtr->stagedBlocks == NULL) {
+		return readBlocks(fileSystemPtr->diskNum, blockNum, count, blocks);
+	}
+
+	for(i = 0; i < count; i++) {
+		if(readFsBlock(fileSystemPtr, blockNum + i, (char *)blocks + i * BLOCKSIZE) < 0) {
+			return READBLOCK_FAILURE;
+		}
+	}
+
+	return 0;
+}
+
+/* Writes a file system block. On a log-structured file system the block goes to the log
+ * head and the disk block holding its previous version becomes dead.
+ */
+int writeFsBlock(FileSystem *fileSystemPtr, int blockNum, void *block) {
+	LogState *log = &fileSystemPtr->log;
+	StagedBlocks *staged = fileSystemPtr->stagedBlocks;
+	int diskBlock, result, index;
+
+	//	any handle's read-ahead window may hold the old content
+	if(((char *)block)[0] == FILE_EXTENT) {
+		fileSystemPtr->dataGeneration++;
+	}
+
+	//	while a transaction commits, the last version of each block is kept in memory
+	if(staged != NULL) {
+		if(blockNum < 0 || blockNum >= fileSystemPtr->size / BLOCKSIZE) {
+			return DISK_PAST_LIMITS;
+		}
+
+		//	a block written for the first time is inserted in block number order
+		if((index = findStagedBlock(staged, blockNum)) == staged->count || staged->blocks[index].blockNum != blockNum) {
+			if(staged->count == staged->capacity) {
+				staged->capacity = staged->capacity ? staged->capacity * 2 : 16;
+				staged->blocks = realloc(staged->blocks, staged->capacity * sizeof(StagedBlock));
+			}
+
+			memmove(&staged->blocks[index + 1], &staged->blocks[index], (staged->count - index) * sizeof(StagedBlock));
+			staged->count++;
+
+			staged->blocks[index] = (StagedBlock) {
+				blockNum,
+				malloc(BLOCKSIZE)
+			};
+		}
+
+		memcpy(staged->blocks[index].data, block, BLOCKSIZE);
+
+		return 0;
+	}
+
+	//	the superblock stays where tfs_mount() looks for it
+	if(!fileSystemPtr->logStructured || blockNum == 0) {
+		return writeBlock(fileSystemPtr->diskNum, blockNum, block);
+	}
+
+	if(blockNum < 0 || blockNum >= fileSystemPtr->size / BLOCKSIZE) {
+		return DISK_PAST_LIMITS;
+	}
+
+	if((diskBlock = getLogBlock(fileSystemPtr)) < 0) {
+		return WRITEBLOCK_FAILURE;
+	}
+
+	//	a failed write leaves a dead block in the log
+	if((result = writeBlock(fileSystemPtr->diskNum, diskBlock, block)) < 0) {
+		return result;
+	}
+
+	//	taking a block may have cleaned, and so moved, the old version
+	if(log->blockMap[blockNum] >= 0) {
+		killLogBlock(fileSystemPtr, log->blockMap[blockNum]);
+	}
+
+	log->blockMap[blockNum] = diskBlock;
+	log->diskBlockOwners[diskBlock] = blockNum;
+	log->segmentLive[(diskBlock - 1) / LOG_SEGMENT_BLOCKS]++;
+
+	return 0;
+}
+
+/* Takes the disk block at the log head. When the head segment is full the log moves on to
+ * the next clean segment, and if that was the last one it cleans another straight away,
+ * so the cleaner always has somewhere to move live blocks to. Returns -1 if there is no
+ * clean segment.
+ */
+int getLogBlock(FileSystem *fileSystemPtr) {
+	LogState *log = &fileSystemPtr->log;
+	int segment;
+
+	if(log->head == 1 + (log->headSegment + 1) * LOG_SEGMENT_BLOCKS) {
+		if((segment = findCleanSegment(fileSystemPtr)) < 0) {
+			return -1;
+		}
+
+		log->headSegment = segment;
+		log->head = 1 + segment * LOG_SEGMENT_BLOCKS;
+
+		//	the reserved segments guarantee some other segment has dead blocks, and the
+		//	fresh head has room for all of its live ones
+		if(!log->cleaning && findCleanSegment(fileSystemPtr) < 0 &&
+				(segment = findCleanVictim(fileSystemPtr)) >= 0) {
+			log->cleaning = 1;
+
+			if(cleanSegment(fileSystemPtr, segment, -1) < 0) {
+				log->cleaning = 0;
+				return -1;
+			}
+
+			log->cleaning = 0;
+		}
+	}
+
+	return log->head++;
+}
+
+/* marks a disk block as no longer holding a live block */
+void killLogBlock(FileSystem *fileSystemPtr, int diskBlock) {
+	LogState *log = &fileSystemPtr->log;
+	int segment = (diskBlock - 1) / LOG_SEGMENT_BLOCKS;
+
+	log->diskBlockOwners[diskBlock] = -1;
+
+	if(--log->segmentLive[segment] == 0 && segment != log->headSegment && fileSystemPtr->discard) {
+		discardBlocks(fileSystemPtr->diskNum, 1 + segment * LOG_SEGMENT_BLOCKS, LOG_SEGMENT_BLOCKS);
+	}
+}
+
+/* drops a freed block from a log-structured file system's block map */
+void unmapLogBlock(FileSystem *fileSystemPtr, int blockNum) {
+	LogState *log = &fileSystemPtr->log;
+
+	if(!fileSystemPtr->logStructured || log->blockMap[blockNum] < 0) {
+		return;
+	}
+
+	killLogBlock(fileSystemPtr, log->blockMap[blockNum]);
+	log->blockMap[blockNum] = -1;
+}
+
+/* Returns the first segment after the head holding no live blocks, or -1 if there is none */
+int findCleanSegment(FileSystem *fileSystemPtr) {
+	LogState *log = &fileSystemPtr->log;
+	int i, segment;
+
+	//	going round from the head keeps the log writing forwards across the disk
+	for(i = 1; i < log->segments; i++) {
+		segment = (log->headSegment + i) % log->segments;
+
+		if(log->segmentLive[segment] == 0) return segment;
+	}
+
+	return -1;
+}
+
+/* Returns the segment with the fewest live blocks among those that also hold dead ones,
+ * so cleaning it frees the most space for the fewest moves, or -1 if there is none.
+ */
+int findCleanVictim(FileSystem *fileSystemPtr) {
+	LogState *log = &fileSystemPtr->log;
+	int segment, victim = -1;
+
+	for(segment = 0; segment < log->segments; segment++) {
+		if(segment == log->headSegment || log->segmentLive[segment] == 0 ||
+				log->segmentLive[segment] == LOG_SEGMENT_BLOCKS) {
+			continue;
+		}
+
+		if(victim < 0 || log->segmentLive[segment] < log->segmentLive[victim]) victim = segment;
+	}
+
+	return victim;
+}
+
+/* Moves a segment's live blocks to the log head, spending at most 'budget' block reads and
+ * writes, or as many as it takes when 'budget' is negative. Returns the number used, or -1
+ * on failure.
+ */
+int cleanSegment(FileSystem *fileSystemPtr, int segment, int budget) {
+	LogState *log = &fileSystemPtr->log;
+	char data[BLOCKSIZE];
+	int diskBlock, blockNum, used = 0;
+
+	for(diskBlock = 1 + segment * LOG_SEGMENT_BLOCKS;
+			diskBlock < 1 + (segment + 1) * LOG_SEGMENT_BLOCKS && (budget < 0 || used + 2 <= budget);
+			diskBlock++) {
+		if((blockNum = log->diskBlockOwners[diskBlock]) < 0) continue;
+
+		if(readBlock(fileSystemPtr->diskNum, diskBlock, data) < 0 ||
+				writeFsBlock(fileSystemPtr, blockNum, data) < 0) {
+			return -1;
+		}
+
+		used += 2;
+		log->cleanedBlocks++;
+	}
+
+	return used;
+}
+
+/* Writes a file's whole content compressed, COMPRESS_GROUP_SIZE bytes at a time, and
+ * records each group's sizes in the inode's extent list. Every group is padded out to a
+ * block boundary so the groups can all go through one writeDataBlocks() call. Returns
+ * the number of bytes of content written.
+ */
+int writeCompressedFile(FileSystem *fileSystemPtr, Inode *inodePtr, char *buffer, int size) {
+	CompressedExtent *extents = NULL, **tailPtr = &extents;
+	char *packed;
+	int packedSize;
+
+	packed = malloc(COMPRESSED_BOUND(size) + 1);
+	packedSize = compressGroups(buffer, size, packed, &tailPtr);
+
+	trimDataBlocks(fileSystemPtr, inodePtr, packedSize / (BLOCKSIZE - 2));
+
+	if(writeDataBlocks(fileSystemPtr, inodePtr, 0, packed, packedSize) < 0) {
+		free(packed);
+		freeExtents(extents);
+		return WRITE_FILE_FAILURE;
+	}
+
+	free(packed);
+	inodePtr->extents = extents;
+
+	return size;
+}
+
+/* Compresses 'size' bytes into groups laid out in 'packed' (COMPRESSED_BOUND(size) bytes)
+ * as they go on disk, each padded to a block boundary, and appends an extent for each to
+ * the list ending at *tailPtrPtr. Returns the bytes of 'packed' used.
+ */
+int compressGroups(char *buffer, int size, char *packed, CompressedExtent ***tailPtrPtr) {
+	int groupOffset, rawSize, compressedSize, packedSize = 0, groupBlocks;
+
+	for(groupOffset = 0; groupOffset < size; groupOffset += rawSize) {
+		rawSize = size - groupOffset < COMPRESS_GROUP_SIZE ? size - groupOffset : COMPRESS_GROUP_SIZE;
+		compressedSize = lzCompress(buffer + groupOffset, rawSize, packed + packedSize);
+
+		//	a group that doesn't shrink is kept as is
+		if(compressedSize >= rawSize) {
+			memcpy(packed + packedSize, buffer + groupOffset, rawSize);
+			compressedSize = rawSize;
+		}
+
+		groupBlocks = (compressedSize + BLOCKSIZE - 3) / (BLOCKSIZE - 2);
+		memset(packed + packedSize + compressedSize, 0, groupBlocks * (BLOCKSIZE - 2) - compressedSize);
+		packedSize += groupBlocks * (BLOCKSIZE - 2);
+
+		**tailPtrPtr = malloc(sizeof(CompressedExtent));
+		***tailPtrPtr = (CompressedExtent) {
+			rawSize,
+			compressedSize,
+			NULL
+		};
+
+		*tailPtrPtr = &(**tailPtrPtr)->next;
+	}
+
+	return packedSize;
+}
+
+/* Puts the group of a compressed file holding byte 'offset' into the handle's group
+ * buffer. Returns -1 if the file has no such group or it can't be read.
+ */
+int loadCompressedGroup(FileSystem *fileSystemPtr, DynamicResource *dynamicResourcePtr, Inode *inodePtr, off_t offset) {
+	CompressedExtent *extent = inodePtr->extents;
+	BlockNode *currBlock;
+	char data[BLOCKSIZE];
+	char *packed;
+	int blockIndex = 0, blocks, block;
+	off_t groupStart = 0;
+
+	while(extent != NULL && offset >= groupStart + extent->rawSize) {
+		groupStart += extent->rawSize;
+		blockIndex += (extent->compressedSize + BLOCKSIZE - 3) / (BLOCKSIZE - 2);
+		extent = extent->next;
+	}
+
+	if(extent == NULL) {
+		return -1;
+	}
+
+	if(dynamicResourcePtr->groupData == NULL) {
+		dynamicResourcePtr->groupData = malloc(COMPRESS_GROUP_SIZE);
+	}
+
+	blocks = (extent->compressedSize + BLOCKSIZE - 3) / (BLOCKSIZE - 2);
+	packed = malloc(blocks * (BLOCKSIZE - 2));
+	currBlock = findDataBlock(inodePtr->dataBlocks, blockIndex);
+
+	for(block = 0; block < blocks; block++) {
+		if(currBlock == NULL || readFsBlock(fileSystemPtr, currBlock->blockNum, data) < 0) {
+			free(packed);
+			return -1;
+		}
+
+		memcpy(packed + block * (BLOCKSIZE - 2), &data[2], BLOCKSIZE - 2);
+		currBlock = currBlock->next;
+	}
+
+	if(extent->compressedSize == extent->rawSize) {
+		memcpy(dynamicResourcePtr->groupData, packed, extent->rawSize);
+	}
+	else if(lzDecompress(packed, extent->compressedSize, dynamicResourcePtr->groupData,
+			COMPRESS_GROUP_SIZE) != extent->rawSize) {
+		free(packed);
+		return -1;
+	}
+
+	free(packed);
+
+	dynamicResourcePtr->groupExtent = extent;
+	dynamicResourcePtr->groupStart = groupStart;
+
+	return 0;
+}
+
+/* Rewrites a compressed file uncompressed, so parts of it can be written in place, and
+ * writes back its inode from inodeData. recompressFile() compresses it again when the
+ * handle is closed or synced.
+ */
+int decompressFile(FileSystem *fileSystemPtr, DynamicResource *dynamicResourcePtr, char *inodeData) {
+	Inode *inodePtr = (Inode *)&inodeData[2];
+	char *content;
+	off_t offset;
+
+	if(inodePtr->extents == NULL) {
+		return 0;
+	}
+
+	content = malloc(inodePtr->size + 1);
+
+	for(offset = 0; offset < inodePtr->size; offset += dynamicResourcePtr->groupExtent->rawSize) {
+		if(loadCompressedGroup(fileSystemPtr, dynamicResourcePtr, inodePtr, offset) < 0) {
+			free(content);
+			return -1;
+		}
+
+		memcpy(content + offset, dynamicResourcePtr->groupData, dynamicResourcePtr->groupExtent->rawSize);
+	}
+
+	releaseExtents(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodePtr);
+	trimDataBlocks(fileSystemPtr, inodePtr, (inodePtr->size + BLOCKSIZE - 3) / (BLOCKSIZE - 2));
+
+	if(writeDataBlocks(fileSystemPtr, inodePtr, 0, content, inodePtr->size) < 0) {
+		free(content);
+		return -1;
+	}
+
+	free(content);
+
+	return writeFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodeData);
+}
+
+/* Compresses a file of a compressing file system again once the writes that made
+ * decompressFile() store it as is are over. Its content is read HOST_COPY_CHUNK bytes at a
+ * time and each chunk's groups go to a new block list, which replaces the old one only
+ * once all of it is written; without the room for it the file just stays uncompressed.
+ * Returns -1 only if the file can't be read.
+ */
+int recompressFile(FileSystem *fileSystemPtr, int inodeBlockNum) {
+	CompressedExtent *extents = NULL, **tailPtr = &extents;
+	BlockNode *currBlock;
+	Inode *inodePtr, packedInode;
+	char inodeData[BLOCKSIZE], data[BLOCKSIZE];
+	char *chunk, *packed;
+	int length, filled, packedSize, result = 0;
+	off_t offset, stored = 0;
+
+	if(!fileSystemPtr->compression) {
+		return 0;
+	}
+
+	if(flushFilePendingData(fileSystemPtr, inodeBlockNum) < 0 || readFsBlock(fileSystemPtr, inodeBlockNum, inodeData) < 0) {
+		return -1;
+	}
+
+	inodePtr = (Inode *)&inodeData[2];
+
+	//	read-only inodes include the frozen ones of snapshots, which share their blocks
+	if(inodePtr->extents != NULL || inodePtr->size == 0 || inodePtr->directory || inodePtr->filePermission == READONLY) {
+		return 0;
+	}
+
+	memset(&packedInode, 0, sizeof(Inode));
+
+	chunk = malloc(HOST_COPY_CHUNK);
+	packed = malloc(COMPRESSED_BOUND(HOST_COPY_CHUNK));
+
+	for(offset = 0; offset < inodePtr->size && result == 0; offset += length) {
+		length = inodePtr->size - offset < HOST_COPY_CHUNK ? inodePtr->size - offset : HOST_COPY_CHUNK;
+		currBlock = findDataBlock(inodePtr->dataBlocks, offset / (BLOCKSIZE - 2));
+
+		for(filled = 0; filled < length && result == 0; filled += BLOCKSIZE - 2) {
+			//	holes read as zeros
+			if(currBlock == NULL || currBlock->blockNum == HOLE_BLOCK) {
+				memset(chunk + filled, 0, BLOCKSIZE - 2);
+			}
+			else if(readFsBlock(fileSystemPtr, currBlock->blockNum, data) < 0) {
+				result = -1;
+			}
+			else {
+				memcpy(chunk + filled, &data[2], BLOCKSIZE - 2);
+			}
+
+			if(currBlock != NULL) currBlock = currBlock->next;
+		}
+
+		if(result == 0) {
+			packedSize = compressGroups(chunk, length, packed, &tailPtr);
+
+			if(writeDataBlocks(fileSystemPtr, &packedInode, stored, packed, packedSize) < 0) {
+				result = 1;
+			}
+
+			stored += packedSize;
+		}
+	}
+
+	free(chunk);
+	free(packed);
+
+	if(result != 0) {
+		releaseDataBlocks(fileSystemPtr, packedInode.dataBlocks);
+		freeExtents(extents);
+
+		return result < 0 ? -1 : 0;
+	}
+
+	blockListChanged(fileSystemPtr, inodePtr->dataBlocks);
+	releaseDataBlocks(fileSystemPtr, inodePtr->dataBlocks);
+
+	inodePtr->dataBlocks = packedInode.dataBlocks;
+	inodePtr->extents = extents;
+
+	return writeFsBlock(fileSystemPtr, inodeBlockNum, inodeData);
+}
+
+/* Drops a file's compressed group list, and the groups its handles have decompressed */
+void releaseExtents(FileSystem *fileSystemPtr, int inodeBlockNum, Inode *inodePtr) {
+	DynamicResourceNode *curr;
+
+	for(curr = fileSystemPtr->dynamicResourceTable; curr != NULL; curr = curr->next) {
+		if(curr->dynamicResource->inodeBlockNum == inodeBlockNum) {
+			curr->dynamicResource->groupExtent = NULL;
+		}
+	}
+
+	freeExtents(inodePtr->extents);
+	inodePtr->extents = NULL;
+}
+
+/* returns a copy of a compressed group list */
+CompressedExtent *copyExtents(CompressedExtent *extent) {
+	CompressedExtent *extents = NULL, **tailPtr = &extents;
+
+	for(; extent != NULL; extent = extent->next) {
+		*tailPtr = malloc(sizeof(CompressedExtent));
+		**tailPtr = (CompressedExtent) {
+			extent->rawSize,
+			extent->compressedSize,
+			NULL
+		};
+
+		tailPtr = &(*tailPtr)->next;
+	}
+
+	return extents;
+}
+
+void freeExtents(CompressedExtent *extent) {
+	CompressedExtent *next;
+
+	for(; extent != NULL; extent = next) {
+		next = extent->next;
+		free(extent);
+	}
+}
+
+/* Called before a file's block list changes. A defragmenter move of the file is dropped
+ * and handles on the file forget their cached tail block.
+ */
+void blockListChanged(FileSystem *fileSystemPtr, BlockNode *blockHead) {
+	DynamicResourceNode *curr;
+
+	//	blocks read ahead may no longer be where the file's content is
+	fileSystemPtr->dataGeneration++;
+
+	if(fileSystemPtr->defrag.inodeBlockNum >= 0 && blockHead == fileSystemPtr->defrag.source) {
+		fileSystemPtr->defrag.dirty = 1;
+	}
+
+	for(curr = fileSystemPtr->dynamicResourceTable; curr != NULL; curr = curr->next) {
+		if(curr->dynamicResource->tailBlock != NULL && curr->dynamicResource->tailHead == blockHead) {
+			curr->dynamicResource->tailBlock = NULL;
+		}
+	}
+}
+
+/* Decides whether the defragmenter should move the file whose inode is at inodeBlockNum.
+ * It is moved onto the lowest free run that holds it whole if it is fragmented or the run
+ * sits below it. The run is taken off the free list right away so nothing else lands
+ * there while the blocks are copied.
+ */
+void startDefragMove(FileSystem *fileSystemPtr, int inodeBlockNum, Inode *inodePtr) {
+	DefragState *state = &fileSystemPtr->defrag;
+	int blocks, targetBlock;
+
+	//	holes stay holes, only allocated blocks are moved
+	if((blocks = countDataBlocks(inodePtr->dataBlocks)) == 0) {
+		return;
+	}
+
+	//	moving blocks a snapshot shares would leave two copies of them
+	if(countSharedBlocks(fileSystemPtr, inodePtr->dataBlocks) > 0) {
+		return;
+	}
+
+	if((targetBlock = findFreeBlockRun(fileSystemPtr, blocks)) < 0) {
+		return;
+	}
+
+	if(countExtents(inodePtr->dataBlocks) == 1 &&
+			targetBlock > nextDataBlock(inodePtr->dataBlocks)->blockNum) {
+		return;
+	}
+
+	getFreeBlockRun(fileSystemPtr, blocks);
+
+	state->inodeBlockNum = inodeBlockNum;
+	state->source = inodePtr->dataBlocks;
+	state->targetBlock = targetBlock;
+	state->length = blocks;
+	state->copied = 0;
+	state->dirty = 0;
+}
+
+/* Copies as many of the moving file's blocks as the budget allows, then switches the
+ * file's block list over to the new run with a single inode write and frees the old
+ * blocks. If the file's block list changed while it was being copied the move is dropped
+ * and the run goes back on the free list. Returns the number of block reads and writes done.
+ */
+int continueDefragMove(FileSystem *fileSystemPtr, int budget) {
+	DefragState *state = &fileSystemPtr->defrag;
+	BlockNode *sourceBlock, *newBlocks = NULL, **tailPtr = &newBlocks;
+	char data[BLOCKSIZE];
+	Inode *inodePtr;
+	int block, used = 0;
+
+	//	the old list may already be freed, so only the run is touched
+	if(state->dirty) {
+		for(block = state->targetBlock; block < state->targetBlock + state->length; block++) {
+			releaseBlock(fileSystemPtr, block);
+		}
+
+		//	counts as work so the pass is repeated and the file gets another try
+		state->inodeBlockNum = -1;
+		state->source = NULL;
+		state->moved++;
+
+		return 1;
+	}
+
+	sourceBlock = nextDataBlock(state->source);
+
+	for(block = 0; block < state->copied; block++) {
+		sourceBlock = nextDataBlock(sourceBlock->next);
+	}
+
+	while(state->copied < state->length && used + 2 <= budget) {
+		if(readFsBlock(fileSystemPtr, sourceBlock->blockNum, data) < 0) {
+			return DEFRAG_FAILURE;
+		}
+
+		if(writeFsBlock(fileSystemPtr, state->targetBlock + state->copied, data) < 0) {
+			return DEFRAG_FAILURE;
+		}
+
+		used += 2;
+		state->copied++;
+
+		if(state->copied < state->length) sourceBlock = nextDataBlock(sourceBlock->next);
+	}
+
+	//	switching over takes an inode read and write
+	if(state->copied < state->length || used + 2 > budget) {
+		return used;
+	}
+
+	if(readFsBlock(fileSystemPtr, state->inodeBlockNum, data) < 0) {
+		return DEFRAG_FAILURE;
+	}
+
+	inodePtr = (Inode *)&data[2];
+
+	//	the new list has the old one's holes in the same places
+	block = state->targetBlock;
+
+	for(sourceBlock = state->source; sourceBlock != NULL; sourceBlock = sourceBlock->next) {
+		*tailPtr = poolAlloc(&fileSystemPtr->blockNodePool);
+		**tailPtr = (BlockNode) {
+			sourceBlock->blockNum == HOLE_BLOCK ? HOLE_BLOCK : block++,
+			NULL
+		};
+
+		tailPtr = &(*tailPtr)->next;
+	}
+
+	inodePtr->dataBlocks = newBlocks;
+
+	if(writeFsBlock(fileSystemPtr, state->inodeBlockNum, data) < 0) {
+		return DEFRAG_FAILURE;
+	}
+
+	used += 2;
+
+	//	the move is over, so this only reaches append handles caching the old list
+	state->inodeBlockNum = -1;
+	blockListChanged(fileSystemPtr, state->source);
+	releaseDataBlocks(fileSystemPtr, state->source);
+
+	state->source = NULL;
+	state->moved++;
+
+	return used;
+}
+
+/* Writes size bytes from buffer into a file's data blocks starting at byte offset. Only
+ * the blocks the write touches are allocated, and those that are missing or holes are
+ * allocated in one call so they come off the free list together. Updates the inode's
+ * block list but not its size. Returns the number of bytes written.
+ */
+int writeDataBlocks(FileSystem *fileSystemPtr, Inode *inodePtr, off_t offset, char *buffer, int size) {
+	struct iovec vector = {
+		buffer,
+		size > 0 ? size : 0
+	};
+
+	return writeDataVector(fileSystemPtr, inodePtr, offset, &vector, 1);
+}
+
+/* Same as writeDataBlocks(), gathering the bytes from 'count' vectors in order. Each
+ * block's payload is filled straight from the vectors it spans.
+ */
+int writeDataVector(FileSystem *fileSystemPtr, Inode *inodePtr, off_t offset, const struct iovec *vectors, int count) {
+	return writeDataVectorAt(fileSystemPtr, inodePtr, &inodePtr->dataBlocks, 0, offset, vectors, count, NULL);
+}
+
+/* Same as writeDataVector(), walking the block list from *link, the entry for block
+ * linkIndex, which must not come after the first block written. A caller that already
+ * holds an entry near the write skips the walk from the front of the list. The entry of
+ * the last block written is left in *lastBlockPtr unless it is NULL.
+ */
+int writeDataVectorAt(FileSystem *fileSystemPtr, Inode *inodePtr, BlockNode **link, int linkIndex, off_t offset,
+		const struct iovec *vectors, int count, BlockNode **lastBlockPtr) {
+	BlockNode *currBlock, *lastBlock = NULL;
+	char data[BLOCKSIZE];
+	int firstIndex, lastIndex, firstWasHole, lastWasHole;
+	int blockIndex, blockOffset, writeSize, written = 0;
+	int vector, copied, size = 0;
+	size_t vectorOffset = 0, copySize;
+
+	for(vector = 0; vector < count; vector++) {
+		size += vectors[vector].iov_len;
+	}
+
+	if(size <= 0) {
+		return 0;
+	}
+
+	vector = 0;
+
+	blockListChanged(fileSystemPtr, inodePtr->dataBlocks);
+
+	firstIndex = offset / (BLOCKSIZE - 2);
+	lastIndex = (offset + size - 1) / (BLOCKSIZE - 2);
+
+	//	a block that was a hole has nothing worth reading back, it is all zeros
+	currBlock = findDataBlock(*link, firstIndex - linkIndex);
+	firstWasHole = currBlock == NULL || currBlock->blockNum == HOLE_BLOCK;
+	currBlock = findDataBlock(currBlock, lastIndex - firstIndex);
+	lastWasHole = currBlock == NULL || currBlock->blockNum == HOLE_BLOCK;
+
+	if(fillHoles(fileSystemPtr, link, linkIndex, firstIndex, lastIndex, 0) < 0) {
+		return WRITE_FILE_FAILURE;
+	}
+
+	currBlock = findDataBlock(*link, firstIndex - linkIndex);
+
+	//	get offset into block (minus two to account for reserved first two bytes)
+	blockOffset = offset % (BLOCKSIZE - 2);
+
+	for(blockIndex = firstIndex; written < size; blockIndex++) {
+		lastBlock = currBlock;
+
+		//	how much to write this time, minus two for first two bytes
+		writeSize = BLOCKSIZE - blockOffset - 2;
+
+		//	adjust for when there is not much data left to write
+		if(size - written < writeSize) writeSize = size - written;
+
+		//	only a partially overwritten block needs its old contents
+		if(writeSize < BLOCKSIZE - 2) {
+			if((blockIndex == firstIndex && firstWasHole) || (blockIndex == lastIndex && lastWasHole)) {
+				memset(data, 0, BLOCKSIZE);
+			}
+			else if(readFsBlock(fileSystemPtr, currBlock->blockNum, data) < 0) {
+				return WRITE_FILE_FAILURE;
+			}
+		}
+
+		//	set block to file extent
+		memset(&data[0], FILE_EXTENT, 1);
+		memset(&data[1], MAGIC_NUMBER, 1);
+
+		for(copied = 0; copied < writeSize; copied += copySize) {
+			copySize = vectors[vector].iov_len - vectorOffset;
+
+			if(copySize > (size_t)(writeSize - copied)) copySize = writeSize - copied;
+
+			memcpy(&data[2 + blockOffset + copied], (char *)vectors[vector].iov_base + vectorOffset, copySize);
+			vectorOffset += copySize;
+
+			if(vectorOffset == vectors[vector].iov_len) {
+				vector++;
+				vectorOffset = 0;
+			}
+		}
+
+		if(fileSystemPtr->dedup) {
+			switch(dedupBlock(fileSystemPtr, currBlock, data)) {
+			case -1:
+				return WRITE_FILE_FAILURE;
+			case 1:
+				//	the file now points at a stored block with these contents
+				written += writeSize;
+				blockOffset = 0;
+				currBlock = currBlock->next;
+				continue;
+			}
+		}
+
+		//	a block shared with a snapshot is written to a copy instead
+		if(unshareBlock(fileSystemPtr, currBlock) < 0) {
+			return WRITE_FILE_FAILURE;
+		}
+
+		if(writeFsBlock(fileSystemPtr, currBlock->blockNum, data) < 0) {
+			return WRITE_FILE_FAILURE;
+		}
+
+		if(fileSystemPtr->dedup) indexBlock(fileSystemPtr, currBlock->blockNum, data);
+
+		written += writeSize;
+		blockOffset = 0;
+		currBlock = currBlock->next;
+	}
+
+	if(lastBlockPtr != NULL) *lastBlockPtr = lastBlock;
+
+	return written;
+}
+
+/* Makes sure blocks firstIndex through lastIndex of a file are backed by disk blocks. The
+ * block list is walked from *link, the entry for block linkIndex (the front of the list
+ * and 0 to walk all of it), and padded out with holes to reach lastIndex, then every hole
+ * in the range is given a block, all taken in one allocateBlocks() call. Filled holes
+ * that start below byte 'zeroBelow' are part of the file's contents and get written as
+ * zeros; the rest are left for the caller to write.
+ */
+int fillHoles(FileSystem *fileSystemPtr, BlockNode **link, int linkIndex, int firstIndex, int lastIndex, off_t zeroBelow) {
+	BlockNode *firstBlock = NULL, *currBlock, *newBlocks = NULL, *nextBlock;
+	char data[BLOCKSIZE];
+	int blockIndex, holes = 0;
+
+	for(blockIndex = linkIndex; blockIndex <= lastIndex; blockIndex++) {
+		if(*link == NULL) {
+			*link = poolAlloc(&fileSystemPtr->blockNodePool);
+			**link = (BlockNode) {
+				HOLE_BLOCK,
+				NULL
+			};
+		}
+
+		if(blockIndex == firstIndex) firstBlock = *link;
+
+		if(blockIndex >= firstIndex && (*link)->blockNum == HOLE_BLOCK) holes++;
+
+		link = &(*link)->next;
+	}
+
+	if(holes == 0) {
+		return 0;
+	}
+
+	if(allocateBlocks(fileSystemPtr, &newBlocks, holes) < 0) {
+		return -1;
+	}
+
+	memset(data, 0, BLOCKSIZE);
+	memset(&data[0], FILE_EXTENT, 1);
+	memset(&data[1], MAGIC_NUMBER, 1);
+
+	currBlock = firstBlock;
+
+	for(blockIndex = firstIndex; blockIndex <= lastIndex; blockIndex++) {
+		if(currBlock->blockNum == HOLE_BLOCK) {
+			currBlock->blockNum = newBlocks->blockNum;
+
+			if((off_t) blockIndex * (BLOCKSIZE - 2) < zeroBelow &&
+					writeFsBlock(fileSystemPtr, currBlock->blockNum, data) < 0) {
+				return -1;
+			}
+
+			nextBlock = newBlocks->next;
+			poolFree(&fileSystemPtr->blockNodePool, newBlocks);
+			newBlocks = nextBlock;
+		}
+
+		currBlock = currBlock->next;
+	}
+
+	return 0;
+}
 
-int getFreeBlock(FileSystem *fileSystemPtr) {
-	int freeBlockNum;
+/* Zeros bytes [from, to) of a file. Holes in the range already read as zeros and are
+ * skipped, so only blocks actually allocated there (the old tail block, or blocks reserved
+ * past the end of file) are written.
+ */
+int zeroRange(FileSystem *fileSystemPtr, Inode *inodePtr, off_t from, off_t to) {
+	BlockNode *currBlock;
+	char data[BLOCKSIZE];
+	int blockOffset, zeroSize;
+
+	//	a defragmenter move may already have copied the blocks being zeroed
+	blockListChanged(fileSystemPtr, inodePtr->dataBlocks);
+
+	currBlock = findDataBlock(inodePtr->dataBlocks, from / (BLOCKSIZE - 2));
+	blockOffset = from % (BLOCKSIZE - 2);
+
+	while(from < to && currBlock != NULL) {
+		zeroSize = BLOCKSIZE - blockOffset - 2;
+
+		if(to - from < zeroSize) zeroSize = to - from;
+
+		if(currBlock->blockNum != HOLE_BLOCK) {
+			if(zeroSize < BLOCKSIZE - 2) {
+				if(readFsBlock(fileSystemPtr, currBlock->blockNum, data) < 0) {
+					return -1;
+				}
+			}
+
+			memset(&data[0], FILE_EXTENT, 1);
+			memset(&data[1], MAGIC_NUMBER, 1);
+			memset(&data[2 + blockOffset], 0, zeroSize);
+
+			if(unshareBlock(fileSystemPtr, currBlock) < 0) {
+				return -1;
+			}
+
+			if(writeFsBlock(fileSystemPtr, currBlock->blockNum, data) < 0) {
+				return -1;
+			}
+		}
+
+		from += zeroSize;
+		blockOffset = 0;
+		currBlock = currBlock->next;
+	}
+
+	return 0;
+}
+
+/* Creates an empty file, or directory if 'directory' is set, called 'name' in the
+ * directory whose inode is at parentBlockNum. Returns its inode block or -1 on failure.
+ */
+int createInode(FileSystem *fileSystemPtr, int parentBlockNum, char *name, int directory) {
+	Inode inode;
+	int inodeBlockNum;
+	char data[BLOCKSIZE];
+	char *permName = (char *) malloc(9);
+	char *creationTimestamp, *modificationTimestamp, *accessTimestamp;
 
-	if(fileSystemPtr->superblock.freeBlocks == NULL) {
+	if((inodeBlockNum = getFreeBlock(fileSystemPtr)) < 0) {
 		return -1;
 	}
 
-	freeBlockNum = fileSystemPtr->superblock.freeBlocks->blockNum;
-	fileSystemPtr->superblock.freeBlocks = fileSystemPtr->superblock.freeBlocks->next;
+	strcpy(permName, name);
 
-	return freeBlockNum;
+	creationTimestamp = (char *) malloc(30);
+	modificationTimestamp = (char *) malloc(30);
+	accessTimestamp = (char *) malloc(30);
+
+	getCurrentTime(creationTimestamp);
+	getCurrentTime(modificationTimestamp);
+	getCurrentTime(accessTimestamp);
+
+	inode = (Inode) {
+		permName,
+		0,
+		READWRITE,
+		NULL,
+		creationTimestamp,
+		modificationTimestamp,
+		accessTimestamp,
+		NULL,
+		directory,
+		0,		//	a directory gets a B-tree with its first entry
+		parentBlockNum
+	};
+
+	inode.generation = ++fileSystemPtr->inodeGeneration;
+
+	addInode(fileSystemPtr, inode, inodeBlockNum);
+
+	if(insertEntry(fileSystemPtr, parentBlockNum, name, inodeBlockNum, directory) < 0) {
+		//	inodes are found by scanning, so the block is marked free before it goes back
+		memset(data, 0, BLOCKSIZE);
+		memset(&data[0], FREE, 1);
+		memset(&data[1], MAGIC_NUMBER, 1);
+
+		writeFsBlock(fileSystemPtr, inodeBlockNum, data);
+		releaseBlock(fileSystemPtr, inodeBlockNum);
+
+		free(permName);
+		free(creationTimestamp);
+		free(modificationTimestamp);
+		free(accessTimestamp);
+
+		return -1;
+	}
+
+	return inodeBlockNum;
 }
 
-int addInode(fileDescriptor diskNum, Inode inode, int blockNum) {
-	char *data = calloc(1, BLOCKSIZE);
-	int result;
+/* Adds a handle on the file whose inode is at inodeBlockNum, opened as 'path' */
+fileDescriptor openInode(FileSystem *fileSystemPtr, char *path, int inodeBlockNum, int flags) {
+	DynamicResource dynamicResource;
+	char *permName = (char *) malloc(strlen(path) + 1);
+	int FD;
+
+	strcpy(permName, path);
+
+	FD = fileSystemPtr->openCount++;
+	
+	dynamicResource = (DynamicResource) {
+		permName,
+		0,
+		FD,
+		inodeBlockNum
+	};
+
+	dynamicResource.flags = flags;
+
+	if(addDynamicResource(fileSystemPtr, dynamicResource) < 0) {
+		return OPEN_FILE_FAILURE;
+	}
+
+	return FD;
+}
+
+int addInode(FileSystem *fileSystemPtr, Inode inode, int blockNum) {
+	char data[BLOCKSIZE] = { 0 };
 	
 	//	set first byte of data to inode block code
 	memset(&data[0], INODE, 1);
@@ -986,18 +6053,18 @@ int addInode(fileDescriptor diskNum, Inode inode, int blockNum) {
 	memcpy(&data[2], &(inode), sizeof(inode));
 
 	//	write inode and return status
-	return writeBlock(diskNum, blockNum, data);
+	return writeFsBlock(fileSystemPtr, blockNum, data);
 }
 
 int addDynamicResource(FileSystem *fileSystemPtr, DynamicResource dynamicResource) {
 	DynamicResourceNode *curr = fileSystemPtr->dynamicResourceTable;
 
-	DynamicResource *dynamicResourcePtr = malloc(sizeof(DynamicResource));
+	DynamicResource *dynamicResourcePtr = poolAlloc(&fileSystemPtr->resourcePool);
 	memcpy(dynamicResourcePtr, &dynamicResource, sizeof(DynamicResource));
 
 	//	create head if it is null
 	if(curr == NULL) {
-		curr = malloc(sizeof(DynamicResourceNode));
+		curr = poolAlloc(&fileSystemPtr->resourceNodePool);
 		*curr = (DynamicResourceNode) {
 			dynamicResourcePtr,
 			NULL
@@ -1008,12 +6075,14 @@ int addDynamicResource(FileSystem *fileSystemPtr, DynamicResource dynamicResourc
 	else {
 		while(curr->next != NULL) curr = curr->next;
 				
-		curr->next = malloc(sizeof(DynamicResourceNode));
+		curr->next = poolAlloc(&fileSystemPtr->resourceNodePool);
 		*(curr->next) = (DynamicResourceNode) {
 			dynamicResourcePtr,
 			NULL
 		};
 	}
+
+	return 1;
 }
 
 int removeDynamicResource(FileSystem *fileSystem, fileDescriptor FD) {
@@ -1029,7 +6098,7 @@ int removeDynamicResource(FileSystem *fileSystem, fileDescriptor FD) {
 		if(curr->dynamicResource->FD == FD) {
 			temp = curr;
 			fileSystem->dynamicResourceTable = curr->next;
-			free(temp);
+			releaseResourceNode(fileSystem, temp);
 
 			return 1;
 		}
@@ -1041,7 +6110,7 @@ int removeDynamicResource(FileSystem *fileSystem, fileDescriptor FD) {
 			if(curr->dynamicResource->FD == FD) {
 				temp = curr;
 				prev->next = curr->next;
-				free(temp);
+				releaseResourceNode(fileSystem, temp);
 
 				return 1;
 			}
@@ -1051,7 +6120,20 @@ int removeDynamicResource(FileSystem *fileSystem, fileDescriptor FD) {
 	}
 }
 
-int renameInode(FileSystem *fileSystemPtr, int blockNum, char *newName) {
+/* Gives a handle's table node, the handle and the name and buffers it holds back */
+void releaseResourceNode(FileSystem *fileSystemPtr, DynamicResourceNode *node) {
+	DynamicResource *dynamicResourcePtr = node->dynamicResource;
+
+	free(dynamicResourcePtr->name);
+	free(dynamicResourcePtr->pendingData);
+	free(dynamicResourcePtr->groupData);
+	free(dynamicResourcePtr->readAheadData);
+
+	poolFree(&fileSystemPtr->resourcePool, dynamicResourcePtr);
+	poolFree(&fileSystemPtr->resourceNodePool, node);
+}
+
+int renameInode(FileSystem *fileSystemPtr, int blockNum, char *newName, int parentBlockNum) {
 	int result;
 	char data[BLOCKSIZE];
 	Inode *inodePtr;
@@ -1060,38 +6142,403 @@ int renameInode(FileSystem *fileSystemPtr, int blockNum, char *newName) {
 
 	//getCurrentTime(modificationTimestamp);
 
-	if((result = readBlock(fileSystemPtr->diskNum, blockNum, data)) < 0) {
+	if((result = readFsBlock(fileSystemPtr, blockNum, data)) < 0) {
 		return result;		//	means error reading block
 	}
 
 	inodePtr = (Inode *)&data[2];
 	//inodePtr->modificationTimestamp = modificationTimestamp;
 
-	strcpy(inodePtr->name, "test");
+	inodePtr->name = (char *) malloc(9);
+	strcpy(inodePtr->name, newName);
+	inodePtr->parentBlockNum = parentBlockNum;
 
 	memcpy(&data[2], inodePtr, sizeof(Inode));
 
-	return writeBlock(fileSystemPtr->diskNum, blockNum, data);
+	return writeFsBlock(fileSystemPtr, blockNum, data);
 }
 
+/* gives every open handle on the file its new path; a file with none open is fine too */
 int renameDynamicResource(FileSystem *fileSystemPtr, int inodeBlockNum, char *newName) {
 	DynamicResourceNode *curr = fileSystemPtr->dynamicResourceTable;
 
-	if(fileSystemPtr->openCount == 0) {
-		return RENAME_FILE_FAILURE;
-	}
-
 	while (curr != NULL) {
 		if(curr->dynamicResource->inodeBlockNum == inodeBlockNum) {
+			free(curr->dynamicResource->name);
+			curr->dynamicResource->name = (char *) malloc(strlen(newName) + 1);
 			strcpy(curr->dynamicResource->name, newName);
-
-			return RENAME_FILE_SUCCESS;
 		}
 
 		curr = curr->next;
 	}
 
-	return RENAME_FILE_FAILURE;
+	return RENAME_FILE_SUCCESS;
+}
+
+/* Replaces the content of the file open as FD with what is left of the host file, reading
+ * it HOST_COPY_CHUNK bytes at a time. Blocks the content fits in are kept, as in
+ * tfs_writeFile(), and the inode is written once at the end, holding however much was
+ * read if the host file fails part way. On a compressing file system each chunk is
+ * compressed into whole groups before it is written, so only the last group is short.
+ */
+int streamHostFile(FileSystem *fileSystemPtr, fileDescriptor FD, int host) {
+	DynamicResource *dynamicResourcePtr;
+	Inode *inodePtr;
+	CompressedExtent *extents = NULL, **tailPtr = &extents, **chunkTailPtr;
+	struct stat hostStat;
+	char inodeData[BLOCKSIZE];
+	char *chunk, *packed = NULL, *modificationTimestamp;
+	int got, filled, packedSize, result = 0;
+	off_t size = 0, stored = 0;
+
+	dynamicResourcePtr = findResource(fileSystemPtr->dynamicResourceTable, FD);
+
+	if(dynamicResourcePtr == NULL || fstat(host, &hostStat) < 0 ||
+			readFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodeData) < 0) {
+		return -1;
+	}
+
+	inodePtr = (Inode *)&inodeData[2];
+
+	if(inodePtr->filePermission == READONLY) {
+		return -1;
+	}
+
+	//	bytes held on the file's handles are replaced along with the rest of the content
+	dropFilePendingData(fileSystemPtr, dynamicResourcePtr->inodeBlockNum);
+	releaseExtents(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodePtr);
+	trimDataBlocks(fileSystemPtr, inodePtr, (hostStat.st_size + BLOCKSIZE - 3) / (BLOCKSIZE - 2));
+
+	//	blocks for the whole file are taken in one go, as one run if the disk has one;
+	//	compressed content takes however many blocks its groups turn out to need
+	if(!fileSystemPtr->compression && hostStat.st_size > 0 &&
+			fillHoles(fileSystemPtr, &inodePtr->dataBlocks, 0, 0, (hostStat.st_size - 1) / (BLOCKSIZE - 2), 0) < 0) {
+		return -1;
+	}
+
+	chunk = malloc(HOST_COPY_CHUNK);
+
+	if(fileSystemPtr->compression) {
+		packed = malloc(COMPRESSED_BOUND(HOST_COPY_CHUNK));
+	}
+
+	do {
+		//	a chunk is filled before it is written, so every group but the last is whole
+		for(filled = 0; filled < HOST_COPY_CHUNK && (got = read(host, chunk + filled, HOST_COPY_CHUNK - filled)) > 0;
+				filled += got);
+
+		if(got < 0 || filled > MAX_FILE_SIZE - size) {
+			result = -1;
+			break;
+		}
+
+		chunkTailPtr = tailPtr;
+		packedSize = packed != NULL ? compressGroups(chunk, filled, packed, &tailPtr) : filled;
+
+		//	groups whose blocks weren't written aren't part of the file
+		if(writeDataBlocks(fileSystemPtr, inodePtr, stored, packed != NULL ? packed : chunk, packedSize) < 0) {
+			freeExtents(*chunkTailPtr);
+			*chunkTailPtr = NULL;
+
+			result = -1;
+			break;
+		}
+
+		size += filled;
+		stored += packedSize;
+	} while(filled == HOST_COPY_CHUNK);
+
+	free(chunk);
+	free(packed);
+
+	//	the host file may have shrunk while it was read
+	trimDataBlocks(fileSystemPtr, inodePtr, (stored + BLOCKSIZE - 3) / (BLOCKSIZE - 2));
+	inodePtr->extents = extents;
+
+	modificationTimestamp = (char *) malloc(30);
+	getCurrentTime(modificationTimestamp);
+
+	dynamicResourcePtr->seekOffset = 0;
+	inodePtr->size = size;
+	inodePtr->modificationTimestamp = modificationTimestamp;
+
+	if(writeFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodeData) < 0) {
+		return -1;
+	}
+
+	return result;
+}
+
+/* Writes the slices of a view to a host file, as many per writev() as the host takes,
+ * going back for whatever a short writev() left out
+ */
+int writeSlices(int host, ReadView *view) {
+	struct iovec *vectors;
+	ssize_t written;
+	int first, batch = sysconf(_SC_IOV_MAX);
+
+	vectors = malloc((view->count > 0 ? view->count : 1) * sizeof(struct iovec));
+
+	for(first = 0; first < view->count; first++) {
+		vectors[first] = (struct iovec) {
+			(void *)view->slices[first].data,
+			view->slices[first].length
+		};
+	}
+
+	for(first = 0; first < view->count; ) {
+		//	a host file that takes nothing would be asked again forever
+		if((written = writev(host, &vectors[first], view->count - first < batch ?
+				view->count - first : batch)) <= 0) {
+			free(vectors);
+			return -1;
+		}
+
+		while(first < view->count && (size_t) written >= vectors[first].iov_len) {
+			written -= vectors[first++].iov_len;
+		}
+
+		if(first < view->count) {
+			vectors[first].iov_base = (char *)vectors[first].iov_base + written;
+			vectors[first].iov_len -= written;
+		}
+	}
+
+	free(vectors);
+
+	return 0;
+}
+
+/* Returns the mapping whose range holds 'addr', or NULL if there is none */
+Mapping *findMapping(FileSystem *fileSystemPtr, char *addr) {
+	Mapping *mapping;
+
+	for(mapping = fileSystemPtr->mappings; mapping != NULL; mapping = mapping->next) {
+		if(addr >= mapping->addr && addr < mapping->addr + mapping->length) {
+			return mapping;
+		}
+	}
+
+	return NULL;
+}
+
+/* Writes the bytes of a mapping that differ from its shadow copy back to the file. Each
+ * run of changed bytes goes out in one writeDataBlocks() call, and the inode is written
+ * once at the end. The file may have shrunk since it was mapped; bytes past its end
+ * aren't written back.
+ */
+int writeBackMapping(FileSystem *fileSystemPtr, Mapping *mapping) {
+	DynamicResource groupResource;
+	Inode *inodePtr;
+	char data[BLOCKSIZE];
+	char *modificationTimestamp;
+	int start, runEnd, end, result, compressed;
+
+	if(mapping->shadow == NULL) {
+		return 0;
+	}
+
+	//	bytes held on handles were written before the ones being written back
+	if(flushFilePendingData(fileSystemPtr, mapping->inodeBlockNum) < 0 ||
+			readFsBlock(fileSystemPtr, mapping->inodeBlockNum, data) < 0) {
+		return -1;
+	}
+
+	inodePtr = (Inode *)&data[2];
+
+	//	the block holds another file's inode now, or none, so the changes are dropped
+	if(data[0] != INODE || inodePtr->generation != mapping->generation) {
+		return 0;
+	}
+
+	end = mapping->length;
+
+	if(inodePtr->size < mapping->offset + end) {
+		end = inodePtr->size > mapping->offset ? inodePtr->size - mapping->offset : 0;
+	}
+
+	if(end <= 0 || memcmp(mapping->addr, mapping->shadow, end) == 0) {
+		return 0;
+	}
+
+	//	changes can't be staged by a transaction, so they wait until it is over
+	if(inodePtr->filePermission == READONLY || fileSystemPtr->transaction != NULL) {
+		return -1;
+	}
+
+	//	the file was rewritten compressed since it was mapped
+	if((compressed = inodePtr->extents != NULL)) {
+		groupResource = (DynamicResource) { NULL };
+		groupResource.inodeBlockNum = mapping->inodeBlockNum;
+
+		result = decompressFile(fileSystemPtr, &groupResource, data);
+		free(groupResource.groupData);
+
+		if(result < 0) {
+			return -1;
+		}
+	}
+
+	//	bytes the mapping left alone may have been written through a handle since
+	for(start = 0; start < end; start = runEnd) {
+		for(; start < end && mapping->addr[start] == mapping->shadow[start]; start++);
+		for(runEnd = start; runEnd < end && mapping->addr[runEnd] != mapping->shadow[runEnd]; runEnd++);
+
+		if(runEnd == start) break;
+
+		if(writeDataBlocks(fileSystemPtr, inodePtr, mapping->offset + start, mapping->addr + start, runEnd - start) < 0) {
+			return -1;
+		}
+
+		memcpy(mapping->shadow + start, mapping->addr + start, runEnd - start);
+	}
+
+	modificationTimestamp = (char *) malloc(30);
+	getCurrentTime(modificationTimestamp);
+	inodePtr->modificationTimestamp = modificationTimestamp;
+
+	if(writeFsBlock(fileSystemPtr, mapping->inodeBlockNum, data) < 0) {
+		return -1;
+	}
+
+	return compressed ? recompressFile(fileSystemPtr, mapping->inodeBlockNum) : 0;
+}
+
+/* Unmaps a mapping's range and frees it */
+void releaseMapping(Mapping *mapping) {
+	munmap(mapping->addr, mapping->length);
+	free(mapping->shadow);
+	free(mapping);
+}
+
+/* Adds one byte to the handle's pending run, flushing it once it holds
+ * DELAYED_ALLOC_LIMIT bytes.
+ */
+int bufferPendingByte(FileSystem *fileSystemPtr, DynamicResource *dynamicResourcePtr, char byte) {
+	if(dynamicResourcePtr->pendingSize == dynamicResourcePtr->pendingCapacity) {
+		dynamicResourcePtr->pendingCapacity = dynamicResourcePtr->pendingCapacity ?
+			dynamicResourcePtr->pendingCapacity * 2 : BLOCKSIZE - 2;
+		dynamicResourcePtr->pendingData = realloc(dynamicResourcePtr->pendingData,
+			dynamicResourcePtr->pendingCapacity);
+	}
+
+	dynamicResourcePtr->pendingData[dynamicResourcePtr->pendingSize++] = byte;
+	dynamicResourcePtr->seekOffset++;
+
+	if(dynamicResourcePtr->pendingSize >= DELAYED_ALLOC_LIMIT &&
+			flushPendingData(fileSystemPtr, dynamicResourcePtr) < 0) {
+		return WRITE_BYTE_FAILURE;
+	}
+
+	return WRITE_BYTE_SUCCESS;
+}
+
+/* Writes out the bytes held on a handle. The run lands in one writeDataVectorAt() call, so
+ * each block it covers is read and written once, and blocks for a run past the end of
+ * the file are assigned in one go, after filling whatever room the file already has (the
+ * partial tail block and any blocks reserved by tfs_fallocate). The block the run ended in
+ * is cached on the handle, so the next run from there on, an append in particular, starts
+ * from it instead of walking the block list from the front.
+ */
+int flushPendingData(FileSystem *fileSystemPtr, DynamicResource *dynamicResourcePtr) {
+	char inodeData[BLOCKSIZE];
+	Inode *inodePtr;
+	BlockNode *tailBlock, **link;
+	int linkIndex;
+	char *modificationTimestamp;
+	struct iovec vector;
+
+	if(dynamicResourcePtr->pendingSize == 0) {
+		return 1;
+	}
+
+	if(readFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodeData) < 0) {
+		return WRITE_BYTE_FAILURE;
+	}
+
+	inodePtr = (Inode *)&inodeData[2];
+
+	vector = (struct iovec) {
+		dynamicResourcePtr->pendingData,
+		dynamicResourcePtr->pendingSize
+	};
+
+	//	the cached entry is gone if the list changed since, and writing drops it again
+	tailBlock = dynamicResourcePtr->tailBlock;
+	link = &inodePtr->dataBlocks;
+	linkIndex = 0;
+
+	if(tailBlock != NULL && dynamicResourcePtr->tailHead == inodePtr->dataBlocks &&
+			dynamicResourcePtr->tailIndex <= dynamicResourcePtr->pendingOffset / (BLOCKSIZE - 2)) {
+		link = &tailBlock;
+		linkIndex = dynamicResourcePtr->tailIndex;
+	}
+
+	if(writeDataVectorAt(fileSystemPtr, inodePtr, link, linkIndex, dynamicResourcePtr->pendingOffset,
+			&vector, 1, &tailBlock) < 0) {
+		return WRITE_BYTE_FAILURE;
+	}
+
+	if(dynamicResourcePtr->pendingOffset + dynamicResourcePtr->pendingSize > inodePtr->size) {
+		inodePtr->size = dynamicResourcePtr->pendingOffset + dynamicResourcePtr->pendingSize;
+	}
+
+	modificationTimestamp = (char *) malloc(30);
+	getCurrentTime(modificationTimestamp);
+	inodePtr->modificationTimestamp = modificationTimestamp;
+
+	if(writeFsBlock(fileSystemPtr, dynamicResourcePtr->inodeBlockNum, inodeData) < 0) {
+		return WRITE_BYTE_FAILURE;
+	}
+
+	dynamicResourcePtr->tailHead = inodePtr->dataBlocks;
+	dynamicResourcePtr->tailBlock = tailBlock;
+	dynamicResourcePtr->tailIndex = (dynamicResourcePtr->pendingOffset + dynamicResourcePtr->pendingSize - 1) /
+		(BLOCKSIZE - 2);
+	dynamicResourcePtr->pendingSize = 0;
+
+	return 1;
+}
+
+int flushAllPendingData(FileSystem *fileSystemPtr) {
+	DynamicResourceNode *curr;
+	int result = 1;
+
+	for(curr = fileSystemPtr->dynamicResourceTable; curr != NULL; curr = curr->next) {
+		if(flushPendingData(fileSystemPtr, curr->dynamicResource) < 0) {
+			result = WRITE_BYTE_FAILURE;
+		}
+	}
+
+	return result;
+}
+
+/* Flushes the pending runs of every handle open on one file, so whatever is about to
+ * look at the file through any of them sees all bytes written to it.
+ */
+int flushFilePendingData(FileSystem *fileSystemPtr, int inodeBlockNum) {
+	DynamicResourceNode *curr;
+	int result = 1;
+
+	for(curr = fileSystemPtr->dynamicResourceTable; curr != NULL; curr = curr->next) {
+		if(curr->dynamicResource->inodeBlockNum == inodeBlockNum &&
+				flushPendingData(fileSystemPtr, curr->dynamicResource) < 0) {
+			result = WRITE_BYTE_FAILURE;
+		}
+	}
+
+	return result;
+}
+
+/* Throws away the pending runs of every handle open on one file */
+void dropFilePendingData(FileSystem *fileSystemPtr, int inodeBlockNum) {
+	DynamicResourceNode *curr;
+
+	for(curr = fileSystemPtr->dynamicResourceTable; curr != NULL; curr = curr->next) {
+		if(curr->dynamicResource->inodeBlockNum == inodeBlockNum) {
+			curr->dynamicResource->pendingSize = 0;
+		}
+	}
 }
 
 void getCurrentTime(char *timestamp) {
@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 /* The default size of the disk and file system block */
 #define BLOCKSIZE 256
@@ -9,21 +12,99 @@
  * default size. You must be able to support different possible values 
  */
 #define DEFAULT_DISK_SIZE 10240
+/* Sizes and offsets are 64-bit off_t, but blocks are numbered with ints, which caps a disk
+ * at INT32_MAX blocks and a file at INT32_MAX blocks of payload
+ */
+#define MAX_FILE_SIZE ((off_t) INT32_MAX * (BLOCKSIZE - 2))
 /* use this name for a default disk file name */
 #define DEFAULT_DISK_NAME “tinyFSDisk” 	
 typedef int fileDescriptor;
+typedef int dirDescriptor;
 
 #define READWRITE 1
 #define READONLY 2
 
+/* Flags for tfs_openFileFlags() */
+#define OPEN_APPEND 1				//	every write goes to the end of the file
+#define OPEN_SYNC 2					//	every change made through the handle is synced
+
+/* Durability levels for tfs_setDurability() */
+#define DURABILITY_NONE 0			//	blocks reach the image whenever stdio writes them out
+#define DURABILITY_CLOSE 1			//	closing a file or unmounting syncs the image
+#define DURABILITY_SYNC 2			//	every operation that changes the file system syncs
+
+/* Flags for tfs_mkfsFlags() */
+#define MKFS_COMPRESS 1				//	tfs_writeFile() stores file content compressed
+#define MKFS_DEDUP 2				//	identical data blocks are stored once
+#define MKFS_LOG 4					//	every block write is appended to a log
+
+/* Operations for tfs_batch() */
+#define BATCH_OPEN 1				//	tfs_openFile()
+#define BATCH_STAT 2				//	fill in the operation's info from the inode
+#define BATCH_MAKE_RO 3				//	tfs_makeRO()
+#define BATCH_MAKE_RW 4				//	tfs_makeRW()
+
+/* Operations staged by a tfs_begin() transaction */
+#define TXN_WRITE 1					//	tfs_writeFile()
+#define TXN_RENAME 2				//	tfs_rename()
+#define TXN_DELETE 3				//	tfs_deleteFile()
+
+/* Flags for tfs_opendir() */
+#define DIR_STAT 1					//	tfs_readdir_r() fills in each entry's inode fields
+
+/* Protection flags for tfs_mmap() */
+#define MMAP_READ 1					//	the range can be read
+#define MMAP_WRITE 2				//	the range can be written and written back
+
+/* Blocks in a segment of a log-structured file system, the unit the cleaner frees */
+#define LOG_SEGMENT_BLOCKS 16
+
+/* Segments a log-structured file system leaves out of its usable size, so there is always
+ * dead space for the cleaner to reclaim and a clean segment for it to move live blocks to.
+ */
+#define LOG_RESERVED_SEGMENTS 2
+
+/* Bytes of file content compressed together. Each group starts on a block boundary so it
+ * can be read back without the groups before it.
+ */
+#define COMPRESS_GROUP_SIZE ((BLOCKSIZE - 2) * 16)
+
+/* Bytes 'size' bytes of content may take compressed, with every group padded out to the
+ * block boundary it may need while it is being compressed
+ */
+#define COMPRESSED_BOUND(size) (((size) + COMPRESS_GROUP_SIZE - 1) / COMPRESS_GROUP_SIZE * \
+	((LZ_BOUND(COMPRESS_GROUP_SIZE) + BLOCKSIZE - 3) / (BLOCKSIZE - 2)) * (BLOCKSIZE - 2))
+
+/* Blocks a handle reads ahead once its reads turn sequential, and the most its read-ahead
+ * window grows to while they stay sequential, doubling on each window read
+ */
+#define READ_AHEAD_MIN 4
+#define READ_AHEAD_MAX 32
+
+/* Bytes a file handle may hold back from tfs_writeByte() before they are forced out to
+ * disk. Without delayed allocation a handle never holds more than one block's worth.
+ */
+#define DELAYED_ALLOC_LIMIT ((BLOCKSIZE - 2) * 64)
+
+/* Bytes tfs_importFile() and tfs_exportFile() move between a host file and the file
+ * system per read or write call on the host file
+ */
+#define HOST_COPY_CHUNK ((BLOCKSIZE - 2) * 1024)
+
 
 /*	For libDisk.c	*/
 
 typedef struct disk {
 	FILE *file;
 	int diskNum;
-	int space;
+	off_t space;					//	bytes of the backing file the disk covers
 	int open;
+	pthread_mutex_t syncLock;		//	guards the counts below
+	pthread_cond_t syncDone;		//	signalled whenever a sync finishes
+	unsigned long writes;			//	blocks written since the disk was opened
+	unsigned long syncedWrites;		//	writes the last finished sync covered
+	int syncing;					//	a caller is syncing the backing file
+	unsigned long syncs;			//	fdatasync() calls made
 } Disk;
 
 typedef struct diskNode {
@@ -32,7 +113,7 @@ typedef struct diskNode {
 } DiskNode;
 
 /* This functions opens a regular UNIX file and designates the first nBytes of it as space for the emulated disk. nBytes should be an integral number of the block size. If nBytes > 0 and there is already a file by the given filename, that file’s contents may be overwritten. If nBytes is 0, an existing disk is opened, and should not be overwritten. There is no requirement to maintain integrity of any file content beyond nBytes. The return value is -1 on failure or a disk number on success. */
-int openDisk(char *filename, int nBytes);
+int openDisk(char *filename, off_t nBytes);
 
 /* readBlock() reads an entire block of BLOCKSIZE bytes from the open disk (identified by ‘disk’) and copies the result into a local buffer (must be at least of BLOCKSIZE bytes). The bNum is a logical block number, which must be translated into a byte offset within the disk. The translation from logical to physical block is straightforward: bNum=0 is the very first byte of the file. bNum=1 is BLOCKSIZE bytes into the disk, bNum=n is n*BLOCKSIZE bytes into the disk. On success, it returns 0. -1 or smaller is returned if disk is not available (hasn’t been opened) or any other failures. You must define your own error code system. */
 int readBlock(int disk, int bNum, void *block);
@@ -43,6 +124,144 @@ int writeBlock(int disk, int bNum, void *block);
 /* closeDisk() takes a disk number ‘disk’ and makes the disk closed to further I/O; i.e. any subsequent reads or writes to a closed disk should return an error. Closing a disk should also close the underlying file, committing any buffered writes. */
 void closeDisk(int disk);
 
+/* discardBlocks() tells the host file system that nBlocks blocks starting at bNum on disk
+ * ‘disk’ no longer hold data, punching them out of the backing file so they stop using
+ * space. The file keeps its size and the discarded range reads back as zeros. On success,
+ * it returns 0. -1 or smaller is returned if the disk is not open or the host can't punch
+ * holes, in which case the blocks keep their old contents.
+ */
+int discardBlocks(int disk, int bNum, int nBlocks);
+
+/* readBlocks() reads nBlocks consecutive blocks starting at bNum from disk ‘disk’ into
+ * ‘blocks’, which must hold nBlocks * BLOCKSIZE bytes, with a single seek and read. On
+ * success, it returns 0. -1 or smaller is returned if the disk is not open or the range
+ * runs past its end.
+ */
+int readBlocks(int disk, int bNum, int nBlocks, void *blocks);
+
+/* writeBlocks() writes nBlocks consecutive blocks from ‘blocks’ to disk ‘disk’ starting at
+ * bNum with a single write. On success, it returns 0. -1 or smaller is returned if the
+ * disk is not open, the range runs past its end or the write fails.
+ */
+int writeBlocks(int disk, int bNum, int nBlocks, void *blocks);
+
+/* syncDisk() makes every block written to disk ‘disk’ so far durable, flushing the
+ * buffered writes and calling fdatasync() on the backing file. Callers arriving while
+ * another one is syncing wait for it and then share a single fdatasync() for everything
+ * written up to then, and a caller with nothing written since the last sync returns
+ * straight away. On success, it returns 0. -1 or smaller is returned if the disk is not
+ * open or the host fails to sync.
+ */
+int syncDisk(int disk);
+
+
+/*	For libCompress.c	*/
+
+/* Most bytes lzCompress() can turn n bytes into */
+#define LZ_BOUND(n) ((n) + (n) / 255 + 16)
+
+/* lzCompress() compresses srcSize bytes from src into dst, which must have room for
+ * LZ_BOUND(srcSize) bytes, with a small LZ77 codec. Returns the compressed length. */
+int lzCompress(const char *src, int srcSize, char *dst);
+
+/* lzDecompress() decompresses srcSize bytes of lzCompress() output from src into dst,
+ * writing at most dstCapacity bytes. Returns the decompressed length, or -1 if the input
+ * is malformed or doesn't fit. */
+int lzDecompress(const char *src, int srcSize, char *dst, int dstCapacity);
+
+
+/*	For libPool.c	*/
+
+typedef struct poolSlab {
+	struct poolSlab *next;
+} PoolSlab;
+
+/* Fixed-size objects handed out from slabs. Set up with POOL_INIT(). */
+typedef struct pool {
+	size_t objectSize;				//	rounded up to keep every object pointer-aligned
+	int slabObjects;				//	objects in each new slab
+	void *freeObjects;				//	objects given back, linked through their first word
+	PoolSlab *slabs;				//	every slab, newest first, kept reachable
+	char *slabNext;					//	next never-used object of the newest slab
+	int slabLeft;					//	never-used objects left in it
+} Pool;
+
+/* An empty pool of objects of type 'type', taking slabObjects of them at a time */
+#define POOL_INIT(type, slabObjects) { \
+	(sizeof(type) + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *), \
+	(slabObjects), \
+	NULL, \
+	NULL, \
+	NULL, \
+	0 \
+}
+
+/* poolAlloc() returns an object from 'pool', which hands back freed objects first. */
+void *poolAlloc(Pool *pool);
+
+/* poolFree() gives an object from poolAlloc() back to 'pool' for reuse. */
+void poolFree(Pool *pool, void *object);
+
+/* poolReserve() makes the next count objects 'pool' carves out of a slab come from one
+ * allocation. */
+void poolReserve(Pool *pool, int count);
+
+
+/*	For libScan.c	*/
+
+/* Blocks a scan of the disk hands a worker at a time, read or written with one call.
+ * Chunks start on multiples of it, so each of those calls is aligned to its own size.
+ */
+#define SCAN_CHUNK_BLOCKS 256
+
+/* Alignment of each worker's scratch buffer, a page so direct I/O could use it */
+#define SCAN_BUFFER_ALIGN 4096
+
+/* Workers a scan runs per online CPU, so each CPU has a few requests in flight while the
+ * device works on others, and the most a scan runs at all
+ */
+#define SCAN_THREADS_PER_CPU 2
+#define SCAN_THREADS_MAX 32
+
+/* Work function of a scan, called for items [first, first + count) with the scratch
+ * buffer of the worker calling it. A negative return stops the scan.
+ */
+typedef int (*ScanFunction)(void *arg, int first, int count, char *scratch);
+
+/* One worker of a scan. It takes chunks from the front of its range and, once that is
+ * empty, steals the back half of another worker's.
+ */
+typedef struct scanWorker {
+	pthread_mutex_t lock;			//	guards next and end, which thieves move
+	int next;						//	first chunk of the range not yet taken
+	int end;						//	chunk after the range
+	int id;
+	char *scratch;
+	pthread_t thread;
+	struct scan *scan;
+} ScanWorker;
+
+typedef struct scan {
+	ScanFunction function;
+	void *arg;
+	int items;
+	int chunkItems;
+	int workerCount;
+	ScanWorker *workers;
+	pthread_mutex_t resultLock;
+	int result;						//	first negative return of the function, 0 if none
+} Scan;
+
+/* scanItems() calls 'function' over items [0, items) in chunks of chunkItems, spread over
+ * a pool of worker threads that steal chunks from each other, each with scratchSize
+ * bytes of scratch buffer. The calling thread is one of the workers, and a scan of a
+ * single chunk runs on it alone. Returns 0, or the first negative value 'function'
+ * returned, after which no more chunks are started. */
+int scanItems(int items, int chunkItems, size_t scratchSize, ScanFunction function, void *arg);
+
+/* scanThreads() returns the number of workers a scan of 'chunks' chunks runs. */
+int scanThreads(int chunks);
+
 
 /*	For libTinyFS.c	*/
 
@@ -52,7 +271,10 @@ enum blockCodes {
 	SUPERBLOCK = 1,
 	INODE = 2,
 	FILE_EXTENT = 3,
-	FREE = 4
+	FREE = 4,
+	SNAPSHOT = 5,
+	SNAPSHOT_INODE = 6,
+	DIRECTORY = 7
 };
 
 /* The superblock contains three different pieces of information. 
@@ -71,27 +293,333 @@ typedef struct superBlock {
 
 typedef struct inode {
 	char *name;
-	int size;
+	off_t size;
 	int filePermission;
 	struct blockNode *dataBlocks;	//	data block linked list
 	char *creationTimestamp;
 	char *modificationTimestamp;
 	char *accessTimestamp;
+	struct compressedExtent *extents;	//	compressed groups, NULL when stored as is
+	int directory;					//	1 for a directory, which has entries instead of data
+	int directoryRoot;				//	DIRECTORY block at the root of its B-tree, 0 if empty
+	int parentBlockNum;				//	inode block of the directory holding it
+	unsigned long generation;		//	tells apart the inodes one inode block has held
 } Inode;
 
+/* Minimum degree of the B-trees directories are kept in. Every node but the root holds
+ * DIRECTORY_DEGREE - 1 to DIRECTORY_NODE_ENTRIES entries sorted by name, so a lookup reads
+ * one block per level of the tree.
+ */
+#define DIRECTORY_DEGREE 6
+#define DIRECTORY_NODE_ENTRIES (2 * DIRECTORY_DEGREE - 1)
+
+typedef struct directoryEntry {
+	char name[9];
+	char directory;					//	so listing doesn't have to read the inode
+	int inodeBlockNum;
+} DirectoryEntry;
+
+/* A DIRECTORY block holds one B-tree node. The names under children[i] sort before
+ * entries[i] and those under children[i + 1] after it.
+ */
+typedef struct directoryNode {
+	int count;
+	int children[DIRECTORY_NODE_ENTRIES + 1];	//	all 0 in a leaf
+	DirectoryEntry entries[DIRECTORY_NODE_ENTRIES];
+} DirectoryNode;
+
+/* Slots in the path lookup cache. Each (directory, name) pair maps to one slot, and a new
+ * entry replaces whatever the slot held.
+ */
+#define DENTRY_CACHE_SIZE 1024
+
+typedef struct dentry {
+	int parentBlockNum;				//	0 for an empty slot
+	char name[9];
+	int inodeBlockNum;
+} Dentry;
+
+/* Entry returned by tfs_readdir_r(). The fields after 'directory' are only filled in for
+ * a stream opened with DIR_STAT.
+ */
+typedef struct dirEntry {
+	char name[9];
+	int directory;
+	off_t size;
+	int filePermission;
+	char *creationTimestamp;
+	char *modificationTimestamp;
+	char *accessTimestamp;
+} DirEntry;
+
+/* One operation of a tfs_batch() call. 'result' gets what the single-file function would
+ * return: a file descriptor or OPEN_FILE_FAILURE for BATCH_OPEN, STAT_FILE_SUCCESS or
+ * READ_FILE_INFO_FAILURE for BATCH_STAT and the tfs_makeRO()/tfs_makeRW() codes.
+ */
+typedef struct batchOp {
+	int op;							//	BATCH_* operation
+	char *name;
+	int result;
+	DirEntry info;					//	filled in by BATCH_STAT
+} BatchOp;
+
+/* Where tfs_batch() has got to with one operation */
+typedef struct batchSlot {
+	BatchOp *op;
+	char *path;						//	operation's name in the form canonicalPath() gives
+	int parentLength;				//	length of the path of the directory it is in
+	int inodeBlockNum;				//	-1 if missing, -2 if it can't be looked up
+} BatchSlot;
+
+/* An open directory stream. Each batch starts after the last name the one before it
+ * returned, so entries added or moved between batches can't make it skip or repeat any.
+ */
+typedef struct directoryStream {
+	dirDescriptor DD;
+	int inodeBlockNum;				//	directory being listed
+	char prefix[9];					//	only names starting with this are returned
+	int flags;						//	DIR_* flags the stream was opened with
+	char last[9];					//	last name returned, empty before the first batch
+	struct directoryStream *next;
+} DirectoryStream;
+
+/* An operation staged by an open transaction, applied when it commits */
+typedef struct stagedOp {
+	int op;							//	TXN_* operation
+	fileDescriptor FD;				//	file written or deleted
+	char *data;						//	copy of the content to write
+	int size;
+	char *oldName;					//	for renames
+	char *newName;
+	struct stagedOp *next;
+} StagedOp;
+
+/* Operations staged since tfs_begin(), in the order they were made */
+typedef struct transaction {
+	StagedOp *ops;
+	StagedOp *lastOp;
+} Transaction;
+
+/* A block written by a committing transaction, held in memory until the commit ends */
+typedef struct stagedBlock {
+	int blockNum;
+	char *data;
+} StagedBlock;
+
+/* The blocks a committing transaction has written, sorted by block number, so a commit
+ * costs memory and a pass in proportion to what it touched rather than to the disk
+ */
+typedef struct stagedBlocks {
+	StagedBlock *blocks;
+	int count;
+	int capacity;
+} StagedBlocks;
+
+/* One compressed group of a file's content, stored from the block after the previous
+ * group's last block. A group that didn't shrink is stored as is, with compressedSize
+ * equal to rawSize.
+ */
+typedef struct compressedExtent {
+	int rawSize;
+	int compressedSize;
+	struct compressedExtent *next;
+} CompressedExtent;
+
 typedef struct blockNode {
 	int blockNum;
 	struct blockNode *next;
 } BlockNode;
 
+/* blockNum of a data block list entry with no disk block behind it. A hole reads as zeros
+ * and gets a block the first time something is written into it. A list that ends before
+ * the file does has a hole for the rest of the file.
+ */
+#define HOLE_BLOCK -1
+
+/* A snapshot block holds one of these. Each file in the snapshot has a frozen read-only
+ * copy of its inode in a SNAPSHOT_INODE block, sharing the live file's data blocks until
+ * the live file writes over them.
+ */
+typedef struct snapshot {
+	char *name;
+	char *creationTimestamp;
+	int fileCount;
+	int *inodeBlocks;				//	SNAPSHOT_INODE block of each file
+} Snapshot;
+
+/* An entry on a file system's list of snapshots, so a snapshot is found by name without
+ * scanning the disk for SNAPSHOT blocks
+ */
+typedef struct snapshotNode {
+	char *name;						//	the snapshot's own name string
+	int blockNum;					//	its SNAPSHOT block
+	struct snapshotNode *next;
+} SnapshotNode;
+
+/* The live files a snapshot is taken of, found by walking the directory trees */
+typedef struct snapshotFiles {
+	int *inodeBlocks;
+	char **paths;					//	full path of each, in the form canonicalPath() gives
+	int count;
+	int capacity;
+} SnapshotFiles;
+
+/* Where the online defragmenter left off, so each tfs_defrag() step picks up from the
+ * previous one.
+ */
+typedef struct defragState {
+	int cursor;						//	next block to check for an inode
+	int inodeBlockNum;				//	file being moved, -1 between files
+	BlockNode *source;				//	block list the file is being moved off of
+	int targetBlock;				//	first block of the run it is moving onto
+	int length;						//	blocks in the file and the run
+	int copied;						//	blocks copied onto the run so far
+	int dirty;						//	block list changed since the move started
+	int moved;						//	files moved during the current pass
+} DefragState;
+
+/* Where the blocks of a log-structured file system are on disk. Everything above it keeps
+ * using the block numbers it always has, with an inode's block number as the file's
+ * identity, and each new version of a block is written at the log head. The block map
+ * finds the latest version of every block, so for inode blocks it is the inode map.
+ * Disk block 0 holds the superblock and segments start at disk block 1.
+ */
+typedef struct logState {
+	int *blockMap;					//	disk block holding each block, -1 if unwritten
+	int *diskBlockOwners;			//	block each disk block holds, -1 if it holds none
+	int *segmentLive;				//	disk blocks in each segment still holding a block
+	int segments;
+	int headSegment;				//	segment being written
+	int head;						//	next disk block the log writes
+	int cleaning;					//	cleaning to keep a segment clean, don't start again
+	int cleanedBlocks;				//	blocks the cleaner has moved
+} LogState;
+
+/* Log summary reported by tfs_logInfo() */
+typedef struct logInfo {
+	int segments;
+	int cleanSegments;				//	segments holding nothing, ready for the log head
+	int liveBlocks;
+	int deadBlocks;					//	old versions left behind in written segments
+	int cleanedBlocks;				//	live blocks moved by the cleaner
+} LogInfo;
+
+/* Entry of the dedup fingerprint index, filing a data block under a hash of its payload */
+typedef struct fingerprintNode {
+	uint64_t fingerprint;
+	int blockNum;
+	struct fingerprintNode *next;
+} FingerprintNode;
+
+/* Block sharing summary reported by tfs_dedupInfo() */
+typedef struct dedupInfo {
+	int logicalBlocks;				//	data blocks in all files' block lists
+	int physicalBlocks;				//	distinct blocks behind them
+	int hits;						//	block writes that found an identical block stored
+} DedupInfo;
+
+/* Layout summary reported by tfs_fragInfo() */
+typedef struct fragInfo {
+	int files;
+	int dataBlocks;
+	int extents;					//	runs of consecutive blocks across all files
+	int freeBlocks;
+	int freeExtents;				//	runs of consecutive blocks on the free list
+} FragInfo;
+
+/* Consistency report filled in by tfs_fsck(). Everything after usedBlocks counts a kind
+ * of inconsistency, so on a healthy file system those are all 0.
+ */
+typedef struct fsckInfo {
+	int blocks;						//	blocks checked
+	int freeBlocks;					//	on the free list
+	int usedBlocks;					//	reached from the superblock, the root or a snapshot
+	int badBlocks;					//	without the magic number
+	int doubleFree;					//	on the free list more than once
+	int freeInUse;					//	on the free list and reached as well
+	int leakedBlocks;				//	neither on the free list nor reached
+	int orphanInodes;				//	leaked inode blocks, files no directory holds
+	int wrongType;					//	reached as one kind of block but marked as another
+	int badReferences;				//	block numbers out of range, or metadata reached twice
+	int refCountErrors;				//	shared data blocks whose reference count is off
+	int logErrors;					//	block map entries out of step with the log
+} FsckInfo;
+
+/* Inodes whose block lists a tfs_fsck() worker walks at a time */
+#define FSCK_CHUNK_INODES 16
+
+/* What tfs_fsck() has found out so far about each block */
+typedef struct fsckState {
+	struct fileSystem *fileSystem;
+	char *types;					//	block code of each block, 0 without the magic number
+	char *freeListed;				//	times each block is on the free list
+	int *references;				//	times each block was reached
+	int *inodeBlocks;				//	inode blocks reached, whose block lists are walked
+	int inodeCount;
+	int inodeCapacity;
+	pthread_mutex_t lock;			//	guards info while workers add to it
+	FsckInfo *info;
+} FsckState;
+
+/* One read-only piece of a file returned by tfs_readView() */
+typedef struct viewSlice {
+	const char *data;
+	int length;
+} ViewSlice;
+
+/* Filled in by tfs_readView(). The slices cover the range in file order and stay valid
+ * until tfs_releaseView(), whatever happens to the file in the meantime.
+ */
+typedef struct readView {
+	ViewSlice *slices;
+	int count;
+	int length;						//	bytes covered by all the slices
+	char *pinned;					//	blocks the slices point into
+} ReadView;
+
+/* A range of a file mapped by tfs_mmap() */
+typedef struct mapping {
+	char *addr;						//	first byte of the range in memory
+	char *shadow;					//	range as last read or written back, NULL if read-only
+	int inodeBlockNum;
+	unsigned long generation;		//	of the inode mapped, so a reused block isn't written
+	off_t offset;					//	file offset of the range
+	int length;
+	struct mapping *next;
+} Mapping;
+
 typedef struct fileSystem {
-	int size;
+	off_t size;
 	int diskNum;
 	int openCount;
 	char *filename;
 	int mounted;
 	SuperBlock superblock;
 	struct dynamicResourceNode *dynamicResourceTable;
+	int delayedAllocation;			//	buffer appends until flush
+	DefragState defrag;
+	int discard;					//	punch freed blocks out of the image
+	int *refCounts;					//	block lists holding each block, 0 or 1 when not shared
+	int compression;				//	tfs_writeFile() compresses file content
+	int dedup;						//	identical data blocks are stored once
+	FingerprintNode **fingerprintIndex;	//	buckets of data blocks by payload hash
+	uint64_t *blockFingerprints;	//	fingerprint each block is indexed under, 0 if none
+	int dedupHits;
+	int logStructured;				//	blocks are written to a log, not in place
+	LogState log;
+	Dentry *dentryCache;			//	recent path component lookups
+	DirectoryStream *directoryStreams;	//	open tfs_opendir() streams
+	int openDirCount;
+	Transaction *transaction;		//	open tfs_begin() transaction, NULL when none
+	StagedBlocks *stagedBlocks;		//	blocks written by a committing transaction, NULL if none
+	int durability;					//	DURABILITY_* level
+	unsigned long dataGeneration;	//	bumped by every data block write and block list change
+	unsigned long inodeGeneration;	//	last generation given to a new inode
+	Mapping *mappings;				//	ranges mapped by tfs_mmap()
+	SnapshotNode *snapshots;		//	every snapshot, newest first
+	Pool blockNodePool;				//	every BlockNode of the free list and the block lists
+	Pool resourcePool;				//	DynamicResources of open handles
+	Pool resourceNodePool;			//	and the table nodes holding them
 } FileSystem;
 
 typedef struct fileSystemNode {
@@ -101,9 +629,25 @@ typedef struct fileSystemNode {
 
 typedef struct dynamicResource {
 	char *name;
-	int seekOffset;					//	current file pointer
+	off_t seekOffset;				//	current file pointer
 	fileDescriptor FD; 
 	int inodeBlockNum;
+	char *pendingData;				//	bytes written by tfs_writeByte() not yet on disk
+	off_t pendingOffset;			//	file offset of the first pending byte
+	int pendingSize;
+	int pendingCapacity;
+	int flags;						//	OPEN_* flags the file was opened with
+	BlockNode *tailHead;			//	block list the tail below was found in
+	BlockNode *tailBlock;			//	block the last flushed run ended in, NULL when not cached
+	int tailIndex;					//	index of that block in the block list
+	char *groupData;				//	decompressed group of a compressed file
+	CompressedExtent *groupExtent;	//	group held in groupData, NULL when none
+	off_t groupStart;				//	file offset of that group
+	char *readAheadData;			//	payloads of the blocks read ahead, NULL before any
+	int readAheadStart;				//	file block index of the first of them
+	int readAheadCount;				//	blocks in the window, 0 when none
+	int readAheadSize;				//	blocks to read ahead next time, 0 while reads look random
+	unsigned long readAheadGeneration;	//	dataGeneration the window was read at
 } DynamicResource;
 
 typedef struct dynamicResourceNode {
@@ -112,26 +656,347 @@ typedef struct dynamicResourceNode {
 } DynamicResourceNode;
 
 /* Makes a blank TinyFS file system of size nBytes on the file specified by ‘filename’. This function should use the emulated disk library to open the specified file, and upon success, format the file to be mountable. This includes initializing all data to 0x00, setting magic numbers, initializing and writing the superblock and inodes, etc. Must return a specified success/error code. */
-int tfs_mkfs(char *filename, int nBytes);
+int tfs_mkfs(char *filename, off_t nBytes);
+
+/* Same as tfs_mkfs(), with MKFS_* flags for the new file system. With MKFS_COMPRESS every
+ * tfs_writeFile() compresses the file's content in groups of COMPRESS_GROUP_SIZE bytes,
+ * and reads decompress a group at a time. Writes that change part of a compressed file
+ * first store it uncompressed, and it is compressed again when the handle it was written
+ * through is closed or synced.
+ * With MKFS_DEDUP every data block written looks its payload up in a fingerprint index
+ * first. When a block with the same contents is already stored the file takes another
+ * reference to it instead of writing a copy; freeing a file only drops its references.
+ * Index hits are checked against the stored block, so hash collisions are harmless.
+ * With MKFS_LOG no block is updated in place: every write, of data and inodes alike, goes
+ * to the next block at the head of a log, and the old version becomes dead space that
+ * tfs_clean() reclaims a segment at a time. LOG_RESERVED_SEGMENTS of the disk are held
+ * back for the cleaner, and nBytes must leave at least one segment on top of those.
+ */
+int tfs_mkfsFlags(char *filename, off_t nBytes, int flags);
 
 /* tfs_mount(char *filename) “mounts” a TinyFS file system located within ‘filename’. tfs_unmount(void) “unmounts” the currently mounted file system. As part of the mount operation, tfs_mount should verify the file system is the correct type. Only one file system may be mounted at a time. Use tfs_unmount to cleanly unmount the currently mounted file system. Must return a specified success/error code. */
 int tfs_mount(char *filename);
 int tfs_unmount(void);
 
+/* Names passed to the functions below are paths of directory names separated by '/', each
+ * up to 8 characters, starting from the root directory whether or not they begin with '/'.
+ * Directories are created with tfs_mkdir() and must exist before anything is created in
+ * them.
+ */
+
 /* Opens a file for reading and writing on the currently mounted file system. Creates a dynamic resource table entry for the file, and returns a file descriptor (integer) that can be used to reference this file while the filesystem is mounted. */
 fileDescriptor tfs_openFile(char *name);
 
+/* Same as tfs_openFile(), with OPEN_* flags for the new handle. With OPEN_APPEND every
+ * tfs_writeByte() on the handle appends to the end of the file regardless of the file
+ * pointer. The handle caches the block its last run of bytes ended in, so an append costs
+ * the same however long the file is instead of walking the block list each time. With
+ * OPEN_SYNC every write, truncate or delete through the handle is durable when it returns,
+ * whatever the file system's durability level, and bytes held back on the handle are
+ * flushed first.
+ */
+fileDescriptor tfs_openFileFlags(char *name, int flags);
+
+/* Creates directory 'path' on the mounted file system. Its parent must already exist.
+ * Returns success/error codes.
+ */
+int tfs_mkdir(char *path);
+
+/* Opens a stream over the entries of directory 'path' for tfs_readdir_r(). Only names
+ * starting with 'prefix' are returned, or every name if it is NULL or empty. With
+ * DIR_STAT each entry also carries its inode's size, permission and timestamps, at the
+ * cost of reading the inode. Returns a directory descriptor or an error code.
+ */
+dirDescriptor tfs_opendir(char *path, char *prefix, int flags);
+
+/* Fills up to 'count' entries of 'entries' with the stream's next entries in name order.
+ * A batch reads the directory's B-tree from the root down to where the previous batch
+ * stopped and on from there, without visiting the names before it. Returns the number of
+ * entries filled, 0 once the stream is exhausted, or an error code.
+ */
+int tfs_readdir_r(dirDescriptor DD, DirEntry *entries, int count);
+
+/* Closes a directory stream. Returns success/error codes. */
+int tfs_closedir(dirDescriptor DD);
+
+/* Applies 'count' operations on the mounted file system at once, setting each one's
+ * result. Names are looked up in path order, so a directory holding several of them is
+ * resolved once for all of them, and BATCH_OPEN creates names that don't exist. Then every
+ * inode is read once and, if an operation changed it, written once, in block number
+ * order. Returns BATCH_SUCCESS if every operation succeeded and BATCH_FAILURE otherwise.
+ */
+int tfs_batch(BatchOp *ops, int count);
+
+/* Starts a transaction on the mounted file system. Until tfs_commit() or tfs_abort(),
+ * tfs_writeFile(), tfs_rename() and tfs_deleteFile() only check their arguments and stage
+ * the operation in memory, returning their usual codes; everything else, reads included,
+ * still sees the file system as it was before the transaction. The other ways of changing
+ * file content, tfs_writeByte(), tfs_writev(), tfs_pwritev(), tfs_truncate(),
+ * tfs_fallocate(), tfs_copyFile() and writing back a tfs_mmap() range, can't be staged
+ * and fail while a transaction is open. Returns success/error codes.
+ */
+int tfs_begin(void);
+
+/* Applies the staged operations in order. They are checked again first, against each
+ * other and against what is now on disk, including whether there are enough free blocks
+ * for the writes, and if any would fail the transaction is dropped with nothing written.
+ * Otherwise every block they write is held in memory, so a block written several times,
+ * like an inode rewritten by each step of a tfs_writeFile(), is only written once, and
+ * the blocks go out in one pass in block number order, data blocks before the inodes
+ * and directory blocks pointing to them. An error past the checks, such as a failed block
+ * write, still writes out the operations applied before it. Either way the transaction
+ * is over. The commit is atomic against other calls but not against a crash: there is
+ * no journal and the blocks are written in place, so a crash part way through the final
+ * pass leaves the image with only part of the transaction. Since block lists only live
+ * in memory, such an image can't be mounted again anyway. Returns success/error codes.
+ */
+int tfs_commit(void);
+
+/* Drops the staged operations without doing any disk I/O. Returns success/error codes. */
+int tfs_abort(void);
+
 /* Closes the file, de-allocates all system/disk resources, and removes table entry */
 int tfs_closeFile(fileDescriptor FD);
 
 /* Writes buffer ‘buffer’ of size ‘size’, which represents an entire file’s content, to the file system. Sets the file pointer to 0 (the start of file) when done. Returns success/error codes. */
 int tfs_writeFile(fileDescriptor FD,char *buffer, int size);
 
-/* deletes a file and marks its blocks as free on disk. */
+/* deletes a file's content and marks its blocks as free. Only the inode is written; freed
+ * blocks keep their old contents as garbage until they are reused. */
 int tfs_deleteFile(fileDescriptor FD);
 
-/* reads one byte from the file and copies it to buffer, using the current file pointer location and incrementing it by one upon success. If the file pointer is already at the end of the file then tfs_readByte() should return an error and not increment the file pointer. */
+/* reads one byte from the file and copies it to buffer, using the current file pointer location and incrementing it by one upon success. If the file pointer is already at the end of the file then tfs_readByte() should return an error and not increment the file pointer.
+ * Each handle watches which blocks it reads. When a read needs the block right after the
+ * ones it read last, or the first block, the handle reads that block and the next
+ * READ_AHEAD_MIN in one go, reading twice as many each time the pattern holds, up to
+ * READ_AHEAD_MAX; a read anywhere else turns read-ahead off until reads are sequential
+ * again. Blocks read ahead are dropped as soon as any file's data changes. */
 int tfs_readByte(fileDescriptor FD, char *buffer);
 
-/* change the file pointer location to offset (absolute). Returns success/error codes.*/
-int tfs_seek(fileDescriptor FD, int offset);
\ No newline at end of file
+/* Fills 'view' with slices covering len bytes of the file from 'offset' without copying
+ * them out. The blocks of the range are read into a buffer the view keeps, one read per
+ * run of consecutive blocks, and each slice points at the payload of one block past its
+ * type and magic bytes; holes are zeros. A compressed file gets one slice per group,
+ * decompressed straight into that buffer. A range past the end of file is cut short
+ * there. The file pointer doesn't move. Returns success/error codes.
+ */
+int tfs_readView(fileDescriptor FD, off_t offset, int len, ReadView *view);
+
+/* Frees what tfs_readView() pinned for 'view'. It may be called after the file is closed
+ * or the file system unmounted. Returns success/error codes.
+ */
+int tfs_releaseView(ReadView *view);
+
+/* Maps len bytes of the file from 'offset' into one contiguous range of memory and
+ * returns its address, or NULL on error. Blocks carry a header, so the image can't be
+ * mapped as it is: the range is read in once, the way tfs_readView() reads it, and
+ * after that every access is a plain memory access. Without MMAP_WRITE the range is
+ * read-only and writing to it faults. Bytes past the end of file read as zeros and are
+ * never written back. The mapping lasts until tfs_munmap() or the unmount of the file
+ * system, even if the file is closed.
+ */
+void *tfs_mmap(fileDescriptor FD, off_t offset, int len, int prot);
+
+/* Writes back the changes made to the mapping holding 'addr', one writeDataBlocks()
+ * per run of changed bytes, then syncs the image. Bytes nobody wrote to in memory are
+ * left alone, so writes made to them through file handles stay. A compressed file is
+ * compressed again once the changes are in. If the file's inode block has been given to
+ * another file since the range was mapped, the changes have nowhere to go and are
+ * dropped. Returns success/error codes.
+ */
+int tfs_msync(void *addr);
+
+/* Writes back the mapping holding 'addr' like tfs_msync() without syncing, and unmaps
+ * it. Returns success/error codes.
+ */
+int tfs_munmap(void *addr);
+
+/* Replaces the content of file 'name', which is created if it doesn't exist, with the
+ * content of the host file at 'hostPath'. The host file is read HOST_COPY_CHUNK bytes at a
+ * time and each chunk lands in one writeDataBlocks() call, so a file of any size streams
+ * through a fixed buffer and no byte goes through tfs_writeByte(). On a compressing file
+ * system each chunk is compressed on its way through, in the same groups tfs_writeFile()
+ * would make. An import can't be staged, so it fails inside a transaction. Returns
+ * success/error codes.
+ */
+int tfs_importFile(char *hostPath, char *name);
+
+/* Writes the content of file 'name' to the host file at 'hostPath', replacing whatever
+ * was there. The file is read HOST_COPY_CHUNK bytes at a time through tfs_readView() and
+ * each chunk's slices go to the host file in one writev(), so the block payloads are
+ * never copied into a buffer. Returns success/error codes.
+ */
+int tfs_exportFile(char *name, char *hostPath);
+
+/* Copies up to len bytes of the file from byte 'offset' into buffer without using or
+ * moving the file pointer, the way pread() does. It reads through the same run reads as
+ * tfs_readView(), but only reads: bytes other handles still hold are copied from them
+ * rather than flushed, and the access time isn't updated. So any number of threads may
+ * call it on the same FD at once, as long as nothing changes the file system meanwhile.
+ * Reading stops at the end of file. Returns the number of bytes read or an error code.
+ */
+int tfs_pread(fileDescriptor FD, char *buffer, int len, off_t offset);
+
+/* Reads into the iovcnt buffers of 'iov', in order, from the file pointer location and
+ * moves it past what was read, the way readv() does. The range is read through
+ * tfs_readView() and each block's payload is copied straight into the buffers it spans.
+ * Reading stops at the end of file. Returns the number of bytes read or an error code.
+ */
+int tfs_readv(fileDescriptor FD, const struct iovec *iov, int iovcnt);
+
+/* Same as tfs_readv() from byte 'offset'. The file pointer doesn't move. */
+int tfs_preadv(fileDescriptor FD, const struct iovec *iov, int iovcnt, off_t offset);
+
+/* Writes the iovcnt buffers of 'iov', in order, at the file pointer location (the end of
+ * file for an OPEN_APPEND handle) and moves it past them, the way writev() does. Each
+ * block the write touches is filled from the buffers it spans and written once, and the
+ * inode is written once per call, however many buffers there are. Writing past the end
+ * of file leaves a hole, as tfs_writeByte() does. Returns the number of bytes written or
+ * an error code.
+ */
+int tfs_writev(fileDescriptor FD, const struct iovec *iov, int iovcnt);
+
+/* Same as tfs_writev() at byte 'offset'. The file pointer doesn't move, even on an
+ * OPEN_APPEND handle.
+ */
+int tfs_pwritev(fileDescriptor FD, const struct iovec *iov, int iovcnt, off_t offset);
+
+/* change the file pointer location to offset (absolute). The offset may be past the end
+ * of file. Returns success/error codes.*/
+int tfs_seek(fileDescriptor FD, off_t offset);
+
+/* writes one byte at the current file pointer location and increments it by one. The byte
+ * may overwrite existing data or be appended at the end of the file. Writing past the end
+ * of file leaves a hole that reads as zeros and only allocates the block the byte lands in.
+ * Consecutive bytes landing in the same block are held on the handle and the block is
+ * read and written once, when a byte goes to another block or somewhere else in the file,
+ * or the handle is flushed by a seek, read, close, sync or anything else that looks at
+ * the file's content or size. A run that goes on from the block the handle last wrote,
+ * such as an append, starts from that block and never re-walks the file's block map. */
+int tfs_writeByte(fileDescriptor FD, unsigned int data);
+
+/* Reserves data blocks for the byte range [offset, offset + len) of an open file so that
+ * later writes land in blocks laid out up front. Blocks are taken from the free list as
+ * one contiguous run whenever the disk has one. The file size is not changed; reserved
+ * blocks past the end of file are filled by later appends, and holes inside the file are
+ * filled with zeros. Returns success/error codes.
+ */
+int tfs_fallocate(fileDescriptor FD, off_t offset, off_t len);
+
+/* Sets the size of an open file to len bytes. Shrinking releases the blocks past the new
+ * end of file, including any reserved by tfs_fallocate(); extending leaves a hole that
+ * reads as zeros and takes no blocks. Returns success/error codes.
+ */
+int tfs_truncate(fileDescriptor FD, off_t len);
+
+/* Turns delayed allocation on (1) or off (0) for the mounted file system. While it is on,
+ * bytes appended with tfs_writeByte() are held on the file handle and blocks are only
+ * assigned when the handle is flushed (seek, read, close, unmount, or the buffer filling
+ * up), so the allocator sees the whole extent at once. Turning it off flushes every open
+ * handle. Returns success/error codes.
+ */
+int tfs_setDelayedAlloc(int enabled);
+
+/* Turns discard on (1) or off (0) for the mounted file system. While it is on, blocks freed
+ * by deleting, rewriting or defragmenting files are punched out of the backing image with
+ * discardBlocks(), one call per run of consecutive blocks. On a log-structured file
+ * system a segment is punched out once it holds no live blocks. Returns success/error codes.
+ */
+int tfs_setDiscard(int enabled);
+
+/* Runs one step of the online defragmenter on the mounted file system, doing at most
+ * 'budget' block reads and writes (at least 2, one block copy) so it can be interleaved
+ * with normal file operations.
+ * Each file is copied onto the lowest run of free blocks that holds it whole when that
+ * makes it contiguous or moves it toward the start of the disk, which pushes free space
+ * toward the end. A file's block list is only switched over once every block has been
+ * copied; a file written to during its move is left where it was and retried on the next
+ * pass. Returns DEFRAG_IN_PROGRESS while there is more to do and DEFRAG_COMPLETE once a
+ * whole pass over the disk moves nothing. A log-structured file system lays blocks out in
+ * the order they are written, so there it returns DEFRAG_COMPLETE straight away.
+ */
+int tfs_defrag(int budget);
+
+/* Sets how hard the mounted file system works to make changes durable. Writes go to the
+ * image through stdio, so at DURABILITY_NONE, the default, a change may sit in a buffer
+ * until the disk is closed. DURABILITY_CLOSE syncs the image when a file is closed or the
+ * file system unmounted. DURABILITY_SYNC syncs it before every operation that changed
+ * something returns; operations that finish together share one fdatasync() (see
+ * syncDisk()), and a transaction syncs once when it commits. Returns success/error codes.
+ */
+int tfs_setDurability(int level);
+
+/* Makes everything written to the mounted file system so far durable, including bytes
+ * held back by delayed allocation. Returns success/error codes.
+ */
+int tfs_sync(void);
+
+/* Makes an open file's changes durable, including bytes its handle holds back. Blocks of
+ * one file system share an image, so other files' writes are synced along with them.
+ * Returns success/error codes.
+ */
+int tfs_fsync(fileDescriptor FD);
+
+/* Fills 'info' with file and free space fragmentation counts for the mounted file system.
+ * Returns success/error codes.
+ */
+int tfs_fragInfo(FragInfo *info);
+
+/* Runs the segment cleaner of a log-structured file system for at most 'budget' block
+ * reads and writes (at least 2, one block move), so it can run between file operations.
+ * It picks the segment with the fewest live blocks, moves those to the log head and
+ * leaves the segment clean for the head to reuse. The log also cleans a segment itself
+ * when it runs out of clean ones. Returns CLEAN_IN_PROGRESS while some segment still has
+ * dead blocks and CLEAN_COMPLETE once none does.
+ */
+int tfs_clean(int budget);
+
+/* Fills 'info' with segment and block counts for the mounted log-structured file system.
+ * Returns success/error codes.
+ */
+int tfs_logInfo(LogInfo *info);
+
+/* Fills 'info' with how many data blocks the mounted file system's files hold and how
+ * many distinct blocks those are, so logicalBlocks / physicalBlocks is the dedup ratio.
+ * Returns success/error codes.
+ */
+int tfs_dedupInfo(DedupInfo *info);
+
+/* Copies file 'source' to 'dest' without copying any data: 'dest' gets a block list holding
+ * the same blocks, and whichever of the two files is written to first gets new blocks for
+ * the parts it writes. 'dest' is created if it doesn't exist, otherwise its content is
+ * replaced. Returns success/error codes.
+ */
+int tfs_copyFile(char *source, char *dest);
+
+/* Takes a point-in-time, read-only snapshot of every file on the mounted file system
+ * under 'name'. Only metadata is written: each file gets a frozen copy of its inode that
+ * shares the file's data blocks, and later writes to the live file go to new blocks,
+ * leaving the shared ones to the snapshot. The files are found through the directory
+ * trees, so taking a snapshot costs time in the number of files and directories, not in
+ * the size of the disk. Returns success/error codes.
+ */
+int tfs_snapshot(char *name);
+
+/* Opens file 'name' as it was when snapshot 'snapshotName' was taken. The handle reads
+ * like any other but every write through it fails. Returns a file descriptor or an error
+ * code.
+ */
+fileDescriptor tfs_openSnapshotFile(char *snapshotName, char *name);
+
+/* Deletes a snapshot, freeing the blocks only it still holds. Fails while any of its
+ * files are open. Returns success/error codes.
+ */
+int tfs_deleteSnapshot(char *name);
+
+/* Checks the mounted file system for consistency and fills 'info' with what it found.
+ * Every block is read in SCAN_CHUNK_BLOCKS runs by a pool of threads to check its magic
+ * number and type. Then everything reachable is followed: the directory trees from the
+ * root, each snapshot's inodes and every block list, the last split over the pool as
+ * well. Each block must end up either on the free list or reached exactly once, with
+ * data blocks shared by several lists counted in the block's reference count. Blocks
+ * that are neither are leaked, and a leaked inode is an orphan file. Nothing is
+ * repaired. Returns FSCK_SUCCESS for a consistent file system, FSCK_INCONSISTENT if
+ * anything was found, or an error code.
+ */
+int tfs_fsck(FsckInfo *info);
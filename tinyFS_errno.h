@@ -1,3 +1,33 @@
+#define		FSCK_SUCCESS		49
+#define		EXPORT_SUCCESS		48
+#define		IMPORT_SUCCESS		47
+#define		MUNMAP_SUCCESS		46
+#define		MSYNC_SUCCESS		45
+#define		RELEASE_VIEW_SUCCESS	44
+#define		READ_VIEW_SUCCESS	43
+#define		SYNC_SUCCESS		42
+#define		DURABILITY_SUCCESS	41
+#define		ABORT_SUCCESS		40
+#define		COMMIT_SUCCESS		39
+#define		BEGIN_SUCCESS		38
+#define		BATCH_SUCCESS		37
+#define		STAT_FILE_SUCCESS	36
+#define		CLOSE_DIR_SUCCESS	35
+#define		MKDIR_SUCCESS		34
+#define		LOG_INFO_SUCCESS	33
+#define		CLEAN_COMPLETE		32
+#define		CLEAN_IN_PROGRESS	31
+#define		DEDUP_INFO_SUCCESS	30
+#define		COPY_FILE_SUCCESS	29
+#define		DELETE_SNAPSHOT_SUCCESS	28
+#define		SNAPSHOT_SUCCESS	27
+#define		TRUNCATE_SUCCESS	26
+#define		DISCARD_SUCCESS		25
+#define		FRAG_INFO_SUCCESS	24
+#define		DEFRAG_COMPLETE		23
+#define		DEFRAG_IN_PROGRESS	22
+#define		DELAYED_ALLOC_SUCCESS	21
+#define		FALLOCATE_SUCCESS	20
 #define		WRITE_BYTE_SUCCESS     19
 #define		MAKE_RW_SUCCESS     18
 #define		MAKE_RO_SUCCESS     17
@@ -33,4 +63,39 @@
 #define		READ_FILE_INFO_FAILURE	-19
 #define		READ_DIR_FAILURE	-20
 #define		REMOVE_DYNAMIC_RESOURCE_ERROR	-21
-
+#define		FALLOCATE_FAILURE	-22
+#define		DELAYED_ALLOC_FAILURE	-23
+#define		DEFRAG_FAILURE		-24
+#define		FRAG_INFO_FAILURE	-25
+#define		DISCARD_FAILURE		-26
+#define		DISCARD_BLOCKS_FAILURE	-27
+#define		TRUNCATE_FAILURE	-28
+#define		SNAPSHOT_FAILURE	-29
+#define		OPEN_SNAPSHOT_FILE_FAILURE	-30
+#define		DELETE_SNAPSHOT_FAILURE	-31
+#define		COPY_FILE_FAILURE	-32
+#define		DEDUP_INFO_FAILURE	-33
+#define		CLEAN_FAILURE		-34
+#define		LOG_INFO_FAILURE	-35
+#define		MKDIR_FAILURE		-36
+#define		OPEN_DIR_FAILURE	-37
+#define		READ_DIR_R_FAILURE	-38
+#define		CLOSE_DIR_FAILURE	-39
+#define		BATCH_FAILURE		-40
+#define		BEGIN_FAILURE		-41
+#define		COMMIT_FAILURE		-42
+#define		ABORT_FAILURE		-43
+#define		SYNC_DISK_FAILURE	-44
+#define		DURABILITY_FAILURE	-45
+#define		SYNC_FAILURE		-46
+#define		READ_VIEW_FAILURE	-47
+#define		RELEASE_VIEW_FAILURE	-48
+#define		MSYNC_FAILURE		-49
+#define		MUNMAP_FAILURE		-50
+#define		IMPORT_FAILURE		-51
+#define		EXPORT_FAILURE		-52
+#define		READV_FAILURE		-53
+#define		WRITEV_FAILURE		-54
+#define		PREAD_FAILURE		-55
+#define		FSCK_FAILURE		-56
+#define		FSCK_INCONSISTENT	-57
@@ -0,0 +1,96 @@
+#include <time.h>
+
+#include "tinyFS.h"
+#include "tinyFS_errno.h"
+
+#define PLAIN_DISK_NAME "testing/dedup-off.bin"
+#define DEDUP_DISK_NAME "testing/dedup-on.bin"
+
+double writeFiles(char *diskName, int flags, int fileCount, int fileBlocks);
+
+/* Write throughput with and without block deduplication. Formats one image plain and one
+ * with MKFS_DEDUP, and each time writes 'files' files of 'file blocks' blocks built
+ * from the same template, where every eighth block is unique to its file, as generated
+ * files and copies with small edits tend to be. Reports MB/s and how many blocks were
+ * actually stored.
+ *
+ *	usage: tinyFsDedupBench [files] [file blocks]
+ */
+int main(int argc, char *argv[]) {
+	int fileCount = 16, fileBlocks = 64;
+	double plain, dedup;
+
+	if(argc > 1) fileCount = atoi(argv[1]);
+	if(argc > 2) fileBlocks = atoi(argv[2]);
+
+	if(fileCount < 1 || fileBlocks < 1) {
+		fprintf(stderr, "usage: %s [files >= 1] [file blocks >= 1]\n", argv[0]);
+		return 1;
+	}
+
+	if((plain = writeFiles(PLAIN_DISK_NAME, 0, fileCount, fileBlocks)) < 0 ||
+			(dedup = writeFiles(DEDUP_DISK_NAME, MKFS_DEDUP, fileCount, fileBlocks)) < 0) {
+		return 1;
+	}
+
+	printf("dedup off: %.1f MB/s\n", plain);
+	printf("dedup on: %.1f MB/s\n", dedup);
+
+	return 0;
+}
+
+/* Formats and fills the image, returning the write throughput in MB/s or -1 on failure */
+double writeFiles(char *diskName, int flags, int fileCount, int fileBlocks) {
+	struct timespec start, end;
+	DedupInfo info;
+	char name[16], *buffer;
+	int file, block, size = fileBlocks * (BLOCKSIZE - 2);
+	double seconds;
+
+	//	room for every block stored twice over, plus the inodes
+	if(tfs_mkfsFlags(diskName, BLOCKSIZE * (2 * fileCount * (fileBlocks + 1) + 2), flags) < 0 ||
+			tfs_mount(diskName) < 0) {
+		fprintf(stderr, "could not make %s\n", diskName);
+		return -1;
+	}
+
+	buffer = malloc(size);
+
+	for(block = 0; block < fileBlocks; block++) {
+		memset(&buffer[block * (BLOCKSIZE - 2)], 'a' + block % 26, BLOCKSIZE - 2);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for(file = 0; file < fileCount; file++) {
+		sprintf(name, "file %d", file);
+
+		//	stamp this file's number on every eighth block
+		for(block = 0; block < fileBlocks; block += 8) {
+			sprintf(&buffer[block * (BLOCKSIZE - 2)], "%d", file);
+		}
+
+		if(tfs_writeFile(tfs_openFile(name), buffer, size) < 0) {
+			fprintf(stderr, "write failed on %s\n", name);
+			free(buffer);
+			return -1;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	free(buffer);
+
+	if(tfs_dedupInfo(&info) < 0) {
+		return -1;
+	}
+
+	printf("dedup %s: %d blocks written, %d stored (%.2fx)\n", flags & MKFS_DEDUP ? "on" : "off",
+		info.logicalBlocks, info.physicalBlocks, (double)info.logicalBlocks / info.physicalBlocks);
+
+	tfs_unmount();
+
+	seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	return (double)fileCount * size / (1024 * 1024) / seconds;
+}
@@ -0,0 +1,88 @@
+#include "tinyFS.h"
+#include "tinyFS_errno.h"
+
+#define DEFRAG_DISK_NAME "testing/defrag.bin"
+#define DEFRAG_FILES 6
+
+void printFragInfo(char *label);
+
+/* Small command line front end for the online defragmenter. File systems only live in
+ * the process that made them, so it formats an image, fragments it by growing several
+ * files a byte at a time side by side and shrinking some of them, then defragments it
+ * in steps of 'budget' block I/Os (default 16, at least 2), reporting the layout as it
+ * goes.
+ *
+ *	usage: tinyFsDefrag [budget] [disk blocks]
+ */
+int main(int argc, char *argv[]) {
+	int budget = 16, diskBlocks = 64;
+	int files[DEFRAG_FILES];
+	char name[9], shrunk[BLOCKSIZE];
+	int file, i, result, steps = 0;
+
+	if(argc > 1) budget = atoi(argv[1]);
+	if(argc > 2) diskBlocks = atoi(argv[2]);
+
+	if(budget < 2 || diskBlocks < DEFRAG_FILES * 8) {
+		fprintf(stderr, "usage: %s [budget >= 2] [disk blocks >= %d]\n", argv[0], DEFRAG_FILES * 8);
+		return 1;
+	}
+
+	if(tfs_mkfs(DEFRAG_DISK_NAME, BLOCKSIZE * diskBlocks) < 0 || tfs_mount(DEFRAG_DISK_NAME) < 0) {
+		fprintf(stderr, "could not make %s\n", DEFRAG_DISK_NAME);
+		return 1;
+	}
+
+	for(file = 0; file < DEFRAG_FILES; file++) {
+		sprintf(name, "file %d", file);
+		files[file] = tfs_openFile(name);
+	}
+
+	//	growing every file one byte at a time interleaves their blocks
+	for(i = 0; i < (BLOCKSIZE - 2) * (diskBlocks / (DEFRAG_FILES * 2)); i++) {
+		for(file = 0; file < DEFRAG_FILES; file++) {
+			tfs_writeByte(files[file], 'a' + file);
+		}
+	}
+
+	//	shrinking every other file leaves holes in free space
+	memset(shrunk, 'z', sizeof(shrunk));
+
+	for(file = 0; file < DEFRAG_FILES; file += 2) {
+		tfs_writeFile(files[file], shrunk, sizeof(shrunk));
+	}
+
+	printFragInfo("before");
+
+	while((result = tfs_defrag(budget)) == DEFRAG_IN_PROGRESS) {
+		steps++;
+	}
+
+	if(result < 0) {
+		fprintf(stderr, "defrag failed... %d\n", result);
+		return 1;
+	}
+
+	printf("Defragmented in %d steps of %d block I/Os\n", steps + 1, budget);
+
+	printFragInfo("after");
+
+	for(file = 0; file < DEFRAG_FILES; file++) {
+		tfs_closeFile(files[file]);
+	}
+
+	tfs_unmount();
+
+	return 0;
+}
+
+void printFragInfo(char *label) {
+	FragInfo info;
+
+	if(tfs_fragInfo(&info) < 0) {
+		return;
+	}
+
+	printf("%s: %d files, %d data blocks in %d extents, %d free blocks in %d extents\n",
+		label, info.files, info.dataBlocks, info.extents, info.freeBlocks, info.freeExtents);
+}
@@ -8,12 +8,59 @@ void libTinyFSCoreDemo();
 void fileRenameDemo();
 void timeStampDemo();
 void permissionsDemo();
+void preallocationDemo();
+void discardDemo();
+void truncateDemo();
+void sparseDemo();
+void snapshotDemo();
+void copyFileDemo();
+void compressionDemo();
+void dedupDemo();
+void logDemo();
+void directoryDemo();
+void directoryStreamDemo();
+void batchDemo();
+void transactionDemo();
+void durabilityDemo();
+void readAheadDemo();
+void writeBufferDemo();
+void readViewDemo();
+void mmapDemo();
+void hostCopyDemo();
+void vectorDemo();
+void preadDemo();
+void *preadRecords(void *arg);
+void largeFileDemo();
+void fsckDemo();
 
 int main(int argc, char *argv[]) {
 	libTinyFSCoreDemo();
 	fileRenameDemo();
 	permissionsDemo();
 	timeStampDemo();
+	preallocationDemo();
+	discardDemo();
+	truncateDemo();
+	sparseDemo();
+	snapshotDemo();
+	copyFileDemo();
+	compressionDemo();
+	dedupDemo();
+	logDemo();
+	directoryDemo();
+	directoryStreamDemo();
+	batchDemo();
+	transactionDemo();
+	durabilityDemo();
+	readAheadDemo();
+	writeBufferDemo();
+	readViewDemo();
+	mmapDemo();
+	hostCopyDemo();
+	vectorDemo();
+	preadDemo();
+	largeFileDemo();
+	fsckDemo();
 	return 0;
 }
 
@@ -110,8 +157,11 @@ void libTinyFSCoreDemo() {
 	printf("Throws an error if reading past end of file... %d\n",
 		tfs_readByte(file1, &readByteBuffer));
 
-	printf("Throws an error if seeking past end of file... %d\n",
+	printf("Seeking past end of file... %d\n",
 		tfs_seek(file1, largeWriteSize + 2));
+
+	printf("Throws an error if seeking before the start of file... %d\n",
+		tfs_seek(file1, -1));
 }
 
 void fileRenameDemo() {
@@ -186,9 +236,9 @@ void timeStampDemo() {
 
 	printf("\nFile TimeStamp Demonstration\n\n");
 
-	tfs_mkfs("testing/filePermissions.bin", BLOCKSIZE * 10);
+	tfs_mkfs("testing/fileTimeStamps.bin", BLOCKSIZE * 10);
 
-	tfs_mount("testing/filePermissions.bin");
+	tfs_mount("testing/fileTimeStamps.bin");
 
 	file1 = tfs_openFile("File 1");
 
@@ -242,4 +292,1140 @@ void timeStampDemo() {
 
 	printf("Updating file 2 modify time when deleting file...\n\n");
 	tfs_readFileInfo(file2);
-}
\ No newline at end of file
+}
+
+void preallocationDemo() {
+	int file1, file2, i;
+	char readByteBuffer;
+
+	printf("\nPreallocation and Delayed Allocation Demonstration\n\n");
+
+	tfs_mkfs("testing/preallocation.bin", BLOCKSIZE * 20);
+
+	tfs_mount("testing/preallocation.bin");
+
+	file1 = tfs_openFile("File 1");
+	file2 = tfs_openFile("File 2");
+
+	printf("Reserving 4 blocks for a file... %d\n",
+		tfs_fallocate(file1, 0, (BLOCKSIZE - 2) * 4));
+
+	printf("Throws an error when reserving an empty range... %d\n",
+		tfs_fallocate(file1, 0, 0));
+
+	printf("Appending a byte into the reserved blocks... %d\n",
+		tfs_writeByte(file1, 'A'));
+
+	printf("Throws an error when reserving more than the disk holds... %d\n",
+		tfs_fallocate(file1, 0, BLOCKSIZE * 40));
+
+	printf("Turning on delayed allocation... %d\n",
+		tfs_setDelayedAlloc(1));
+
+	for(i = 0; i < BLOCKSIZE * 2; i++) {
+		tfs_writeByte(file2, 'D');
+	}
+
+	tfs_writeByte(file2, 'E');
+
+	printf("Seeking flushes the appended bytes to disk... %d\n",
+		tfs_seek(file2, BLOCKSIZE * 2));
+
+	printf("Reading the last appended byte... %d\n",
+		tfs_readByte(file2, &readByteBuffer));
+
+	printf("Byte read (as char): %c\n", readByteBuffer);
+
+	printf("Turning off delayed allocation... %d\n",
+		tfs_setDelayedAlloc(0));
+
+	printf("Closing a file with reserved blocks... %d\n",
+		tfs_closeFile(file1));
+}
+
+void discardDemo() {
+	int file1;
+	char largeWrite[BLOCKSIZE * 4];
+
+	memset(largeWrite, 'D', sizeof(largeWrite));
+
+	printf("\nLazy Delete and Discard Demonstration\n\n");
+
+	tfs_mkfs("testing/discard.bin", BLOCKSIZE * 20);
+
+	tfs_mount("testing/discard.bin");
+
+	file1 = tfs_openFile("File 1");
+
+	tfs_writeFile(file1, largeWrite, sizeof(largeWrite));
+
+	printf("Turning on discard... %d\n",
+		tfs_setDiscard(1));
+
+	printf("Deleting a multi-block file... %d\n",
+		tfs_deleteFile(file1));
+
+	printf("Remounting with discarded blocks in the image... %d\n",
+		tfs_mount("testing/discard.bin"));
+
+	printf("Writing into the freed blocks again... %d\n",
+		tfs_writeFile(file1, largeWrite, sizeof(largeWrite)));
+
+	printf("Turning off discard... %d\n",
+		tfs_setDiscard(0));
+}
+
+void truncateDemo() {
+	int file1, logFile, i;
+	char readByteBuffer;
+
+	printf("\nTruncate and Append Demonstration\n\n");
+
+	tfs_mkfs("testing/truncate.bin", BLOCKSIZE * 20);
+
+	tfs_mount("testing/truncate.bin");
+
+	file1 = tfs_openFile("File 1");
+	logFile = tfs_openFileFlags("File 1", OPEN_APPEND);
+
+	tfs_writeFile(file1, "truncate me", sizeof("truncate me"));
+
+	printf("Truncating a file to 8 bytes... %d\n",
+		tfs_truncate(file1, 8));
+
+	printf("Appending through an append handle... %d\n",
+		tfs_writeByte(logFile, '!'));
+
+	tfs_seek(file1, 8);
+	tfs_readByte(file1, &readByteBuffer);
+
+	printf("Byte read after the truncated end (as char): %c\n", readByteBuffer);
+
+	for(i = 0; i < BLOCKSIZE * 2; i++) {
+		tfs_writeByte(logFile, 'A');
+	}
+
+	printf("Extending a file past its blocks... %d\n",
+		tfs_truncate(file1, BLOCKSIZE * 3));
+
+	tfs_seek(file1, BLOCKSIZE * 3 - 1);
+	tfs_readByte(file1, &readByteBuffer);
+
+	printf("Byte read from the extended range (as int): %d\n", readByteBuffer);
+
+	printf("Throws an error when truncating to a negative length... %d\n",
+		tfs_truncate(file1, -1));
+}
+
+void sparseDemo() {
+	int file1;
+	char readByteBuffer;
+	FragInfo info;
+
+	printf("\nSparse File Demonstration\n\n");
+
+	tfs_mkfs("testing/sparse.bin", BLOCKSIZE * 20);
+
+	tfs_mount("testing/sparse.bin");
+
+	file1 = tfs_openFile("File 1");
+
+	printf("Seeking far past end of an empty file... %d\n",
+		tfs_seek(file1, BLOCKSIZE * 10));
+
+	printf("Writing a byte there... %d\n",
+		tfs_writeByte(file1, 'Z'));
+
+	tfs_fragInfo(&info);
+
+	printf("Data blocks used by the file: %d\n", info.dataBlocks);
+
+	tfs_seek(file1, BLOCKSIZE * 5);
+	tfs_readByte(file1, &readByteBuffer);
+
+	printf("Byte read from the hole (as int): %d\n", readByteBuffer);
+
+	tfs_seek(file1, BLOCKSIZE * 10);
+	tfs_readByte(file1, &readByteBuffer);
+
+	printf("Byte read after the hole (as char): %c\n", readByteBuffer);
+
+	printf("Extending the file by truncating... %d\n",
+		tfs_truncate(file1, BLOCKSIZE * 15));
+
+	tfs_fragInfo(&info);
+
+	printf("Data blocks used after extending: %d\n", info.dataBlocks);
+}
+
+void snapshotDemo() {
+	int file1, snapFile1;
+	char readByteBuffer;
+
+	printf("\nSnapshot Demonstration\n\n");
+
+	tfs_mkfs("testing/snapshot.bin", BLOCKSIZE * 20);
+
+	tfs_mount("testing/snapshot.bin");
+
+	file1 = tfs_openFile("File 1");
+
+	tfs_writeFile(file1, "old contents", sizeof("old contents"));
+
+	printf("Taking a snapshot... %d\n",
+		tfs_snapshot("Backup"));
+
+	printf("Throws an error if the snapshot name is taken... %d\n",
+		tfs_snapshot("Backup"));
+
+	tfs_writeFile(file1, "new contents", sizeof("new contents"));
+
+	snapFile1 = tfs_openSnapshotFile("Backup", "File 1");
+
+	tfs_readByte(file1, &readByteBuffer);
+
+	printf("First byte of the live file (as char): %c\n", readByteBuffer);
+
+	tfs_readByte(snapFile1, &readByteBuffer);
+
+	printf("First byte of the snapshot's copy (as char): %c\n", readByteBuffer);
+
+	printf("Throws an error when writing to a snapshot file... %d\n",
+		tfs_writeByte(snapFile1, 'X'));
+
+	printf("Throws an error when deleting a snapshot with open files... %d\n",
+		tfs_deleteSnapshot("Backup"));
+
+	tfs_closeFile(snapFile1);
+
+	printf("Deleting the snapshot... %d\n",
+		tfs_deleteSnapshot("Backup"));
+}
+
+void copyFileDemo() {
+	int file1, file2;
+	char readByteBuffer;
+	FragInfo info;
+
+	printf("\nFile Copy Demonstration\n\n");
+
+	tfs_mkfs("testing/copy.bin", BLOCKSIZE * 20);
+
+	tfs_mount("testing/copy.bin");
+
+	file1 = tfs_openFile("Template");
+
+	tfs_writeFile(file1, "template contents", sizeof("template contents"));
+
+	tfs_fragInfo(&info);
+
+	printf("Free blocks before copying: %d\n", info.freeBlocks);
+
+	printf("Copying a file... %d\n",
+		tfs_copyFile("Template", "Tenant 1"));
+
+	tfs_fragInfo(&info);
+
+	printf("Free blocks after copying (one for the new inode): %d\n", info.freeBlocks);
+
+	file2 = tfs_openFile("Tenant 1");
+
+	tfs_writeByte(file2, 'T');
+
+	tfs_readByte(file1, &readByteBuffer);
+
+	printf("First byte of the template after writing the copy (as char): %c\n", readByteBuffer);
+
+	tfs_seek(file2, 0);
+	tfs_readByte(file2, &readByteBuffer);
+
+	printf("First byte of the copy (as char): %c\n", readByteBuffer);
+
+	printf("Throws an error when copying a file that doesn't exist... %d\n",
+		tfs_copyFile("Nothing", "Tenant 2"));
+}
+
+void compressionDemo() {
+	int file1, i, recordSize;
+	char readByteBuffer;
+	char *record = "{\"id\": 1, \"name\": \"tenant\", \"enabled\": true}\n";
+	char contents[BLOCKSIZE * 16];
+	FragInfo info;
+
+	printf("\nCompression Demonstration\n\n");
+
+	printf("Making a compressed file system... %d\n",
+		tfs_mkfsFlags("testing/compress.bin", BLOCKSIZE * 40, MKFS_COMPRESS));
+
+	tfs_mount("testing/compress.bin");
+
+	file1 = tfs_openFile("File 1");
+
+	recordSize = strlen(record);
+
+	for(i = 0; i + recordSize <= sizeof(contents); i += recordSize) {
+		memcpy(&contents[i], record, recordSize);
+	}
+
+	printf("Writing %d bytes of JSON records... %d\n", i,
+		tfs_writeFile(file1, contents, i));
+
+	tfs_fragInfo(&info);
+
+	printf("Data blocks used: %d\n", info.dataBlocks);
+
+	tfs_seek(file1, recordSize * 50 + 3);
+	tfs_readByte(file1, &readByteBuffer);
+
+	printf("Byte read from the middle of the file (as char): %c\n", readByteBuffer);
+
+	printf("Overwriting one byte stores the file uncompressed... %d\n",
+		tfs_writeByte(file1, '2'));
+
+	tfs_fragInfo(&info);
+
+	printf("Data blocks used after the overwrite: %d\n", info.dataBlocks);
+
+	printf("Closing the file compresses it again... %d\n", tfs_closeFile(file1));
+
+	tfs_fragInfo(&info);
+
+	printf("Data blocks used after closing: %d\n", info.dataBlocks);
+
+	file1 = tfs_openFile("File 1");
+	tfs_seek(file1, recordSize * 50 + 4);
+	tfs_readByte(file1, &readByteBuffer);
+
+	printf("Byte read back where it was overwritten (as char): %c\n", readByteBuffer);
+}
+
+void dedupDemo() {
+	int file1, file2;
+	char contents[BLOCKSIZE * 4];
+	DedupInfo info;
+
+	printf("\nDeduplication Demonstration\n\n");
+
+	printf("Making a deduplicating file system... %d\n",
+		tfs_mkfsFlags("testing/dedup.bin", BLOCKSIZE * 40, MKFS_DEDUP));
+
+	tfs_mount("testing/dedup.bin");
+
+	file1 = tfs_openFile("File 1");
+	file2 = tfs_openFile("File 2");
+
+	memset(contents, 'd', sizeof(contents));
+
+	printf("Writing the same %d bytes to two files... %d %d\n", (int)sizeof(contents),
+		tfs_writeFile(file1, contents, sizeof(contents)),
+		tfs_writeFile(file2, contents, sizeof(contents)));
+
+	tfs_dedupInfo(&info);
+
+	printf("Blocks in files: %d, blocks stored: %d\n", info.logicalBlocks, info.physicalBlocks);
+
+	printf("Deleting File 1... %d\n", tfs_deleteFile(file1));
+
+	tfs_dedupInfo(&info);
+
+	printf("Blocks in files: %d, blocks stored: %d\n", info.logicalBlocks, info.physicalBlocks);
+}
+
+void logDemo() {
+	int file1, i, steps = 0;
+	char readByteBuffer;
+	char contents[BLOCKSIZE * 4];
+	LogInfo info;
+
+	printf("\nLog-Structured Demonstration\n\n");
+
+	printf("Making a log-structured file system... %d\n",
+		tfs_mkfsFlags("testing/log.bin", BLOCKSIZE * (1 + 5 * LOG_SEGMENT_BLOCKS), MKFS_LOG));
+
+	tfs_mount("testing/log.bin");
+
+	file1 = tfs_openFile("File 1");
+
+	memset(contents, 'l', sizeof(contents));
+
+	printf("Writing %d bytes... %d\n", (int)sizeof(contents),
+		tfs_writeFile(file1, contents, sizeof(contents)));
+
+	//	scattered one byte writes, each of which rewrites a data block and the inode
+	for(i = 0; i < 40; i++) {
+		tfs_seek(file1, (i * 397) % sizeof(contents));
+		tfs_writeByte(file1, 'L');
+	}
+
+	tfs_logInfo(&info);
+
+	printf("After 40 scattered writes: %d live blocks, %d dead, %d of %d segments clean\n",
+		info.liveBlocks, info.deadBlocks, info.cleanSegments, info.segments);
+
+	while(tfs_clean(8) == CLEAN_IN_PROGRESS) {
+		steps++;
+	}
+
+	tfs_logInfo(&info);
+
+	printf("Cleaned in %d steps: %d live blocks, %d dead, %d of %d segments clean\n",
+		steps + 1, info.liveBlocks, info.deadBlocks, info.cleanSegments, info.segments);
+
+	tfs_seek(file1, 397);
+	tfs_readByte(file1, &readByteBuffer);
+
+	printf("Byte read from a rewritten block (as char): %c\n", readByteBuffer);
+}
+
+void directoryDemo() {
+	int file1, i, found;
+	char readByteBuffer;
+	char name[20];
+
+	printf("\nDirectory Demonstration\n\n");
+
+	tfs_mkfs("testing/directory.bin", BLOCKSIZE * 200);
+
+	tfs_mount("testing/directory.bin");
+
+	printf("Making directory docs... %d\n",
+		tfs_mkdir("docs"));
+
+	printf("Making directory docs/drafts... %d\n",
+		tfs_mkdir("/docs/drafts"));
+
+	file1 = tfs_openFile("docs/drafts/plan");
+
+	printf("Writing to docs/drafts/plan... %d\n",
+		tfs_writeFile(file1, "in a subdirectory", sizeof("in a subdirectory")));
+
+	tfs_openFile("notes");
+
+	printf("Listing files in filesystem:\n");
+	tfs_readdir();
+
+	printf("\nThrows an error when the directory does not exist... %d\n",
+		tfs_openFile("missing/file"));
+
+	printf("Throws an error when opening a directory as a file... %d\n",
+		tfs_openFile("docs"));
+
+	printf("Throws an error when the directory already exists... %d\n",
+		tfs_mkdir("docs"));
+
+	printf("Throws an error when moving a directory into itself... %d\n",
+		tfs_rename("docs", "docs/drafts/docs"));
+
+	printf("Moving docs/drafts/plan to plan... %d\n",
+		tfs_rename("docs/drafts/plan", "plan"));
+
+	printf("Renaming directory docs to archive... %d\n",
+		tfs_rename("docs", "archive"));
+
+	printf("Moving notes to archive/drafts/notes... %d\n",
+		tfs_rename("notes", "archive/drafts/notes"));
+
+	//	enough entries for the directory's B-tree to split a few times
+	tfs_mkdir("many");
+
+	for(i = 0; i < 40; i++) {
+		sprintf(name, "many/d%02d", (i * 17) % 40);
+		tfs_mkdir(name);
+	}
+
+	printf("Listing files in filesystem:\n");
+	tfs_readdir();
+
+	printf("\nOpening archive/drafts/notes... %d\n",
+		tfs_openFile("archive/drafts/notes") >= 0);
+
+	for(i = 0, found = 0; i < 40; i++) {
+		sprintf(name, "many/d%02d/sub", i);
+
+		if(tfs_mkdir(name) == MKDIR_SUCCESS) found++;
+	}
+
+	printf("Directories found under many: %d of 40\n", found);
+
+	tfs_seek(file1, 3);
+	tfs_readByte(file1, &readByteBuffer);
+
+	printf("Byte read from the moved file (as char): %c\n", readByteBuffer);
+}
+
+void directoryStreamDemo() {
+	int file1, i, entry, filled, batch = 0, total = 0;
+	char name[20];
+	DirEntry entries[4];
+	dirDescriptor DD;
+
+	printf("\nDirectory Stream Demonstration\n\n");
+
+	tfs_mkfs("testing/directoryStream.bin", BLOCKSIZE * 60);
+
+	tfs_mount("testing/directoryStream.bin");
+
+	tfs_mkdir("logs");
+	tfs_mkdir("logs/old");
+
+	//	created out of order, listed in order
+	for(i = 0; i < 20; i++) {
+		sprintf(name, "logs/e%02d", (i * 7) % 20);
+		file1 = tfs_openFile(name);
+		tfs_writeFile(file1, name, i + 1);
+	}
+
+	tfs_openFile("logs/x");
+
+	DD = tfs_opendir("logs", "e1", DIR_STAT);
+
+	printf("Opening a stream over logs/e1*... %d\n", DD >= 0);
+
+	while((filled = tfs_readdir_r(DD, entries, 4)) > 0) {
+		printf("Batch %d:", ++batch);
+
+		for(entry = 0; entry < filled; entry++) {
+			printf(" %s (%lld bytes)", entries[entry].name, (long long)entries[entry].size);
+		}
+
+		printf("\n");
+	}
+
+	printf("Closing the stream... %d\n",
+		tfs_closedir(DD));
+
+	DD = tfs_opendir("/logs", NULL, 0);
+
+	while((filled = tfs_readdir_r(DD, entries, 4)) > 0) {
+		total += filled;
+		sprintf(name, "%s%s", entries[filled - 1].name, entries[filled - 1].directory ? "/" : "");
+	}
+
+	printf("Entries in logs: %d, last one: %s\n", total, name);
+
+	tfs_closedir(DD);
+
+	printf("Throws an error when opening a file as a directory... %d\n",
+		tfs_opendir("logs/x", NULL, 0));
+
+	printf("Throws an error when reading a closed stream... %d\n",
+		tfs_readdir_r(DD, entries, 4));
+}
+
+void batchDemo() {
+	int i;
+	BatchOp ops[6] = {
+		{ BATCH_OPEN, "etc/hosts" },
+		{ BATCH_OPEN, "etc/passwd" },
+		{ BATCH_OPEN, "motd" },
+		{ BATCH_MAKE_RO, "etc/passwd" },
+		{ BATCH_STAT, "etc" },
+		{ BATCH_MAKE_RO, "etc/missing" }
+	};
+
+	printf("\nBatched Metadata Demonstration\n\n");
+
+	tfs_mkfs("testing/batch.bin", BLOCKSIZE * 20);
+
+	tfs_mount("testing/batch.bin");
+
+	tfs_mkdir("etc");
+
+	printf("Running a batch of 6 operations... %d\n",
+		tfs_batch(ops, 6));
+
+	for(i = 0; i < 6; i++) {
+		printf("%s %s... %d\n", ops[i].op == BATCH_OPEN ? "Opening" : ops[i].op == BATCH_STAT ?
+			"Reading info of" : "Making read-only", ops[i].name, ops[i].result);
+	}
+
+	printf("etc is a directory... %d\n", ops[4].info.directory);
+
+	printf("Throws an error when writing to a file the batch made read-only... %d\n",
+		tfs_writeFile(ops[1].result, "locked", sizeof("locked")));
+}
+
+void transactionDemo() {
+	int file1, file2;
+	char readByteBuffer;
+
+	printf("\nTransaction Demonstration\n\n");
+
+	tfs_mkfs("testing/transaction.bin", BLOCKSIZE * 20);
+
+	tfs_mount("testing/transaction.bin");
+
+	file1 = tfs_openFile("ledger");
+	file2 = tfs_openFile("journal");
+
+	tfs_writeFile(file1, "old ledger", sizeof("old ledger"));
+	tfs_writeFile(file2, "old journal", sizeof("old journal"));
+
+	printf("Starting a transaction... %d\n",
+		tfs_begin());
+
+	printf("Throws an error when a transaction is already open... %d\n",
+		tfs_begin());
+
+	printf("Staging a write to ledger... %d\n",
+		tfs_writeFile(file1, "new ledger", sizeof("new ledger")));
+
+	printf("Staging a rename of journal to archive... %d\n",
+		tfs_rename("journal", "archive"));
+
+	printf("Throws an error when journal was already renamed in the transaction... %d\n",
+		tfs_rename("journal", "other"));
+
+	tfs_readByte(file1, &readByteBuffer);
+	printf("First byte of ledger before committing (as char): %c\n", readByteBuffer);
+
+	printf("Aborting the transaction... %d\n",
+		tfs_abort());
+
+	tfs_seek(file1, 0);
+	tfs_readByte(file1, &readByteBuffer);
+	printf("First byte of ledger after aborting (as char): %c\n", readByteBuffer);
+
+	tfs_begin();
+
+	tfs_writeFile(file1, "new ledger", sizeof("new ledger"));
+	tfs_rename("journal", "archive");
+	tfs_writeFile(file2, "new journal", sizeof("new journal"));
+	tfs_rename("archive", "journal");
+
+	printf("Committing 4 staged operations... %d\n",
+		tfs_commit());
+
+	tfs_readByte(file1, &readByteBuffer);
+	printf("First byte of ledger after committing (as char): %c\n", readByteBuffer);
+
+	tfs_readByte(file2, &readByteBuffer);
+	printf("First byte of journal after committing (as char): %c\n", readByteBuffer);
+
+	tfs_begin();
+
+	tfs_deleteFile(file1);
+	tfs_writeFile(file2, "lost", sizeof("lost"));
+	tfs_closeFile(file2);
+
+	printf("Throws an error when committing a write to a closed file... %d\n",
+		tfs_commit());
+
+	tfs_seek(file1, 0);
+	printf("Reading ledger, which the failed commit left alone... %d\n",
+		tfs_readByte(file1, &readByteBuffer));
+
+	printf("Throws an error when aborting with no transaction open... %d\n",
+		tfs_abort());
+}
+
+void durabilityDemo() {
+	int file1, file2;
+
+	printf("\nDurability Demonstration\n\n");
+
+	tfs_mkfs("testing/durability.bin", BLOCKSIZE * 20);
+
+	tfs_mount("testing/durability.bin");
+
+	printf("Syncing after every operation... %d\n",
+		tfs_setDurability(DURABILITY_SYNC));
+
+	file1 = tfs_openFile("File 1");
+
+	printf("Writing a file, synced before returning... %d\n",
+		tfs_writeFile(file1, "durable", sizeof("durable")));
+
+	printf("Throws an error for an unknown durability level... %d\n",
+		tfs_setDurability(DURABILITY_SYNC + 1));
+
+	printf("Only syncing when files close... %d\n",
+		tfs_setDurability(DURABILITY_CLOSE));
+
+	printf("Opening a file that syncs its own changes... FD: %d\n",
+		(file2 = tfs_openFileFlags("File 2", OPEN_SYNC)));
+
+	tfs_setDelayedAlloc(1);
+
+	printf("Writing a byte through it flushes and syncs it... %d\n",
+		tfs_writeByte(file2, 'S'));
+
+	printf("Writing a byte held back by delayed allocation... %d\n",
+		tfs_writeByte(file1, '!'));
+
+	printf("Syncing the file holding it back... %d\n",
+		tfs_fsync(file1));
+
+	printf("Syncing the whole file system... %d\n",
+		tfs_sync());
+
+	printf("Closing a file syncs the image... %d\n",
+		tfs_closeFile(file1));
+
+	printf("Throws an error when syncing a closed file... %d\n",
+		tfs_fsync(file1));
+
+	tfs_setDelayedAlloc(0);
+}
+
+void readAheadDemo() {
+	int file1, file2, i, matched, size = (BLOCKSIZE - 2) * 40;
+	char content[size];
+	char readByteBuffer;
+
+	printf("\nRead-Ahead Demonstration\n\n");
+
+	for(i = 0; i < size; i++) {
+		content[i] = 'a' + i % 26;
+	}
+
+	tfs_mkfs("testing/readAhead.bin", BLOCKSIZE * 60);
+
+	tfs_mount("testing/readAhead.bin");
+
+	file1 = tfs_openFile("scan");
+	file2 = tfs_openFile("scan");
+
+	tfs_writeFile(file1, content, size);
+
+	for(i = 0, matched = 0; i < size; i++) {
+		if(tfs_readByte(file1, &readByteBuffer) == READ_BYTE_SUCCESS && readByteBuffer == content[i]) matched++;
+	}
+
+	printf("Bytes read front to back that match: %d of %d\n", matched, size);
+
+	for(i = 0, matched = 0; i < 100; i++) {
+		tfs_seek(file1, (i * 7919) % size);
+
+		if(tfs_readByte(file1, &readByteBuffer) == READ_BYTE_SUCCESS && readByteBuffer == content[(i * 7919) % size]) matched++;
+	}
+
+	printf("Bytes read at scattered offsets that match: %d of 100\n", matched);
+
+	tfs_seek(file1, 0);
+	tfs_readByte(file1, &readByteBuffer);
+
+	//	the blocks read ahead by file1 are dropped when file2 writes
+	tfs_seek(file2, 1);
+	tfs_writeByte(file2, 'Z');
+
+	tfs_readByte(file1, &readByteBuffer);
+	printf("Byte written through another handle after reading ahead (as char): %c\n", readByteBuffer);
+}
+
+void writeBufferDemo() {
+	int file1, file2, i, matched, size = (BLOCKSIZE - 2) * 4 + 10;
+	char readByteBuffer;
+
+	printf("\nWrite Buffer Demonstration\n\n");
+
+	tfs_mkfs("testing/writeBuffer.bin", BLOCKSIZE * 20);
+
+	tfs_mount("testing/writeBuffer.bin");
+
+	file1 = tfs_openFile("journal");
+	file2 = tfs_openFile("journal");
+
+	//	each block is written once, when the bytes move on to the next one
+	for(i = 0; i < size; i++) {
+		tfs_writeByte(file1, 'a' + i % 26);
+	}
+
+	for(i = 0, matched = 0; i < size; i++) {
+		if(tfs_readByte(file2, &readByteBuffer) == READ_BYTE_SUCCESS && readByteBuffer == 'a' + i % 26) matched++;
+	}
+
+	printf("Bytes written one at a time read back through another handle: %d of %d\n", matched, size);
+
+	tfs_seek(file1, 100);
+	tfs_writeByte(file1, 'X');
+	tfs_writeByte(file1, 'Y');
+
+	//	the read flushes the bytes file1 still holds
+	tfs_seek(file2, 101);
+	tfs_readByte(file2, &readByteBuffer);
+	printf("Byte overwritten in the middle of the file (as char): %c\n", readByteBuffer);
+
+	tfs_writeByte(file1, 'Z');
+
+	printf("Making the file read-only keeps the byte held back... %d\n",
+		tfs_makeRO("journal"));
+
+	tfs_readByte(file2, &readByteBuffer);
+	printf("Byte read after it (as char): %c\n", readByteBuffer);
+
+	printf("Throws an error when writing a byte to the read-only file... %d\n",
+		tfs_writeByte(file1, 'W'));
+}
+
+void readViewDemo() {
+	int file1, i, lines, size = (BLOCKSIZE - 2) * 6;
+	char content[size];
+	ReadView view;
+
+	printf("\nRead View Demonstration\n\n");
+
+	for(i = 0; i < size; i++) {
+		content[i] = i % 40 == 39 ? '\n' : 'r';
+	}
+
+	tfs_mkfs("testing/readView.bin", BLOCKSIZE * 20);
+
+	tfs_mount("testing/readView.bin");
+
+	file1 = tfs_openFile("records");
+
+	tfs_writeFile(file1, content, size);
+
+	printf("Viewing 1000 bytes from offset 300... %d\n",
+		tfs_readView(file1, 300, 1000, &view));
+
+	printf("Slices in the view: %d, bytes: %d\n", view.count, view.length);
+
+	//	the records are parsed in place, straight out of the slices
+	for(i = 0, lines = 0; i < view.count; i++) {
+		lines += (int)(memchr(view.slices[i].data, '\n', view.slices[i].length) != NULL);
+	}
+
+	printf("Slices holding the end of a record: %d\n", lines);
+
+	tfs_writeFile(file1, "overwritten", 11);
+
+	printf("First byte of the view after the file is rewritten (as char): %c\n", view.slices[0].data[0]);
+
+	printf("Releasing the view... %d\n",
+		tfs_releaseView(&view));
+
+	printf("A view past the end of file is cut short... %d\n",
+		tfs_readView(file1, 5, 100, &view));
+
+	printf("Bytes in it: %d\n", view.length);
+
+	tfs_releaseView(&view);
+
+	printf("Throws an error when the view starts past the end of file... %d\n",
+		tfs_readView(file1, 12, 1, &view));
+}
+
+void mmapDemo() {
+	int file1, i, entries = (BLOCKSIZE - 2) * 8 / sizeof(int);
+	int table[entries], *mapped;
+	char readByteBuffer;
+
+	printf("\nMemory Map Demonstration\n\n");
+
+	for(i = 0; i < entries; i++) {
+		table[i] = i * i;
+	}
+
+	tfs_mkfs("testing/mmap.bin", BLOCKSIZE * 20);
+
+	tfs_mount("testing/mmap.bin");
+
+	file1 = tfs_openFile("squares");
+
+	tfs_writeFile(file1, (char *)table, sizeof(table));
+
+	mapped = tfs_mmap(file1, 0, sizeof(table), MMAP_READ | MMAP_WRITE);
+
+	//	lookups in the mapped table are plain array reads
+	printf("Entry 300 of the mapped table: %d\n", mapped[300]);
+
+	mapped[1] = 'M';
+
+	printf("Writing the change back... %d\n",
+		tfs_msync(mapped));
+
+	tfs_seek(file1, sizeof(int));
+	tfs_readByte(file1, &readByteBuffer);
+	printf("Byte read through the file handle (as char): %c\n", readByteBuffer);
+
+	printf("Unmapping the table... %d\n",
+		tfs_munmap(mapped));
+
+	printf("Throws an error when unmapping it twice... %d\n",
+		tfs_munmap(mapped));
+
+	tfs_makeRO("squares");
+
+	printf("Mapping a read-only file for writing fails: %s\n",
+		tfs_mmap(file1, 0, 16, MMAP_READ | MMAP_WRITE) == NULL ? "yes" : "no");
+}
+
+void hostCopyDemo() {
+	int file1, i, size = (BLOCKSIZE - 2) * 5 + 3;
+	char content[size], exported[size + 1];
+	char readByteBuffer;
+	FILE *host;
+
+	printf("\nHost Import and Export Demonstration\n\n");
+
+	for(i = 0; i < size; i++) {
+		content[i] = 'A' + i % 26;
+	}
+
+	host = fopen("testing/host.txt", "w");
+	fwrite(content, 1, size, host);
+	fclose(host);
+
+	tfs_mkfs("testing/hostCopy.bin", BLOCKSIZE * 20);
+
+	tfs_mount("testing/hostCopy.bin");
+
+	printf("Importing testing/host.txt... %d\n",
+		tfs_importFile("testing/host.txt", "imported"));
+
+	file1 = tfs_openFile("imported");
+	tfs_seek(file1, size - 1);
+	tfs_readByte(file1, &readByteBuffer);
+	printf("Last byte of the imported file (as char): %c\n", readByteBuffer);
+
+	printf("Exporting it to testing/export.txt... %d\n",
+		tfs_exportFile("imported", "testing/export.txt"));
+
+	host = fopen("testing/export.txt", "r");
+	printf("Exported file matches the host file: %s\n",
+		fread(exported, 1, size + 1, host) == size && memcmp(exported, content, size) == 0 ? "yes" : "no");
+	fclose(host);
+
+	printf("Throws an error when the host file doesn't exist... %d\n",
+		tfs_importFile("testing/missing.txt", "imported"));
+
+	printf("Throws an error when exporting a file that doesn't exist... %d\n",
+		tfs_exportFile("missing", "testing/export.txt"));
+}
+
+void vectorDemo() {
+	int file1, i, matching = 0;
+	char header[] = "HDR:", body[BLOCKSIZE * 2], trailer[] = "END";
+	char readHeader[4], readBody[BLOCKSIZE * 2], readTrailer[3];
+	struct iovec record[3] = {
+		{ header, 4 },
+		{ body, sizeof(body) },
+		{ trailer, 3 }
+	};
+	struct iovec readRecord[3] = {
+		{ readHeader, 4 },
+		{ readBody, sizeof(readBody) },
+		{ readTrailer, 3 }
+	};
+	struct iovec patch = { "hdr", 3 };
+
+	printf("\nVectored I/O Demonstration\n\n");
+
+	for(i = 0; i < sizeof(body); i++) {
+		body[i] = 'a' + i % 26;
+	}
+
+	tfs_mkfs("testing/vector.bin", BLOCKSIZE * 20);
+
+	tfs_mount("testing/vector.bin");
+
+	file1 = tfs_openFile("records");
+
+	//	header, body and trailer land in one pass with one inode update
+	printf("Writing a header, body and trailer in one call... %d\n",
+		tfs_writev(file1, record, 3));
+
+	printf("Writing the record again after it... %d\n",
+		tfs_writev(file1, record, 3));
+
+	printf("Patching the first header in place... %d\n",
+		tfs_pwritev(file1, &patch, 1, 0));
+
+	printf("Reading the second record back into three buffers... %d\n",
+		tfs_preadv(file1, readRecord, 3, sizeof(body) + 7));
+
+	for(i = 0; i < sizeof(body); i++) {
+		matching += readBody[i] == body[i];
+	}
+
+	printf("Header: %.4s, body bytes that match: %d of %d, trailer: %.3s\n",
+		readHeader, matching, (int) sizeof(body), readTrailer);
+
+	tfs_seek(file1, 0);
+
+	printf("Reading from the file pointer... %d\n",
+		tfs_readv(file1, readRecord, 1));
+	printf("First header (as chars): %.4s\n", readHeader);
+
+	tfs_seek(file1, (sizeof(body) + 7) * 2);
+
+	printf("Reading at the end of file... %d\n",
+		tfs_readv(file1, readRecord, 3));
+
+	printf("Throws an error when reading past the end of file... %d\n",
+		tfs_preadv(file1, readRecord, 3, sizeof(body) * 3));
+
+	tfs_makeRO("records");
+
+	printf("Throws an error when writing to a read-only file... %d\n",
+		tfs_writev(file1, record, 3));
+}
+
+#define PREAD_RECORDS 100
+#define PREAD_THREADS 4
+
+void preadDemo() {
+	int file1, file2, i, matching = 0;
+	int reads[PREAD_THREADS][2];
+	char records[PREAD_RECORDS * 16];
+	char readBuffer[16], readByteBuffer;
+	pthread_t threads[PREAD_THREADS];
+
+	printf("\nPositional Read Demonstration\n\n");
+
+	for(i = 0; i < PREAD_RECORDS; i++) {
+		sprintf(records + i * 16, "record %03d     ", i);
+		records[i * 16 + 15] = '\n';
+	}
+
+	tfs_mkfs("testing/pread.bin", BLOCKSIZE * 20);
+
+	tfs_mount("testing/pread.bin");
+
+	file1 = tfs_openFile("records");
+	tfs_writeFile(file1, records, sizeof(records));
+
+	//	every thread reads every record through the same handle
+	for(i = 0; i < PREAD_THREADS; i++) {
+		reads[i][0] = file1;
+		pthread_create(&threads[i], NULL, preadRecords, reads[i]);
+	}
+
+	for(i = 0; i < PREAD_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+		matching += reads[i][1];
+	}
+
+	printf("Records read by %d threads at once that match: %d of %d\n",
+		PREAD_THREADS, matching, PREAD_THREADS * PREAD_RECORDS);
+
+	printf("Reading record 42... %d\n",
+		tfs_pread(file1, readBuffer, 16, 42 * 16));
+	printf("Record read (as chars): %.10s\n", readBuffer);
+
+	tfs_readByte(file1, &readByteBuffer);
+	printf("Byte read at the untouched file pointer (as char): %c\n", readByteBuffer);
+
+	file2 = tfs_openFile("records");
+	tfs_seek(file2, sizeof(records));
+	tfs_writeByte(file2, 'P');
+
+	printf("Reading past the old end of file... %d\n",
+		tfs_pread(file1, readBuffer, 16, sizeof(records)));
+	printf("Byte another handle still holds (as char): %c\n", readBuffer[0]);
+
+	printf("Throws an error when reading past the end of file... %d\n",
+		tfs_pread(file1, readBuffer, 16, sizeof(records) + 2));
+}
+
+/* Reads every record of the file whose FD is in arg[0] and counts those that match in
+ * arg[1]
+ */
+void *preadRecords(void *arg) {
+	int *reads = arg, i;
+	char readBuffer[16], expected[17];
+
+	reads[1] = 0;
+
+	for(i = 0; i < PREAD_RECORDS; i++) {
+		sprintf(expected, "record %03d     ", i);
+
+		if(tfs_pread(reads[0], readBuffer, 16, i * 16) == 16 && memcmp(readBuffer, expected, 15) == 0) {
+			reads[1]++;
+		}
+	}
+
+	return NULL;
+}
+
+void largeFileDemo() {
+	int file1;
+	char readByteBuffer;
+	DirEntry entry;
+	dirDescriptor DD;
+	off_t largeOffset = (off_t) 3 << 30;
+
+	printf("\nLarge File Demonstration\n\n");
+
+	tfs_mkfs("testing/largeFile.bin", BLOCKSIZE * 20);
+
+	tfs_mount("testing/largeFile.bin");
+
+	file1 = tfs_openFile("big");
+
+	//	3 GiB is past what an int offset can hold; the hole before it takes no blocks
+	printf("Seeking 3 GiB into an empty file... %d\n",
+		tfs_seek(file1, largeOffset));
+
+	printf("Writing a byte there... %d\n",
+		tfs_writeByte(file1, 'G'));
+
+	DD = tfs_opendir("/", NULL, DIR_STAT);
+	tfs_readdir_r(DD, &entry, 1);
+	tfs_closedir(DD);
+
+	printf("Size of the file: %lld bytes\n", (long long)entry.size);
+
+	printf("Reading the byte back... %d\n",
+		tfs_pread(file1, &readByteBuffer, 1, largeOffset));
+	printf("Byte read (as char): %c\n", readByteBuffer);
+
+	printf("Throws an error when truncating past the largest file... %d\n",
+		tfs_truncate(file1, MAX_FILE_SIZE + 1));
+
+	printf("Deleting the file... %d\n",
+		tfs_deleteFile(file1));
+}
+
+void fsckDemo() {
+	int file1, i;
+	char name[16], record[BLOCKSIZE * 3];
+	FsckInfo info;
+	FILE *host;
+
+	printf("\nConsistency Check Demonstration\n\n");
+
+	memset(record, 'F', sizeof(record));
+
+	//	4 chunks of SCAN_CHUNK_BLOCKS, so the scans split the disk between workers
+	tfs_mkfs("testing/fsck.bin", BLOCKSIZE * 1024);
+
+	tfs_mount("testing/fsck.bin");
+
+	//	enough entries to split the directory's B-tree
+	tfs_mkdir("logs");
+
+	for(i = 0; i < 40; i++) {
+		sprintf(name, "logs/f%02d", i);
+		file1 = tfs_openFile(name);
+		tfs_writeFile(file1, record, 100 + i);
+		tfs_closeFile(file1);
+	}
+
+	file1 = tfs_openFile("shared");
+	tfs_writeFile(file1, record, sizeof(record));
+	tfs_snapshot("before");
+
+	//	the snapshot keeps the old first block, the file gets a new one
+	tfs_writeByte(file1, 'f');
+
+	printf("Checking the file system... %d\n",
+		tfs_fsck(&info));
+	printf("Blocks checked: %d, free: %d, in use: %d, leaked: %d\n",
+		info.blocks, info.freeBlocks, info.usedBlocks, info.leakedBlocks);
+
+	//	wipe the magic number of the last block behind the file system's back
+	host = fopen("testing/fsck.bin", "r+");
+	fseek(host, (long) BLOCKSIZE * 1023 + 1, SEEK_SET);
+	fputc(0x12, host);
+	fclose(host);
+
+	printf("Throws an error when a block has lost its magic number... %d\n",
+		tfs_fsck(&info));
+	printf("Bad blocks: %d\n", info.badBlocks);
+
+	printf("Throws an error when remounting it... %d\n",
+		tfs_mount("testing/fsck.bin"));
+}
@@ -0,0 +1,82 @@
+#include <time.h>
+#include <sys/stat.h>
+
+#include "tinyFS.h"
+#include "tinyFS_errno.h"
+
+#define HOST_COPY_DISK_NAME "testing/hostCopy.bin"
+
+double secondsSince(struct timespec *start);
+
+/* Moves a host file into a TinyFS image and back out again. File systems only live in the
+ * process that made them, so it formats an image big enough for the input (with the
+ * given MKFS_* flags), imports the input with tfs_importFile(), exports it to the output
+ * with tfs_exportFile() and reports the throughput of each direction. The output should
+ * come out identical to the input.
+ *
+ *	usage: tinyFsHostCopy input output [mkfs flags]
+ */
+int main(int argc, char *argv[]) {
+	struct stat inputStat;
+	struct timespec start;
+	double importSeconds, exportSeconds, megabytes;
+	int flags = 0, blocks, result;
+
+	if(argc > 3) flags = atoi(argv[3]);
+
+	if(argc < 3 || flags < 0 || flags > (MKFS_COMPRESS | MKFS_DEDUP | MKFS_LOG)) {
+		fprintf(stderr, "usage: %s input output [mkfs flags 0-%d]\n", argv[0],
+			MKFS_COMPRESS | MKFS_DEDUP | MKFS_LOG);
+		return 1;
+	}
+
+	if(stat(argv[1], &inputStat) < 0) {
+		fprintf(stderr, "can't read %s\n", argv[1]);
+		return 1;
+	}
+
+	//	every payload block and the inode, with room to spare for the log and its cleaner
+	blocks = inputStat.st_size / (BLOCKSIZE - 2) + 16;
+
+	if(flags & MKFS_LOG) blocks *= 2;
+
+	if(tfs_mkfsFlags(HOST_COPY_DISK_NAME, (off_t) BLOCKSIZE * blocks, flags) < 0 || tfs_mount(HOST_COPY_DISK_NAME) < 0) {
+		fprintf(stderr, "could not make %s\n", HOST_COPY_DISK_NAME);
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if((result = tfs_importFile(argv[1], "copy")) < 0) {
+		fprintf(stderr, "import failed... %d\n", result);
+		return 1;
+	}
+
+	importSeconds = secondsSince(&start);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if((result = tfs_exportFile("copy", argv[2])) < 0) {
+		fprintf(stderr, "export failed... %d\n", result);
+		return 1;
+	}
+
+	exportSeconds = secondsSince(&start);
+
+	tfs_unmount();
+
+	megabytes = (double)inputStat.st_size / (1024 * 1024);
+
+	printf("import: %.1f MB in %.3f s (%.1f MB/s)\n", megabytes, importSeconds, megabytes / importSeconds);
+	printf("export: %.1f MB in %.3f s (%.1f MB/s)\n", megabytes, exportSeconds, megabytes / exportSeconds);
+
+	return 0;
+}
+
+double secondsSince(struct timespec *start) {
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}